@@ -0,0 +1,383 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include "CircleBatch.hpp"
+#include "Environment.hpp"
+#include "ParticleStore.hpp"
+#include "RenderFrame.hpp"
+#include "SpatialGrid.hpp"
+#include "TextBatch.hpp"
+
+
+// Benchmarks for the simulation core. Configure with -DCMAKE_BUILD_TYPE=Release for
+// numbers worth comparing. Run with
+//     a.out.bench --benchmark_out=bench.json --benchmark_out_format=json
+// to save the results, and compare the files from two builds with the compare.py
+// script that comes with Google Benchmark.
+namespace
+{
+    const double WIDTH = 1300;
+    const double HEIGHT = 1200;
+    const double PI = std::atan(1) * 4;
+
+    // How the particles of a scene are laid out.
+    enum class Scene
+    {
+        // Spread evenly over the whole environment.
+        Uniform,
+        // Bunched up into a few tight clusters.
+        Clustered,
+        // Orbiting a heavy body in the middle, in a flat disk.
+        Disk
+    };
+
+    const char* const SCENE_NAMES[] = {"uniform", "clustered", "disk"};
+    const char* const SOLVER_NAMES[] = {"reference", "direct", "barneshut", "multipole", "mesh"};
+    const char* const INTEGRATOR_NAMES[] = {"euler", "leapfrog", "block"};
+
+
+    // Return a radius that leaves room between n particles spread over the
+    // environment, so large scenes aren't one big collision.
+    double radiusFor(unsigned n)
+    {
+        return std::min(3.0, std::max(0.2, 0.25 * std::sqrt(WIDTH * HEIGHT / n)));
+    }
+
+
+    // Fill an environment with n particles laid out like the scene. The same n
+    // always gives the same particles.
+    void fill(Environment& env, Scene scene, unsigned n)
+    {
+        std::mt19937 rng(n);
+        std::uniform_real_distribution<double> unit(0, 1);
+        double radius = radiusFor(n);
+
+        env.getParticles().reserve(n);
+
+        if (Scene::Uniform == scene)
+        {
+            for (unsigned i = 0; i < n; ++i)
+            {
+                env.placeParticle(Particle(radius, unit(rng) * WIDTH, unit(rng) * HEIGHT, MotionVector<double>(0, 0)));
+            }
+        }
+        else if (Scene::Clustered == scene)
+        {
+            const unsigned CLUSTERS = 8;
+            std::normal_distribution<double> spread(0, 40);
+            double centers[CLUSTERS][2];
+            for (auto& c : centers)
+            {
+                c[0] = 150 + unit(rng) * (WIDTH - 300);
+                c[1] = 150 + unit(rng) * (HEIGHT - 300);
+            }
+
+            for (unsigned i = 0; i < n; ++i)
+            {
+                const double* c = centers[i % CLUSTERS];
+                env.placeParticle(Particle(radius, c[0] + spread(rng), c[1] + spread(rng), MotionVector<double>(0, 0)));
+            }
+        }
+        else
+        {
+            double sunRadius = 30;
+            double cx = WIDTH / 2;
+            double cy = HEIGHT / 2;
+            env.placeParticle(Particle(sunRadius, cx, cy, MotionVector<double>(0, 0)));
+
+            // Each particle starts on a circular orbit around the sun.
+            double gm = GRAVITATIONAL_CONSTANT * Particle::calcMass(sunRadius, PARTICLE_DENSITY);
+            for (unsigned i = 1; i < n; ++i)
+            {
+                double r = 80 + unit(rng) * 450;
+                double angle = unit(rng) * 2 * PI;
+                double speed = std::sqrt(gm / r);
+                env.placeParticle(Particle(
+                    radius,
+                    cx + r * std::cos(angle),
+                    cy + r * std::sin(angle),
+                    MotionVector<double>(-speed * std::sin(angle), speed * std::cos(angle))
+                ));
+            }
+        }
+    }
+
+
+    // One update of a whole environment, including collisions.
+    void updateEnvironment(benchmark::State& state, Environment::Solver solver, Environment::Integrator integrator, Scene scene)
+    {
+        unsigned n = state.range(0);
+        Environment env(0);
+        env.setSolver(solver);
+        env.setIntegrator(integrator);
+        env.setThreads(ThreadPool::hardwareThreads());
+        fill(env, scene, n);
+
+        for (auto _ : state)
+        {
+            env.update();
+        }
+
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["particles"] = env.getParticles().size();
+    }
+
+
+    // Find every pair of touching particles in a scene with a grid.
+    void findCollisions(benchmark::State& state)
+    {
+        unsigned n = state.range(0);
+        Environment env(0);
+        fill(env, Scene::Clustered, n);
+        const ParticleStore& particles = env.getParticles();
+
+        SpatialGrid grid;
+        std::vector<unsigned> nearby;
+        for (auto _ : state)
+        {
+            grid.build(particles.x, particles.y, particles.radius);
+
+            unsigned touching = 0;
+            for (unsigned i = 0; i < particles.size(); ++i)
+            {
+                nearby.clear();
+                grid.candidatesFor(i, nearby);
+                for (unsigned j : nearby)
+                {
+                    touching += particles.isColliding(i, j);
+                }
+            }
+            benchmark::DoNotOptimize(touching);
+        }
+
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+
+    // Merge n pairs of touching particles in a store.
+    void coalesceStore(benchmark::State& state)
+    {
+        unsigned n = state.range(0);
+        ParticleStore pairs;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            pairs.add(3, 10 + i % 1000, 10 + i / 1000 * 10, 1, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+            pairs.add(2, 12 + i % 1000, 10 + i / 1000 * 10, -1, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+        }
+
+        ParticleStore store;
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            store = pairs;
+            state.ResumeTiming();
+
+            for (unsigned i = 0; i < n; ++i)
+            {
+                benchmark::DoNotOptimize(store.coalesce(2 * i, 2 * i + 1, ELASTICITY_CONSTANT));
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+
+    // Merge a touching pair of Particle objects.
+    void coalesceParticles(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            Particle a(3, 10, 10, MotionVector<double>(1, 0));
+            Particle b(2, 12, 10, MotionVector<double>(-1, 0));
+            a.coalesce(b, ELASTICITY_CONSTANT);
+            benchmark::DoNotOptimize(a);
+        }
+    }
+
+
+    // Pull a Particle towards a point and move it, the way the Reference solver does.
+    void accelerateParticle(benchmark::State& state)
+    {
+        Particle p(2, 100, 150, MotionVector<double>(3, -4));
+        double x = 400;
+        for (auto _ : state)
+        {
+            p.accelerateTowards(x, 20, GRAVITATIONAL_CONSTANT, 5e7);
+            p.move();
+            benchmark::DoNotOptimize(p);
+        }
+    }
+
+
+    // Build the triangles for every particle in a scene, the way Sim draws them.
+    void batchCircles(benchmark::State& state)
+    {
+        unsigned n = state.range(0);
+        Environment env(0);
+        fill(env, Scene::Disk, n);
+        const ParticleStore& particles = env.getParticles();
+
+        CircleBatch batch;
+        for (auto _ : state)
+        {
+            batch.clear();
+            for (unsigned i = 0; i < particles.size(); ++i)
+            {
+                batch.addCircle(particles.x[i], particles.y[i], particles.radius[i], Color{255, 255, 255});
+            }
+            benchmark::DoNotOptimize(batch.vertices().data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["vertices"] = batch.vertices().size();
+    }
+
+
+    // Find the particles in a window a tenth the width of the environment, zoomed in
+    // to ten pixels per meter, and batch them. The work should follow the number in
+    // view rather than the total.
+    void cullView(benchmark::State& state)
+    {
+        unsigned n = state.range(0);
+        Environment env(0);
+        fill(env, Scene::Uniform, n);
+        RenderFrame frame;
+        frame.capture(env, 0);
+
+        const double ZOOM = 10;
+        double left = WIDTH * 0.45;
+        double top = HEIGHT * 0.45;
+
+        std::vector<unsigned> inView;
+        CircleBatch batch;
+        for (auto _ : state)
+        {
+            frame.visible(left, top, left + WIDTH / ZOOM, top + HEIGHT / ZOOM, inView);
+            batch.clear();
+            for (unsigned i : inView)
+            {
+                batch.addCircle((frame.x[i] - left) * ZOOM, (frame.y[i] - top) * ZOOM, frame.radius[i] * ZOOM, frame.color[i]);
+            }
+            benchmark::DoNotOptimize(batch.vertices().data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * n);
+        state.counters["visible"] = inView.size();
+    }
+
+
+    // Lay out the profiler overlay, which is the same text every frame apart from
+    // the numbers.
+    void batchText(benchmark::State& state)
+    {
+        std::vector<TextBatch::Glyph> glyphs(TextBatch::LAST - TextBatch::FIRST + 1, TextBatch::Glyph{0, 0, 10, 20, 11});
+        int height = TextBatch::pack(glyphs, 512);
+
+        TextBatch batch;
+        batch.setGlyphs(glyphs, 512, height);
+        std::vector<std::string> lines;
+        for (unsigned line = 0; line < 8; ++line)
+        {
+            lines.push_back("phase" + std::to_string(line) + "       0.12   0.34   0.56");
+        }
+
+        for (auto _ : state)
+        {
+            batch.clear();
+            for (unsigned line = 0; line < lines.size(); ++line)
+            {
+                batch.addText(lines[line], 10, 10 + 22 * line, Color{255, 255, 255});
+            }
+            benchmark::DoNotOptimize(batch.vertices().data());
+        }
+
+        state.SetItemsProcessed(state.iterations() * lines.size());
+    }
+
+
+    // Blow up a number of large bodies at once and update the environment.
+    void explosionBurst(benchmark::State& state)
+    {
+        unsigned bodies = state.range(0);
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            Environment env(0);
+            env.setSolver(Environment::Solver::BarnesHut);
+            std::mt19937 rng(bodies);
+            std::uniform_real_distribution<double> unit(0, 1);
+            for (unsigned i = 0; i < bodies; ++i)
+            {
+                env.placeParticle(Particle(40, 100 + unit(rng) * (WIDTH - 200), 100 + unit(rng) * (HEIGHT - 200), MotionVector<double>(0, 0)));
+            }
+            // A body with no mass left explodes on the next update.
+            std::fill(env.getParticles().mass.begin(), env.getParticles().mass.end(), 0);
+            state.ResumeTiming();
+
+            env.update();
+        }
+
+        state.SetItemsProcessed(state.iterations() * bodies);
+    }
+
+
+    // Return the largest number of particles a solver is benchmarked with. The
+    // exact solvers take too long on the largest scenes.
+    long maxParticles(Environment::Solver solver)
+    {
+        switch (solver)
+        {
+            case Environment::Solver::Reference:
+                return 4 << 10;
+            case Environment::Solver::Direct:
+                return 64 << 10;
+            default:
+                return 1 << 20;
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    for (Environment::Solver solver : {Environment::Solver::Reference, Environment::Solver::Direct, Environment::Solver::BarnesHut, Environment::Solver::Multipole, Environment::Solver::Mesh})
+    {
+        for (Scene scene : {Scene::Uniform, Scene::Clustered, Scene::Disk})
+        {
+            std::string name = std::string("update/") + SOLVER_NAMES[static_cast<int>(solver)] + "/" + SCENE_NAMES[static_cast<int>(scene)];
+            benchmark::RegisterBenchmark(name.c_str(), updateEnvironment, solver, Environment::Integrator::Leapfrog, scene)
+                ->RangeMultiplier(4)->Range(1 << 10, maxParticles(solver))
+                ->Unit(benchmark::kMillisecond)->UseRealTime();
+        }
+    }
+
+    // Every integrator, on the scene where block time steps matter most.
+    for (Environment::Integrator integrator : {Environment::Integrator::Euler, Environment::Integrator::Leapfrog, Environment::Integrator::Block})
+    {
+        std::string name = std::string("integrator/") + INTEGRATOR_NAMES[static_cast<int>(integrator)] + "/disk";
+        benchmark::RegisterBenchmark(name.c_str(), updateEnvironment, Environment::Solver::BarnesHut, integrator, Scene::Disk)
+            ->RangeMultiplier(4)->Range(1 << 10, 1 << 16)
+            ->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+
+    benchmark::RegisterBenchmark("collisions/grid", findCollisions)->RangeMultiplier(4)->Range(1 << 10, 1 << 20);
+    benchmark::RegisterBenchmark("collisions/coalesceStore", coalesceStore)->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+    benchmark::RegisterBenchmark("particle/coalesce", coalesceParticles);
+    benchmark::RegisterBenchmark("particle/accelerateTowards", accelerateParticle);
+    benchmark::RegisterBenchmark("render/circleBatch", batchCircles)->RangeMultiplier(8)->Range(1 << 10, 1 << 20);
+    benchmark::RegisterBenchmark("render/cullView", cullView)->RangeMultiplier(8)->Range(1 << 10, 1 << 20);
+    benchmark::RegisterBenchmark("render/textBatch", batchText);
+    benchmark::RegisterBenchmark("explosion/burst", explosionBurst)->RangeMultiplier(4)->Range(1, 64)
+        ->Unit(benchmark::kMillisecond);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,43 +1,57 @@
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
-#include <vector>
-#include "MotionVector.hpp"
+#include "Environment.hpp"
+#include "ThreadPool.hpp"
 
 
-
-class A
-{
-public:
-    A()=default;
-
-    virtual ~A()=default;
-
-    virtual void move() {std::cout << "A::move()" << this << std::endl;}
-};
-
-
-
-
-class B : public A
+// Measures how Environment::update scales from 1 thread up to every thread the
+// machine has, for each solver, and how accurate each solver is. Run the float and
+// mixed builds of this too, to compare the speed and accuracy of each precision.
+int main(int argc, char** argv)
 {
-public:
-    B() {};
-    virtual ~B()=default;
-
-    void move() override {std::cout << "B::move()" << std::endl;}
-};
+    unsigned numParticles = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int frames = argc > 2 ? std::atoi(argv[2]) : 10;
 
+    std::cerr << "Precision: " << GRAVSIM_PRECISION_NAME << std::endl;
 
+    const char* names[] = {"Reference ", "Direct    ", "BarnesHut ", "Multipole ", "Mesh      "};
 
-int main()
-{
-    int low = 1;
-    int high = 9;
-
-    for (int i = 0; i < 10; ++i)
+    for (Environment::Solver solver : {Environment::Solver::Direct, Environment::Solver::BarnesHut, Environment::Solver::Multipole, Environment::Solver::Mesh})
     {
-        std::cout << std::rand() % high + low << std::endl;
+        const char* name = names[static_cast<int>(solver)];
+        double baseline = 0;
+
+        for (unsigned threads = 1; threads <= ThreadPool::hardwareThreads(); threads *= 2)
+        {
+            std::srand(1);
+            Environment env(numParticles);
+            env.setSolver(solver);
+            env.setThreads(threads);
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < frames; ++i)
+            {
+                env.update();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            double stepsPerSecond = frames / elapsed.count();
+            if (threads == 1)
+            {
+                baseline = stepsPerSecond;
+            }
+
+            std::cerr << name
+                << threads << " threads: " << stepsPerSecond << " steps/s, "
+                << stepsPerSecond / baseline << "x" << std::endl;
+        }
+
+        std::srand(1);
+        Environment env(numParticles);
+        env.setSolver(solver);
+        std::cerr << name << "relative error: " << env.measureSolverError() << std::endl;
     }
 
-
-    
+    return 0;
 }
@@ -1,6 +1,41 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <type_traits>
+#include <string>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 #include "MotionVector.hpp"
+#include "Vec2.hpp"
 #include "Particle.hpp"
+#include "ParticleStore.hpp"
+#include "QuadTree.hpp"
+#include "GravityKernel.hpp"
+#include "ThreadPool.hpp"
+#include "AllocationCounter.hpp"
+#include "Log.hpp"
+#include "Profiler.hpp"
+#include "SpatialGrid.hpp"
+#include "FastMultipole.hpp"
+#include "ParticleMesh.hpp"
+#include "Environment.hpp"
+#include "Snapshot.hpp"
+#include "InputLog.hpp"
+#include "CircleBatch.hpp"
+#include "TextBatch.hpp"
+#include "Camera.hpp"
+#include "DensityMap.hpp"
+#include "RenderFrame.hpp"
+#include "TripleBuffer.hpp"
+#include "TrajectoryWriter.hpp"
+#include "TrajectoryReader.hpp"
+
+
+// The tolerances below are for the double build. Floats only keep about 7
+// significant digits instead of 16, so they're loosened when particles are stored
+// as floats.
+const double LOOSEN = std::is_same<Real, double>::value ? 1 : 1e6;
 
 
 TEST(VectorCreationTests, vectorCanBeCreatedWithIntegerCompType)
@@ -222,6 +257,40 @@ TEST(VectorUnitMagnitudeTests, largeDecimalUnitVector)
     EXPECT_NEAR(unitV1.y() ,expectedY, 0.0000001);
 }
 
+TEST(Vec2Tests, arithmeticWorksInConstantExpressions)
+{
+    constexpr Vec2<double> a(3, 4);
+    constexpr Vec2<double> b(1, -2);
+
+    static_assert(a.squaredNorm() == 25, "squaredNorm should be usable at compile time");
+    static_assert(a + b == Vec2<double>(4, 2), "addition should be usable at compile time");
+    static_assert(fma(a, 2.0, b) == Vec2<double>(7, 6), "fma should be usable at compile time");
+
+    Vec2<double> c = a;
+    c -= b;
+    c *= 2.0;
+    EXPECT_EQ(c, Vec2<double>(4, 12));
+    EXPECT_DOUBLE_EQ(a.dot(b), -5);
+    EXPECT_DOUBLE_EQ(a.norm(), 5);
+    EXPECT_DOUBLE_EQ(a.normalized().x, 0.6);
+    EXPECT_DOUBLE_EQ(a.normalized().y, 0.8);
+    EXPECT_EQ(Vec2<double>().normalized(), Vec2<double>());
+}
+
+TEST(Vec2Tests, addScaledSkipsFlaggedEntries)
+{
+    std::vector<double> x{1, 2, 3, 4};
+    std::vector<double> y{0, 0, 0, 0};
+    std::vector<double> dx{1, 1, 1, 1};
+    std::vector<double> dy{2, 2, 2, 2};
+    std::vector<std::uint8_t> flags{0, ParticleStore::FROZEN, 0, ParticleStore::ATTACKER};
+
+    addScaled(x.data(), y.data(), dx.data(), dy.data(), 0.5, flags.data(), ParticleStore::FROZEN, 0, 4);
+
+    EXPECT_EQ(x, (std::vector<double>{1.5, 2, 3.5, 4.5}));
+    EXPECT_EQ(y, (std::vector<double>{1, 0, 1, 1}));
+}
+
 TEST(ParticleCoordinateTests, canReadParticleCoordinates)
 {
     // Define basic particle attributes.
@@ -342,3 +411,1340 @@ TEST(ParticleCollisionTests, particlesJustTouchingAreNotColliding)
 
     ASSERT_FALSE(p1.isCollidingWith(p2));
 }
+
+TEST(QuadTreeTests, zeroOpeningAngleMatchesDirectSummation)
+{
+    std::vector<Real> xs = {10, 200, 640, 900, 1250, 13, 480};
+    std::vector<Real> ys = {15, 1100, 600, 30, 700, 22, 480};
+    std::vector<Real> masses = {5e6, 2e7, 1e6, 8e6, 3e5, 4e6, 9e6};
+
+    QuadTree tree(0);
+    tree.build(xs, ys, masses, 1300, 1200);
+
+    std::vector<Accum> ax;
+    std::vector<Accum> ay;
+    tree.computeAccelerations(GRAVITATIONAL_CONSTANT, ax, ay);
+
+    for (unsigned i = 0; i < xs.size(); ++i)
+    {
+        double expectedX = 0;
+        double expectedY = 0;
+        for (unsigned j = 0; j < xs.size(); ++j)
+        {
+            if (i != j)
+            {
+                double dx = xs[j] - xs[i];
+                double dy = ys[j] - ys[i];
+                double dist = std::hypot(dx, dy);
+                expectedX += GRAVITATIONAL_CONSTANT * masses[j] * dx / (dist * dist * dist);
+                expectedY += GRAVITATIONAL_CONSTANT * masses[j] * dy / (dist * dist * dist);
+            }
+        }
+
+        EXPECT_NEAR(ax[i], expectedX, std::abs(expectedX) * 1e-12 * LOOSEN);
+        EXPECT_NEAR(ay[i], expectedY, std::abs(expectedY) * 1e-12 * LOOSEN);
+    }
+}
+
+TEST(QuadTreeTests, distantClusterIsApproximatedByItsCenterOfMass)
+{
+    // A tight cluster of bodies, and one body far away from it.
+    std::vector<Real> xs = {1000, 1001, 1000, 1001, 10};
+    std::vector<Real> ys = {1000, 1000, 1001, 1001, 10};
+    std::vector<Real> masses = {1e6, 1e6, 1e6, 1e6, 1};
+
+    QuadTree tree(0.5);
+    tree.build(xs, ys, masses, 1300, 1200);
+
+    Accum ax;
+    Accum ay;
+    tree.accelerationAt(10, 10, GRAVITATIONAL_CONSTANT, ax, ay);
+
+    // The cluster should pull roughly like a single body of 4e6 kg at its center.
+    double dx = 1000.5 - 10;
+    double dy = 1000.5 - 10;
+    double dist = std::hypot(dx, dy);
+    double expected = GRAVITATIONAL_CONSTANT * 4e6 / (dist * dist);
+
+    EXPECT_NEAR(std::hypot(ax, ay), expected, expected * 1e-3);
+    EXPECT_NEAR(std::atan2(ay, ax), std::atan2(dy, dx), 1e-6);
+}
+
+TEST(QuadTreeTests, overlappingBodiesDoNotAttractEachOther)
+{
+    std::vector<Real> xs = {50, 50, 50};
+    std::vector<Real> ys = {70, 70, 70};
+    std::vector<Real> masses = {1e6, 2e6, 3e6};
+
+    QuadTree tree;
+    tree.build(xs, ys, masses, 1300, 1200);
+
+    std::vector<Accum> ax;
+    std::vector<Accum> ay;
+    tree.computeAccelerations(GRAVITATIONAL_CONSTANT, ax, ay);
+
+    for (unsigned i = 0; i < xs.size(); ++i)
+    {
+        EXPECT_EQ(ax[i], 0);
+        EXPECT_EQ(ay[i], 0);
+    }
+}
+
+TEST(ParticleStoreTests, idsStayValidWhenOtherParticlesAreRemoved)
+{
+    ParticleStore store;
+    ParticleStore::Id a = store.add(1, 10, 10, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    ParticleStore::Id b = store.add(2, 20, 20, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    ParticleStore::Id c = store.add(3, 30, 30, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+    store.setFlag(store.indexOf(a), ParticleStore::DEAD);
+    store.removeDead();
+
+    ASSERT_EQ(store.size(), 2u);
+    EXPECT_EQ(store.indexOf(a), ParticleStore::NONE);
+    EXPECT_EQ(store.x[store.indexOf(b)], 20);
+    EXPECT_EQ(store.x[store.indexOf(c)], 30);
+
+    // The last particle is moved into the removed one's place.
+    EXPECT_EQ(store.indexOf(c), 0u);
+    EXPECT_EQ(store.indexOf(b), 1u);
+}
+
+TEST(ParticleStoreTests, oldIdsStayInvalidWhenSlotsAreReused)
+{
+    ParticleStore store;
+    ParticleStore::Id a = store.add(1, 10, 10, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    store.add(2, 20, 20, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+    std::vector<ParticleStore::Id> seen{a};
+    for (int i = 0; i < 100; ++i)
+    {
+        store.remove(store.indexOf(seen.back()));
+        ParticleStore::Id d = store.add(3, 30, 30, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+        // Every particle gets a new ID, even though the same slot is reused.
+        EXPECT_EQ(std::count(seen.begin(), seen.end(), d), 0);
+        for (ParticleStore::Id old : seen)
+        {
+            EXPECT_EQ(store.indexOf(old), ParticleStore::NONE);
+        }
+        ASSERT_NE(store.indexOf(d), ParticleStore::NONE);
+        EXPECT_EQ(store.x[store.indexOf(d)], 30);
+        seen.push_back(d);
+    }
+
+    // The slot was reused 100 times, and its generation is kept above the slot.
+    EXPECT_EQ(seen.back() >> ParticleStore::SLOT_BITS, 100u);
+    EXPECT_EQ(seen.back() & ((ParticleStore::Id(1) << ParticleStore::SLOT_BITS) - 1), a);
+
+    EXPECT_EQ(store.size(), 2u);
+    EXPECT_EQ(store.indexOf(ParticleStore::NO_ID), ParticleStore::NONE);
+}
+
+TEST(ParticleStoreTests, accelerateTowardsMatchesParticle)
+{
+    Particle p(2, 100, 150, MotionVector<double>(3, -4));
+    ParticleStore store;
+    store.add(2, 100, 150, 3, -4, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+    p.accelerateTowards(400, 20, GRAVITATIONAL_CONSTANT, 5e7);
+    store.accelerateTowards(0, 400, 20, GRAVITATIONAL_CONSTANT, 5e7);
+
+    EXPECT_DOUBLE_EQ(store.vx[0], Real(p.getVelocity().x()));
+    EXPECT_DOUBLE_EQ(store.vy[0], Real(p.getVelocity().y()));
+}
+
+TEST(ParticleStoreTests, heavierParticleAbsorbsLighterOne)
+{
+    ParticleStore store;
+    ParticleStore::Id small = store.add(2, 100, 100, 10, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    ParticleStore::Id big = store.add(5, 104, 100, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+    double totalMass = store.mass[0] + store.mass[1];
+
+    ASSERT_TRUE(store.coalesce(0, 1, 1));
+
+    EXPECT_TRUE(store.hasFlag(store.indexOf(small), ParticleStore::DEAD));
+    EXPECT_FALSE(store.hasFlag(store.indexOf(big), ParticleStore::DEAD));
+    EXPECT_DOUBLE_EQ(store.mass[store.indexOf(big)], totalMass);
+    EXPECT_DOUBLE_EQ(store.radius[store.indexOf(big)], Real(Particle::calcRad(totalMass, PARTICLE_DENSITY)));
+}
+
+TEST(ParticleStoreTests, mergedParticleMovesToTheCenterOfMass)
+{
+    ParticleStore store;
+    store.add(2, 100, 100, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    store.add(3, 103, 102, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+
+    double centerX = (store.x[0] * store.mass[0] + store.x[1] * store.mass[1]) / (store.mass[0] + store.mass[1]);
+    double centerY = (store.y[0] * store.mass[0] + store.y[1] * store.mass[1]) / (store.mass[0] + store.mass[1]);
+
+    ASSERT_TRUE(store.coalesce(0, 1, 1));
+
+    EXPECT_DOUBLE_EQ(store.x[1], centerX);
+    EXPECT_DOUBLE_EQ(store.y[1], centerY);
+}
+
+TEST(GravityKernelTests, everyVariantMatchesAccelerateTowards)
+{
+    // Enough bodies to span several tiles and leave a partial vector at the end.
+    unsigned n = 2 * GravityKernel::TILE + 13;
+    std::srand(7);
+
+    ParticleStore store;
+    std::vector<Real> masses;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        store.add(1 + std::rand() % 5, std::rand() % 1300, std::rand() % 1200, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+        masses.push_back(store.mass[i]);
+    }
+
+    // Sum up the change in velocity the old way, one pair at a time.
+    ParticleStore reference = store;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        for (unsigned j = 0; j < n; ++j)
+        {
+            if (i != j)
+            {
+                reference.accelerateTowards(i, store.x[j], store.y[j], GRAVITATIONAL_CONSTANT, store.mass[j]);
+            }
+        }
+    }
+
+    for (GravityKernel::Variant v : {GravityKernel::Variant::Scalar, GravityKernel::Variant::Avx2, GravityKernel::Variant::Avx512})
+    {
+        GravityKernel kernel;
+        if (!kernel.setVariant(v))
+        {
+            continue;
+        }
+
+        std::vector<Accum> ax;
+        std::vector<Accum> ay;
+        kernel.computeAccelerations(store.x, store.y, masses, GRAVITATIONAL_CONSTANT, ax, ay);
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double expectedX = reference.vx[i] * 60;
+            double expectedY = reference.vy[i] * 60;
+            double tolerance = 1e-9 * LOOSEN * std::hypot(expectedX, expectedY);
+
+            EXPECT_NEAR(ax[i], expectedX, tolerance);
+            EXPECT_NEAR(ay[i], expectedY, tolerance);
+        }
+    }
+}
+
+TEST(GravityKernelTests, overlappingBodiesDoNotAttractEachOther)
+{
+    std::vector<Real> xs(20, 50);
+    std::vector<Real> ys(20, 70);
+    std::vector<Real> masses(20, 1e6);
+
+    GravityKernel kernel;
+    std::vector<Accum> ax;
+    std::vector<Accum> ay;
+    kernel.computeAccelerations(xs, ys, masses, GRAVITATIONAL_CONSTANT, ax, ay);
+
+    for (unsigned i = 0; i < xs.size(); ++i)
+    {
+        EXPECT_EQ(ax[i], 0);
+        EXPECT_EQ(ay[i], 0);
+    }
+}
+
+TEST(ThreadPoolTests, parallelForVisitsEveryIndexOnce)
+{
+    ThreadPool pool(4);
+    std::vector<int> visits(10007, 0);
+
+    pool.parallelFor(0, visits.size(), 100, [&](unsigned begin, unsigned end, unsigned worker) {
+        EXPECT_LT(worker, pool.size());
+        for (unsigned i = begin; i < end; ++i)
+        {
+            ++visits[i];
+        }
+    });
+
+    for (int v : visits)
+    {
+        EXPECT_EQ(v, 1);
+    }
+}
+
+TEST(GravityKernelTests, threadedKernelMatchesSingleThreadedKernel)
+{
+    unsigned n = 3 * GravityKernel::TILE + 5;
+    std::srand(11);
+
+    std::vector<Real> xs;
+    std::vector<Real> ys;
+    std::vector<Real> masses;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        xs.push_back(std::rand() % 1300);
+        ys.push_back(std::rand() % 1200);
+        masses.push_back(1e6 + std::rand() % 1000000);
+    }
+
+    GravityKernel kernel;
+    ThreadPool pool(3);
+    std::vector<Accum> ax;
+    std::vector<Accum> ay;
+    std::vector<Accum> threadedAx;
+    std::vector<Accum> threadedAy;
+    kernel.computeAccelerations(xs, ys, masses, GRAVITATIONAL_CONSTANT, ax, ay);
+    kernel.computeAccelerations(xs, ys, masses, GRAVITATIONAL_CONSTANT, threadedAx, threadedAy, &pool);
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double tolerance = 1e-9 * LOOSEN * std::hypot(ax[i], ay[i]);
+        EXPECT_NEAR(threadedAx[i], ax[i], tolerance);
+        EXPECT_NEAR(threadedAy[i], ay[i], tolerance);
+    }
+}
+
+TEST(EnvironmentTests, threadCountDoesNotChangeTheResult)
+{
+    std::srand(3);
+    Environment single(400);
+    Environment threaded = single;
+    single.setThreads(1);
+    threaded.setThreads(4);
+
+    for (int frame = 0; frame < 20; ++frame)
+    {
+        single.update();
+        threaded.update();
+    }
+
+    ParticleStore& a = single.getParticles();
+    ParticleStore& b = threaded.getParticles();
+    ASSERT_EQ(a.size(), b.size());
+    for (unsigned i = 0; i < a.size(); ++i)
+    {
+        EXPECT_EQ(a.idAt(i), b.idAt(i));
+        EXPECT_EQ(a.x[i], b.x[i]);
+        EXPECT_EQ(a.y[i], b.y[i]);
+        EXPECT_EQ(a.mass[i], b.mass[i]);
+    }
+}
+
+TEST(EnvironmentTests, deterministicModeDoesNotDependOnThreadCount)
+{
+    for (Environment::Solver solver : {Environment::Solver::Reference, Environment::Solver::Direct})
+    {
+        std::srand(4);
+        Environment single(600);
+        single.setSolver(solver);
+        single.setDeterministic(true);
+        Environment threaded = single;
+        single.setThreads(1);
+        threaded.setThreads(3);
+
+        for (int frame = 0; frame < 10; ++frame)
+        {
+            single.update();
+            threaded.update();
+        }
+
+        ParticleStore& a = single.getParticles();
+        ParticleStore& b = threaded.getParticles();
+        ASSERT_EQ(a.size(), b.size());
+        for (unsigned i = 0; i < a.size(); ++i)
+        {
+            EXPECT_EQ(a.idAt(i), b.idAt(i));
+            EXPECT_EQ(a.x[i], b.x[i]);
+            EXPECT_EQ(a.y[i], b.y[i]);
+            EXPECT_EQ(a.vx[i], b.vx[i]);
+            EXPECT_EQ(a.vy[i], b.vy[i]);
+            EXPECT_EQ(a.mass[i], b.mass[i]);
+        }
+    }
+}
+
+TEST(EnvironmentTests, leapfrogKeepsTheEnergyOfAnOrbit)
+{
+    double energyError[2];
+
+    for (Environment::Integrator integrator : {Environment::Integrator::Euler, Environment::Integrator::Leapfrog})
+    {
+        Environment env(0);
+        env.setSolver(Environment::Solver::Direct);
+        env.setIntegrator(integrator);
+        env.setTimeStep(0.1);
+
+        // A small particle on an eccentric orbit around a large frozen one.
+        ParticleStore::Id sun = env.placeParticle(Particle(30, 650, 600, MotionVector<double>(0, 0)));
+        ParticleStore::Id planet = env.placeParticle(Particle(1, 850, 600, MotionVector<double>(0, 0)));
+
+        ParticleStore& particles = env.getParticles();
+        particles.freeze(particles.indexOf(sun));
+        double gm = GRAVITATIONAL_CONSTANT * particles.mass[particles.indexOf(sun)];
+        particles.vy[particles.indexOf(planet)] = 0.8 * std::sqrt(gm / 200);
+
+        auto energy = [&]() {
+            unsigned p = particles.indexOf(planet);
+            double speedSq = particles.vx[p] * particles.vx[p] + particles.vy[p] * particles.vy[p];
+            return speedSq / 2 - gm / std::hypot(particles.x[p] - 650, particles.y[p] - 600);
+        };
+
+        double start = energy();
+        for (int i = 0; i < 2000; ++i)
+        {
+            env.update();
+        }
+        ASSERT_NE(particles.indexOf(planet), ParticleStore::NONE);
+
+        energyError[integrator == Environment::Integrator::Leapfrog] = std::abs(energy() / start - 1);
+    }
+
+    EXPECT_LT(energyError[1], energyError[0] / 10);
+    EXPECT_LT(energyError[1], 1e-3);
+}
+
+TEST(EnvironmentTests, blockTimeStepsOnlyShrinkTheStepsOfFastParticles)
+{
+    // A small particle in a tight orbit around a frozen one, and a field of
+    // particles far away from both that barely move.
+    auto makeScene = [](Environment::Integrator integrator, double dt) {
+        Environment env(0);
+        env.setSolver(Environment::Solver::Direct);
+        env.setIntegrator(integrator);
+        env.setTimeStep(dt);
+
+        ParticleStore::Id sun = env.placeParticle(Particle(10, 200, 200, MotionVector<double>(0, 0)));
+        env.placeParticle(Particle(1, 230, 200, MotionVector<double>(0, 0)));
+        for (int x = 500; x < 1250; x += 50)
+        {
+            for (int y = 100; y < 1100; y += 50)
+            {
+                env.placeParticle(Particle(1, x, y, MotionVector<double>(0, 0)));
+            }
+        }
+
+        ParticleStore& particles = env.getParticles();
+        particles.freeze(particles.indexOf(sun));
+        double gm = GRAVITATIONAL_CONSTANT * particles.mass[particles.indexOf(sun)];
+        particles.vy[1] = 0.8 * std::sqrt(gm / 30);
+        return env;
+    };
+
+    Environment fine = makeScene(Environment::Integrator::Leapfrog, 0.5 / 16);
+    Environment coarse = makeScene(Environment::Integrator::Leapfrog, 0.5);
+    Environment block = makeScene(Environment::Integrator::Block, 0.5);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        for (int j = 0; j < 16; ++j)
+        {
+            fine.update();
+        }
+        coarse.update();
+        block.update();
+    }
+
+    auto distance = [](Environment& a, Environment& b) {
+        ParticleStore& pa = a.getParticles();
+        ParticleStore& pb = b.getParticles();
+        return std::hypot(pa.x[1] - pb.x[1], pa.y[1] - pb.y[1]);
+    };
+
+    ASSERT_EQ(block.getParticles().size(), fine.getParticles().size());
+    EXPECT_LT(distance(block, fine), distance(coarse, fine) / 10);
+    EXPECT_LT(block.getForceEvaluations(), fine.getForceEvaluations() / 10);
+}
+
+TEST(EnvironmentTests, blockStepsRecomputeMergedParticles)
+{
+    Environment env(0);
+    env.setSolver(Environment::Solver::Direct);
+    env.setIntegrator(Environment::Integrator::Block);
+    ParticleStore::Id survivor = env.placeParticle(Particle(8, 400, 400, MotionVector<double>(0, 0)));
+    env.placeParticle(Particle(8, 402, 401, MotionVector<double>(0, 0)));
+    // A frozen body to pull on the survivor, whose own stale acceleration can't
+    // change how anything steps.
+    ParticleStore::Id anchor = env.placeParticle(Particle(40, 700, 500, MotionVector<double>(0, 0)));
+    env.getParticles().freeze(env.getParticles().indexOf(anchor));
+
+    // The first update merges the two close particles, which moves the survivor.
+    env.update();
+    ASSERT_EQ(env.getParticles().size(), 2u);
+    ASSERT_NE(env.getParticles().indexOf(survivor), ParticleStore::NONE);
+
+    // Loading a snapshot forgets every acceleration, so the copy computes the
+    // survivor's from scratch.
+    std::string path = testing::TempDir() + "snapshot_merged";
+    ASSERT_TRUE(Snapshot::save(env, path.c_str()));
+    Environment fresh(0);
+    fresh.setSolver(Environment::Solver::Direct);
+    fresh.setIntegrator(Environment::Integrator::Block);
+    ASSERT_TRUE(Snapshot::load(fresh, path.c_str()));
+    std::remove(path.c_str());
+
+    env.update();
+    fresh.update();
+    unsigned a = env.getParticles().indexOf(survivor);
+    unsigned b = fresh.getParticles().indexOf(survivor);
+    EXPECT_EQ(env.getParticles().vx[a], fresh.getParticles().vx[b]);
+    EXPECT_EQ(env.getParticles().vy[a], fresh.getParticles().vy[b]);
+}
+
+TEST(EnvironmentTests, updatesStopAllocatingOnceWarmedUp)
+{
+    // The tests link the allocation hooks, so allocations are always counted.
+    ASSERT_TRUE(AllocationCounter::available());
+
+    // Particles far enough apart that none of them collide, since more collisions
+    // than ever before need more room to be stored. The first is a body too big for
+    // the grid's cells, in a gap in the middle, so it has more candidates than a
+    // cell holds. It's light enough not to pull anything into it.
+    Environment env(0);
+    env.setThreads(3);
+    ParticleStore::Id big = env.placeParticle(Particle(450, 665, 605, MotionVector<double>(0, 0), Color{255, 255, 255}, true, 0.001));
+    env.getParticles().freeze(env.getParticles().indexOf(big));
+    for (int x = 20; x < 1300; x += 30)
+    {
+        for (int y = 20; y < 1200; y += 30)
+        {
+            if (std::hypot(x - 665, y - 605) > 470)
+            {
+                env.placeParticle(Particle(1 + (x + y) % 3, x, y, MotionVector<double>(0, 0)));
+            }
+        }
+    }
+
+    for (Environment::Solver solver : {Environment::Solver::Direct, Environment::Solver::BarnesHut, Environment::Solver::Multipole, Environment::Solver::Mesh})
+    {
+        env.setSolver(solver);
+        for (int i = 0; i < 3; ++i)
+        {
+            env.update();
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            env.update();
+            EXPECT_EQ(env.getUpdateAllocations(), 0u);
+        }
+    }
+
+    // Block time steps keep their own scratch arrays.
+    env.setIntegrator(Environment::Integrator::Block);
+    env.update();
+    env.update();
+    env.update();
+    EXPECT_EQ(env.getUpdateAllocations(), 0u);
+    EXPECT_EQ(env.getGrid().bigCount(), 1u);
+    EXPECT_NE(env.getParticles().indexOf(big), ParticleStore::NONE);
+}
+
+TEST(ThreadPoolTests, makingTasksDoesNotAllocate)
+{
+    ThreadPool pool(3);
+    std::vector<double> a(1000, 1);
+    std::vector<double> b(1000, 2);
+    std::vector<double> sums(3, 0);
+
+    // Enough captures that std::function would have had to allocate.
+    auto task = [&, a, b](unsigned begin, unsigned end, unsigned worker) {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            sums[worker] += a[i] + b[i];
+        }
+    };
+
+    pool.parallelFor(0, 1000, 10, task);
+    unsigned long long before = AllocationCounter::allocations();
+    pool.parallelFor(0, 1000, 10, task);
+    EXPECT_EQ(AllocationCounter::allocations(), before);
+    EXPECT_EQ(sums[0] + sums[1] + sums[2], 6000);
+}
+
+TEST(SpatialGridTests, candidatesIncludeEveryCollidingPairOnce)
+{
+    std::srand(5);
+    ParticleStore store;
+    for (int i = 0; i < 2000; ++i)
+    {
+        store.add(1 + std::rand() % 8, std::rand() % 1300, std::rand() % 1200, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    }
+
+    SpatialGrid grid;
+    grid.build(store.x, store.y, store.radius);
+
+    for (unsigned i = 0; i < store.size(); ++i)
+    {
+        std::vector<unsigned> candidates;
+        grid.candidatesFor(i, candidates);
+
+        std::vector<unsigned> sorted = candidates;
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_TRUE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+        for (unsigned j = i + 1; j < store.size(); ++j)
+        {
+            if (store.isColliding(i, j))
+            {
+                EXPECT_TRUE(std::binary_search(sorted.begin(), sorted.end(), j));
+            }
+        }
+
+        for (unsigned j : candidates)
+        {
+            EXPECT_GT(j, i);
+        }
+    }
+}
+
+TEST(SpatialGridTests, queryFindsEveryCircleOverlappingARectangle)
+{
+    std::srand(6);
+    ParticleStore store;
+    for (int i = 0; i < 3000; ++i)
+    {
+        store.add(1 + std::rand() % 8, std::rand() % 1300, std::rand() % 1200, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    }
+
+    SpatialGrid grid;
+    grid.build(store.x, store.y, store.radius);
+
+    // A small rectangle walks the cells, and one over everything checks every circle.
+    const double RECTS[2][4] = {{300, 200, 420, 260}, {-1e6, -1e6, 1e6, 1e6}};
+    for (const double* r : RECTS)
+    {
+        std::vector<unsigned> found;
+        grid.query(r[0], r[1], r[2], r[3], found);
+
+        std::vector<unsigned> sorted = found;
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_TRUE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+        for (unsigned i = 0; i < store.size(); ++i)
+        {
+            if (store.x[i] + store.radius[i] >= r[0] && store.x[i] - store.radius[i] <= r[2]
+                && store.y[i] + store.radius[i] >= r[1] && store.y[i] - store.radius[i] <= r[3])
+            {
+                EXPECT_TRUE(std::binary_search(sorted.begin(), sorted.end(), i));
+            }
+        }
+    }
+
+    std::vector<unsigned> small;
+    grid.query(300, 200, 420, 260, small);
+    EXPECT_LT(small.size(), store.size() / 10);
+}
+
+TEST(SpatialGridTests, bigCirclesDontWidenTheCells)
+{
+    std::srand(7);
+    ParticleStore store;
+    for (int i = 0; i < 2000; ++i)
+    {
+        store.add(1 + std::rand() % 8, std::rand() % 1300, std::rand() % 1200, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    }
+
+    SpatialGrid grid;
+    grid.build(store.x, store.y, store.radius);
+    double cellSize = grid.getCellSize();
+
+    // Two huge bodies in the middle of the others, one of them partway through the
+    // indices.
+    store.add(1e7, 700, 600, 0, 0, PARTICLE_DENSITY, ParticleStore::GRAVITY);
+    store.x[1000] = 650;
+    store.y[1000] = 600;
+    store.radius[1000] = store.radius[store.size() - 1];
+    grid.build(store.x, store.y, store.radius);
+    EXPECT_EQ(grid.getCellSize(), cellSize);
+    EXPECT_EQ(grid.bigCount(), 2u);
+
+    for (unsigned i = 0; i < store.size(); ++i)
+    {
+        std::vector<unsigned> candidates;
+        grid.candidatesFor(i, candidates);
+        EXPECT_LE(candidates.size(), grid.maxCandidates());
+        std::sort(candidates.begin(), candidates.end());
+        EXPECT_TRUE(std::adjacent_find(candidates.begin(), candidates.end()) == candidates.end());
+
+        for (unsigned j = i + 1; j < store.size(); ++j)
+        {
+            if (store.isColliding(i, j))
+            {
+                EXPECT_TRUE(std::binary_search(candidates.begin(), candidates.end(), j));
+            }
+        }
+    }
+
+    std::vector<unsigned> found;
+    grid.query(640, 590, 660, 610, found);
+    EXPECT_TRUE(std::find(found.begin(), found.end(), 1000u) != found.end());
+    EXPECT_TRUE(std::find(found.begin(), found.end(), store.size() - 1) != found.end());
+}
+
+TEST(FastMultipoleTests, errorShrinksAsTheOrderGrows)
+{
+    std::srand(3);
+    std::vector<Real> xs;
+    std::vector<Real> ys;
+    std::vector<Real> masses;
+    for (int i = 0; i < 4000; ++i)
+    {
+        xs.push_back(std::rand() % 130000 / 100.0);
+        ys.push_back(std::rand() % 120000 / 100.0);
+        masses.push_back(1e5 + std::rand() % 1000000);
+    }
+
+    std::vector<Accum> ax;
+    std::vector<Accum> ay;
+    double lastError = 1;
+    for (unsigned order : {2, 6, 12})
+    {
+        FastMultipole fmm(order);
+        fmm.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax, ay, nullptr);
+        ASSERT_GT(fmm.getLevels(), 2u);
+
+        double error = GravitySolver::sampleError(xs, ys, masses, GRAVITATIONAL_CONSTANT, ax, ay, 200);
+        EXPECT_LT(error, lastError / 4);
+        lastError = error;
+    }
+
+    EXPECT_LT(lastError, 1e-3);
+}
+
+TEST(FastMultipoleTests, threadedSolverMatchesSingleThreadedSolver)
+{
+    std::srand(4);
+    std::vector<Real> xs;
+    std::vector<Real> ys;
+    std::vector<Real> masses;
+    for (int i = 0; i < 3000; ++i)
+    {
+        xs.push_back(std::rand() % 1300);
+        ys.push_back(std::rand() % 1200);
+        masses.push_back(1e6);
+    }
+    // A body far outside the domain, and one with no mass.
+    xs.push_back(-5000);
+    ys.push_back(9000);
+    masses.push_back(1e6);
+    masses[0] = 0;
+
+    FastMultipole fmm;
+    std::vector<Accum> ax1, ay1, ax4, ay4;
+    fmm.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax1, ay1, nullptr);
+
+    ThreadPool pool(4);
+    fmm.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax4, ay4, &pool);
+
+    EXPECT_EQ(ax1, ax4);
+    EXPECT_EQ(ay1, ay4);
+    EXPECT_LT(GravitySolver::sampleError(xs, ys, masses, GRAVITATIONAL_CONSTANT, ax1, ay1, 100), 1e-2);
+}
+
+TEST(ParticleMeshTests, distantBodiesPullLikePointMasses)
+{
+    std::vector<Real> xs{100, 1100};
+    std::vector<Real> ys{300, 800};
+    std::vector<Real> masses{1e6, 3e6};
+
+    ParticleMesh mesh(128, false);
+    std::vector<Accum> ax, ay;
+    mesh.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax, ay, nullptr);
+
+    double dx = xs[1] - xs[0];
+    double dy = ys[1] - ys[0];
+    double dist = std::sqrt(dx * dx + dy * dy);
+    double pull = GRAVITATIONAL_CONSTANT * masses[1] / (dist * dist);
+    EXPECT_NEAR(ax[0], pull * dx / dist, pull * 1e-2);
+    EXPECT_NEAR(ay[0], pull * dy / dist, pull * 1e-2);
+    EXPECT_NEAR(ax[0] * masses[0], -ax[1] * masses[1], pull * masses[0] * 1e-2);
+}
+
+TEST(ParticleMeshTests, threadedSolverMatchesSingleThreadedSolver)
+{
+    std::srand(6);
+    std::vector<Real> xs;
+    std::vector<Real> ys;
+    std::vector<Real> masses;
+    for (int i = 0; i < 3000; ++i)
+    {
+        xs.push_back(std::rand() % 130000 / 100.0);
+        ys.push_back(std::rand() % 120000 / 100.0);
+        masses.push_back(1e5 + std::rand() % 1000000);
+    }
+
+    ParticleMesh mesh(128);
+    std::vector<Accum> ax1, ay1, ax4, ay4;
+    mesh.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax1, ay1, nullptr);
+
+    ThreadPool pool(4);
+    mesh.solve(xs, ys, masses, 1300, 1200, GRAVITATIONAL_CONSTANT, ax4, ay4, &pool);
+
+    EXPECT_EQ(ax1, ax4);
+    EXPECT_EQ(ay1, ay4);
+    EXPECT_LT(GravitySolver::sampleError(xs, ys, masses, GRAVITATIONAL_CONSTANT, ax1, ay1, 200), 2e-2);
+}
+
+TEST(EnvironmentTests, everySolverIsCloseToDirectSummation)
+{
+    std::srand(5);
+    Environment env(2000);
+
+    env.setSolver(Environment::Solver::Direct);
+    EXPECT_LT(env.measureSolverError(), 1e-12 * LOOSEN);
+
+    env.setSolver(Environment::Solver::BarnesHut);
+    EXPECT_LT(env.measureSolverError(), 1e-1);
+
+    env.setSolver(Environment::Solver::Multipole);
+    env.setMultipoleOrder(10);
+    EXPECT_LT(env.measureSolverError(), 1e-2);
+
+    env.setSolver(Environment::Solver::Mesh);
+    EXPECT_LT(env.measureSolverError(), 1e-1);
+}
+
+TEST(LogTests, messagesAreWrittenInOrder)
+{
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    Log::setOutput(file);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        Log::write(LogLevel::Warn, "message %d", i);
+    }
+    Log::setOutput(stderr);
+
+    char line[Log::MESSAGE_SIZE + 16];
+    std::rewind(file);
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_NE(std::fgets(line, sizeof(line), file), nullptr);
+        EXPECT_EQ(std::string(line), "[warn] message " + std::to_string(i) + "\n");
+    }
+    EXPECT_EQ(std::fgets(line, sizeof(line), file), nullptr);
+    std::fclose(file);
+}
+
+TEST(LogTests, loggingDoesNotAllocateOrEvaluateFilteredMessages)
+{
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    Log::setOutput(file);
+
+    int evaluated = 0;
+    unsigned long long before = AllocationCounter::allocations();
+    for (int i = 0; i < 100; ++i)
+    {
+        Log::write(LogLevel::Info, "mass %g at (%d, %d)", 1.5e6, i, -i);
+    }
+    LOG_TRACE("only formatted in trace builds %d", ++evaluated);
+    EXPECT_EQ(AllocationCounter::allocations() - before, 0u);
+    EXPECT_EQ(evaluated, GRAVSIM_LOG_LEVEL > 0 ? 0 : 1);
+
+    Log::setOutput(stderr);
+    std::fclose(file);
+}
+
+TEST(SnapshotTests, loadedEnvironmentCarriesOnExactlyLikeTheSavedOne)
+{
+    Environment saved(300);
+    saved.setSolver(Environment::Solver::Direct);
+    saved.getParticles().remove(7);
+    ParticleStore::Id attacker = saved.placeAttacker(600, 500);
+    for (int i = 0; i < 3; ++i)
+    {
+        saved.update();
+    }
+
+    std::string path = testing::TempDir() + "snapshot_round_trip";
+    ASSERT_TRUE(Snapshot::save(saved, path.c_str()));
+
+    Environment loaded(5);
+    loaded.setSolver(Environment::Solver::Direct);
+    ASSERT_TRUE(Snapshot::load(loaded, path.c_str()));
+    std::remove(path.c_str());
+
+    EXPECT_EQ(loaded.getTime(), saved.getTime());
+    ASSERT_EQ(loaded.getAttackers().size(), 1u);
+    EXPECT_EQ(loaded.getAttackers()[0].getBody(), attacker);
+
+    // New particles get the same IDs in both.
+    Particle p(2, 50, 50, MotionVector<double>(0, 0));
+    EXPECT_EQ(loaded.placeParticle(p), saved.placeParticle(p));
+
+    for (int i = 0; i < 3; ++i)
+    {
+        saved.update();
+        loaded.update();
+    }
+
+    ParticleStore& a = saved.getParticles();
+    ParticleStore& b = loaded.getParticles();
+    ASSERT_EQ(a.size(), b.size());
+    for (unsigned i = 0; i < a.size(); ++i)
+    {
+        EXPECT_EQ(a.idAt(i), b.idAt(i));
+        EXPECT_EQ(a.x[i], b.x[i]);
+        EXPECT_EQ(a.vy[i], b.vy[i]);
+        EXPECT_EQ(a.mass[i], b.mass[i]);
+    }
+}
+
+TEST(SnapshotTests, badFilesAreRejectedWithoutChangingTheEnvironment)
+{
+    Environment env(50);
+    std::string path = testing::TempDir() + "snapshot_bad";
+    ASSERT_TRUE(Snapshot::save(env, path.c_str()));
+
+    // Cut the file short.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+
+    Environment other(20);
+    EXPECT_FALSE(Snapshot::load(other, path.c_str()));
+    EXPECT_FALSE(Snapshot::load(other, (path + "_missing").c_str()));
+    EXPECT_EQ(other.getParticles().size(), 20u);
+    std::remove(path.c_str());
+}
+
+TEST(SnapshotTests, attackersAndFreeSlotsAreChecked)
+{
+    std::string path = testing::TempDir() + "snapshot_checked";
+    Environment other(20);
+
+    // Point the only attacker, whose record ends the file, at an ordinary particle.
+    Environment attacked(30);
+    attacked.placeAttacker(600, 500);
+    ASSERT_TRUE(Snapshot::save(attacked, path.c_str()));
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-static_cast<std::streamoff>(sizeof(Snapshot::AttackerRecord)), std::ios::end);
+        std::uint64_t body = attacked.getParticles().idAt(0);
+        file.write(reinterpret_cast<const char*>(&body), sizeof(body));
+    }
+    EXPECT_FALSE(Snapshot::load(other, path.c_str()));
+
+    // Without attackers the free slots, padded to one section, end the file. List
+    // the first one twice.
+    Environment freed(30);
+    freed.getParticles().remove(3);
+    freed.getParticles().remove(4);
+    ASSERT_TRUE(Snapshot::save(freed, path.c_str()));
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        std::uint32_t slot;
+        file.seekg(-static_cast<std::streamoff>(Snapshot::SECTION_ALIGNMENT), std::ios::end);
+        file.read(reinterpret_cast<char*>(&slot), sizeof(slot));
+        file.seekp(-static_cast<std::streamoff>(Snapshot::SECTION_ALIGNMENT - sizeof(slot)), std::ios::end);
+        file.write(reinterpret_cast<const char*>(&slot), sizeof(slot));
+    }
+    EXPECT_FALSE(Snapshot::load(other, path.c_str()));
+    EXPECT_EQ(other.getParticles().size(), 20u);
+    std::remove(path.c_str());
+}
+
+TEST(TrajectoryTests, runsRoundTripThroughTheirEncoding)
+{
+    const char bytes[] = {0, 0, 0, 0, 5, 0, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0};
+    std::vector<char> runs;
+    Trajectory::encodeRuns(bytes, sizeof(bytes), runs);
+    EXPECT_LT(runs.size(), sizeof(bytes));
+
+    char decoded[sizeof(bytes)];
+    ASSERT_TRUE(Trajectory::decodeRuns(runs.data(), runs.size(), decoded, sizeof(decoded)));
+    EXPECT_EQ(std::string(bytes, sizeof(bytes)), std::string(decoded, sizeof(decoded)));
+    EXPECT_FALSE(Trajectory::decodeRuns(runs.data(), runs.size(), decoded, sizeof(decoded) - 1));
+}
+
+TEST(TrajectoryTests, readerCanSeekToAnyFrameInAnyOrder)
+{
+    std::string path = testing::TempDir() + "trajectory_seek";
+
+    Environment env(150);
+    env.setSolver(Environment::Solver::Direct);
+    std::vector<ParticleStore> expected;
+
+    TrajectoryWriter writer;
+    TrajectoryWriter::Options options;
+    options.decimation = 2;
+    options.fields = Trajectory::POSITION | Trajectory::MASS;
+    options.chunkFrames = 3;
+    options.queueFrames = 100;
+    ASSERT_TRUE(writer.open(path.c_str(), options));
+    for (int i = 0; i < 20; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            expected.push_back(env.getParticles());
+        }
+        writer.write(env.getParticles(), env.getTime());
+        env.update();
+    }
+    writer.close();
+    EXPECT_EQ(writer.written(), 10u);
+    EXPECT_EQ(writer.dropped(), 0u);
+
+    TrajectoryReader reader;
+    ASSERT_TRUE(reader.open(path.c_str()));
+    ASSERT_EQ(reader.frames(), 10u);
+    EXPECT_EQ(reader.decimation(), 2u);
+
+    TrajectoryReader::Frame frame;
+    for (unsigned i : {7u, 8u, 2u, 0u, 9u, 3u, 4u})
+    {
+        ASSERT_TRUE(reader.read(i, frame));
+        EXPECT_EQ(frame.step, 2 * i);
+        const ParticleStore& particles = expected[i];
+        ASSERT_EQ(frame.ids.size(), particles.size());
+        EXPECT_TRUE(frame.vx.empty());
+        for (unsigned p = 0; p < particles.size(); ++p)
+        {
+            EXPECT_EQ(frame.ids[p], particles.idAt(p));
+            EXPECT_EQ(frame.x[p], particles.x[p]);
+            EXPECT_EQ(frame.y[p], particles.y[p]);
+            EXPECT_EQ(frame.mass[p], particles.mass[p]);
+        }
+    }
+    EXPECT_FALSE(reader.read(10, frame));
+    reader.close();
+    std::remove(path.c_str());
+}
+
+TEST(InputLogTests, replayEndsExactlyWhereTheRecordedSessionDid)
+{
+    std::string path = testing::TempDir() + "input_replay";
+
+    std::srand(1234);
+    Environment live(150);
+    live.setSolver(Environment::Solver::BarnesHut);
+    live.setThreads(2);
+
+    InputLog log;
+    ASSERT_TRUE(log.record(path.c_str(), InputLog::headerFor(live, 1234, 150)));
+    for (std::uint64_t step = 0; step < 40; ++step)
+    {
+        if (3 == step)
+        {
+            log.apply(live, InputLog::Event{step, InputLog::Action::PlaceParticle, 0, 4, 300, 200, 1, -2});
+        }
+        if (10 == step)
+        {
+            ParticleStore& particles = live.getParticles();
+            log.apply(live, InputLog::Event{step, InputLog::Action::ToggleFreeze, 0, 0, particles.x[0], particles.y[0], 0, 0});
+            EXPECT_TRUE(particles.hasFlag(0, ParticleStore::FROZEN));
+        }
+        if (10 == step || 25 == step)
+        {
+            log.apply(live, InputLog::Event{step, InputLog::Action::PlaceAttacker, 0, 0, 650, 600, 0, 0});
+        }
+        live.update();
+    }
+    log.stop(40);
+
+    InputLog::Header header;
+    std::vector<InputLog::Event> events;
+    ASSERT_TRUE(InputLog::load(path.c_str(), header, events));
+    std::remove(path.c_str());
+    ASSERT_EQ(events.size(), 5u);
+    EXPECT_EQ(events.back().action, InputLog::Action::End);
+
+    Environment replayed = InputLog::start(header);
+    InputLog::replay(replayed, events);
+
+    EXPECT_EQ(replayed.getTime(), live.getTime());
+    EXPECT_EQ(replayed.getAttackers().size(), live.getAttackers().size());
+    ParticleStore& a = live.getParticles();
+    ParticleStore& b = replayed.getParticles();
+    ASSERT_EQ(a.size(), b.size());
+    for (unsigned i = 0; i < a.size(); ++i)
+    {
+        EXPECT_EQ(a.idAt(i), b.idAt(i));
+        EXPECT_EQ(a.x[i], b.x[i]);
+        EXPECT_EQ(a.vy[i], b.vy[i]);
+        EXPECT_EQ(a.flags[i], b.flags[i]);
+    }
+}
+
+TEST(CircleBatchTests, circlesAreFansThatStayWithinHalfAPixel)
+{
+    CircleBatch batch;
+    batch.addCircle(100, 50, 1, Color{255, 0, 0});
+    batch.addCircle(300, 200, 40, Color{0, 255, 0});
+
+    unsigned small = CircleBatch::sidesFor(1);
+    unsigned large = CircleBatch::sidesFor(40);
+    EXPECT_EQ(small, CircleBatch::MIN_SIDES);
+    EXPECT_GT(large, small);
+    EXPECT_LE(40 * (1 - std::cos(std::atan(1) * 4 / large)), 0.5);
+    EXPECT_EQ(CircleBatch::sidesFor(1e6), CircleBatch::MAX_SIDES);
+
+    const std::vector<CircleBatch::Vertex>& vertices = batch.vertices();
+    const std::vector<int>& indices = batch.indices();
+    ASSERT_EQ(vertices.size(), 2 + small + large);
+    ASSERT_EQ(indices.size(), 3 * (small + large));
+
+    // The second circle's center, then its edge.
+    const CircleBatch::Vertex& center = vertices[1 + small];
+    EXPECT_EQ(center.x, 300);
+    EXPECT_EQ(center.g, 255);
+    for (unsigned v = 2 + small; v < vertices.size(); ++v)
+    {
+        EXPECT_NEAR(std::hypot(vertices[v].x - 300, vertices[v].y - 200), 40, 1e-3);
+    }
+    for (int index : indices)
+    {
+        EXPECT_LT(static_cast<unsigned>(index), vertices.size());
+    }
+
+    batch.clear();
+    EXPECT_TRUE(batch.vertices().empty());
+}
+
+TEST(TextBatchTests, textIsQuadsFromTheAtlasAndLayoutsAreKept)
+{
+    // Every glyph is 8 by 10 pixels, and spaces are empty.
+    std::vector<TextBatch::Glyph> glyphs(TextBatch::LAST - TextBatch::FIRST + 1, TextBatch::Glyph{0, 0, 8, 10, 9});
+    glyphs[0] = TextBatch::Glyph{0, 0, 0, 0, 5};
+    int height = TextBatch::pack(glyphs, 64);
+    // The space takes no room, so the first row fits eight glyphs and the rest fit
+    // seven, which puts the A on the fifth row.
+    EXPECT_EQ(glyphs['A' - TextBatch::FIRST].atlasY, 4 * 11);
+    EXPECT_GE(height, glyphs.back().atlasY + 10);
+    for (const TextBatch::Glyph& g : glyphs)
+    {
+        EXPECT_LE(g.atlasX + g.width, 64);
+    }
+
+    TextBatch batch;
+    batch.addText("ignored", 0, 0, Color{255, 255, 255});
+    EXPECT_TRUE(batch.vertices().empty());
+
+    batch.setGlyphs(glyphs, 64, height);
+    batch.addText("A B", 100, 50, Color{0, 255, 0});
+    const std::vector<TextBatch::Vertex>& vertices = batch.vertices();
+    ASSERT_EQ(vertices.size(), 8u);
+    ASSERT_EQ(batch.indices().size(), 12u);
+
+    // The B starts after the advance of the A and the space.
+    const TextBatch::Glyph& a = glyphs['A' - TextBatch::FIRST];
+    EXPECT_EQ(vertices[0].x, 100);
+    EXPECT_EQ(vertices[0].y, 50);
+    EXPECT_EQ(vertices[2].y, 60);
+    EXPECT_FLOAT_EQ(vertices[0].u, a.atlasX / 64.0f);
+    EXPECT_FLOAT_EQ(vertices[2].v, (a.atlasY + 10) / static_cast<float>(height));
+    EXPECT_EQ(vertices[4].x, 100 + 9 + 5);
+    EXPECT_EQ(vertices[4].g, 255);
+    EXPECT_EQ(vertices[4].r, 0);
+    EXPECT_EQ(batch.cached(), 1u);
+
+    // Drawing the same string again reuses its layout, and one that isn't drawn
+    // for long enough is forgotten.
+    batch.clear();
+    batch.addText("A B", 0, 0, Color{255, 255, 255});
+    batch.addText("\x01", 0, 0, Color{255, 255, 255});
+    EXPECT_EQ(batch.cached(), 2u);
+    EXPECT_EQ(batch.vertices().size(), 12u);
+    for (unsigned long long f = 0; f <= TextBatch::KEEP_FRAMES; ++f)
+    {
+        batch.clear();
+        batch.addText("A B", 0, 0, Color{255, 255, 255});
+    }
+    EXPECT_EQ(batch.cached(), 1u);
+}
+
+TEST(TripleBufferTests, readerOnlyEverSeesNewerPublishedValues)
+{
+    TripleBuffer<std::vector<int>> buffer;
+    EXPECT_FALSE(buffer.update());
+
+    buffer.back().assign(1, 7);
+    buffer.publish();
+    ASSERT_TRUE(buffer.update());
+    EXPECT_EQ(buffer.front().at(0), 7);
+    EXPECT_FALSE(buffer.update());
+
+    // Every value the reader takes is whole, and newer than the one before it.
+    const int LAST = 100000;
+    std::thread writer([&buffer]()
+    {
+        for (int i = 1; i <= LAST; ++i)
+        {
+            buffer.back().assign(4, i);
+            buffer.publish();
+        }
+    });
+
+    int seen = 0;
+    while (seen < LAST)
+    {
+        if (buffer.update())
+        {
+            const std::vector<int>& value = buffer.front();
+            ASSERT_EQ(value.size(), 4u);
+            EXPECT_EQ(value.front(), value.back());
+            EXPECT_GT(value.front(), seen);
+            seen = value.front();
+        }
+    }
+    writer.join();
+    EXPECT_FALSE(buffer.update());
+}
+
+TEST(RenderFrameTests, frameCopiesWhatTheWindowDraws)
+{
+    Environment env(0);
+    ParticleStore::Id id = env.placeParticle(Particle(10, 100, 100, MotionVector<double>(0, 0)));
+    env.placeParticle(Particle(5, 400, 300, MotionVector<double>(0, 0)));
+    ParticleStore::Id attacker = env.placeAttacker(700, 500);
+
+    RenderFrame frame;
+    frame.capture(env, 12);
+    ASSERT_EQ(frame.size(), env.getParticles().size());
+    EXPECT_EQ(frame.updates, 12u);
+    EXPECT_EQ(frame.x[frame.indexOf(id)], 100);
+    EXPECT_EQ(frame.radius[frame.indexOf(id)], 10);
+
+    Color red = frame.color[frame.indexOf(attacker)];
+    EXPECT_EQ(red.r, 255);
+    EXPECT_EQ(red.g, 0);
+
+    EXPECT_EQ(frame.findParticle(104, 96), id);
+    EXPECT_EQ(frame.findParticle(250, 250), ParticleStore::NO_ID);
+    EXPECT_EQ(frame.indexOf(12345), ParticleStore::NONE);
+
+    std::vector<unsigned> inView;
+    frame.visible(80, 80, 120, 120, inView);
+    ASSERT_EQ(inView.size(), 1u);
+    EXPECT_EQ(inView[0], frame.indexOf(id));
+    frame.visible(0, 0, 1300, 1200, inView);
+    EXPECT_EQ(inView.size(), frame.size());
+
+    // Capturing again reuses the frame.
+    env.getParticles().remove(env.getParticles().indexOf(id));
+    frame.capture(env, 13);
+    EXPECT_EQ(frame.size(), env.getParticles().size());
+    EXPECT_EQ(frame.indexOf(id), ParticleStore::NONE);
+}
+
+TEST(CameraTests, zoomKeepsThePointUnderTheCursor)
+{
+    Camera camera(1300, 1200);
+    EXPECT_EQ(camera.toScreenX(100), 100);
+    EXPECT_EQ(camera.toScreenY(250), 250);
+    EXPECT_EQ(camera.left(), 0);
+    EXPECT_EQ(camera.bottom(), 1200);
+
+    double x = camera.toWorldX(400);
+    double y = camera.toWorldY(300);
+    camera.zoomAt(4, 400, 300);
+    EXPECT_EQ(camera.getZoom(), 4);
+    EXPECT_NEAR(camera.toScreenX(x), 400, 1e-9);
+    EXPECT_NEAR(camera.toScreenY(y), 300, 1e-9);
+    EXPECT_NEAR(camera.right() - camera.left(), 1300 / 4.0, 1e-9);
+
+    // Panning moves the view by pixels, whatever the zoom.
+    camera.pan(20, -8);
+    EXPECT_NEAR(camera.toScreenX(x), 420, 1e-9);
+    EXPECT_NEAR(camera.toScreenY(y), 292, 1e-9);
+    EXPECT_NEAR(camera.toWorldX(camera.toScreenX(77)), 77, 1e-9);
+
+    camera.zoomAt(1e9, 0, 0);
+    EXPECT_EQ(camera.getZoom(), Camera::MAX_ZOOM);
+    camera.zoomAt(1e-18, 0, 0);
+    EXPECT_EQ(camera.getZoom(), Camera::MIN_ZOOM);
+
+    camera.reset();
+    EXPECT_EQ(camera.toScreenX(100), 100);
+}
+
+TEST(DensityMapTests, tinyParticlesAddUpToOneSquarePerPixel)
+{
+    DensityMap density;
+    density.resize(100, 50);
+
+    // Three particles in one pixel, one in another, and two off screen.
+    density.add(10.2, 20.7, 0.25, Color{200, 0, 0});
+    density.add(10.9, 20.1, 0.25, Color{0, 200, 0});
+    density.add(10.5, 20.5, 0.5, Color{0, 200, 0});
+    density.add(60, 30, 0.01, Color{255, 255, 255});
+    density.add(-1, 30, 0.5, Color{255, 255, 255});
+    density.add(100, 30, 0.5, Color{255, 255, 255});
+    EXPECT_EQ(density.pixels(), 2u);
+
+    CircleBatch batch;
+    density.drawInto(batch);
+    const std::vector<CircleBatch::Vertex>& vertices = batch.vertices();
+    ASSERT_EQ(vertices.size(), 8u);
+    ASSERT_EQ(batch.indices().size(), 12u);
+
+    // The full pixel is the average color, and the lone particle is dimmed, but
+    // only as far as MIN_COVERAGE.
+    EXPECT_EQ(vertices[0].x, 10);
+    EXPECT_EQ(vertices[2].y, 21);
+    EXPECT_EQ(vertices[0].r, 50);
+    EXPECT_EQ(vertices[0].g, 150);
+    EXPECT_EQ(vertices[4].r, static_cast<int>(255 * DensityMap::MIN_COVERAGE));
+
+    density.clear();
+    EXPECT_EQ(density.pixels(), 0u);
+    density.add(10, 20, 1, Color{0, 0, 255});
+    EXPECT_EQ(density.pixels(), 1u);
+}
+
+TEST(ProfilerTests, statsCoverTheLastWindowOfFrames)
+{
+    Profiler profiler;
+    // The first frames fall out of the window.
+    for (int i = 0; i < 20; ++i)
+    {
+        profiler.add(Profiler::Phase::Forces, std::chrono::milliseconds(1000));
+        profiler.endFrame();
+    }
+    for (unsigned i = 1; i <= Profiler::WINDOW; ++i)
+    {
+        profiler.add(Profiler::Phase::Forces, std::chrono::milliseconds(i));
+        profiler.endFrame();
+    }
+
+    Profiler::Stats stats = profiler.stats(Profiler::Phase::Forces);
+    EXPECT_DOUBLE_EQ(stats.min, 1);
+    EXPECT_DOUBLE_EQ(stats.avg, (Profiler::WINDOW + 1) / 2.0);
+    EXPECT_DOUBLE_EQ(stats.p99, Profiler::WINDOW - 1);
+    EXPECT_DOUBLE_EQ(profiler.last(Profiler::Phase::Forces), Profiler::WINDOW);
+    EXPECT_DOUBLE_EQ(profiler.stats(Profiler::Phase::Merges).p99, 0);
+}
+
+TEST(ProfilerTests, updatesWriteOneCsvLinePerFrame)
+{
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+
+    Environment env(200);
+    env.setSolver(Environment::Solver::Direct);
+    Profiler& profiler = env.getProfiler();
+    profiler.setCsv(file);
+    for (int i = 0; i < 3; ++i)
+    {
+        env.update();
+        profiler.endFrame();
+    }
+    profiler.setCsv(nullptr);
+
+    char line[256];
+    std::rewind(file);
+    ASSERT_NE(std::fgets(line, sizeof(line), file), nullptr);
+    EXPECT_EQ(std::string(line), "frame,forces_ms,merges_ms,explosions_ms,removal_ms,circles_ms,text_ms,present_ms\n");
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_NE(std::fgets(line, sizeof(line), file), nullptr);
+        EXPECT_EQ(std::string(line).substr(0, 2), std::to_string(i) + ",");
+    }
+    EXPECT_EQ(std::fgets(line, sizeof(line), file), nullptr);
+    std::fclose(file);
+
+    EXPECT_EQ(profiler.frames(), 3u);
+    EXPECT_GT(profiler.stats(Profiler::Phase::Forces).min, 0);
+    EXPECT_EQ(profiler.stats(Profiler::Phase::Circles).min, 0);
+}
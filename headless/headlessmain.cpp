@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Environment.hpp"
+#include "InputLog.hpp"
+#include "Log.hpp"
+#include "Snapshot.hpp"
+#include "ThreadPool.hpp"
+#include "TrajectoryWriter.hpp"
+
+
+namespace
+{
+    const char* const SOLVER_NAMES[] = {"reference", "direct", "barneshut", "multipole", "mesh"};
+    const char* const INTEGRATOR_NAMES[] = {"euler", "leapfrog", "block"};
+
+
+    // Return the index of name in names, or -1 if it isn't there.
+    template <unsigned N>
+    int find(const char* const (&names)[N], const char* name)
+    {
+        for (unsigned i = 0; i < N; ++i)
+        {
+            if (0 == std::strcmp(names[i], name))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+
+    void printUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " --replay <recording> [threads]\n"
+            << "       " << program << " [particles|snapshot] [frames] [solver] [integrator] [threads] [csv] [save] [trajectory] [every]\n"
+            << "  particles can be the path of a snapshot to start from instead\n"
+            << "  solver is one of reference, direct, barneshut, multipole, mesh (default direct)\n"
+            << "  integrator is one of euler, leapfrog, block (default euler)\n"
+            << "  threads defaults to every thread the machine has\n"
+            << "  csv is a file to write the time of each phase of each frame to, or - for none\n"
+            << "  save is a file to save a snapshot of the environment to when it's done, or - for none\n"
+            << "  trajectory is a file to record the particles to, every frame or every [every] frames\n"
+            << "  --replay runs a session recorded with a.out.src --record, with the threads it was recorded with by default" << std::endl;
+    }
+
+
+    // Return a hash of every particle's position and velocity, to tell whether two
+    // runs ended up in exactly the same place.
+    unsigned long long fingerprint(const ParticleStore& particles)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (const std::vector<Real>* values : {&particles.x, &particles.y, &particles.vx, &particles.vy})
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values->data());
+            for (std::size_t b = 0; b < values->size() * sizeof(Real); ++b)
+            {
+                hash = (hash ^ bytes[b]) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+
+    // Replay a recorded session as fast as possible.
+    int replay(const char* path, unsigned threads)
+    {
+        InputLog::Header header;
+        std::vector<InputLog::Event> events;
+        if (!InputLog::load(path, header, events))
+        {
+            Log::flush();
+            return 1;
+        }
+
+        if (threads > 0)
+        {
+            header.threads = threads;
+        }
+        Environment env = InputLog::start(header);
+        std::uint64_t steps = events.empty() ? 0 : events.back().step;
+
+        auto start = std::chrono::steady_clock::now();
+        InputLog::replay(env, events);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Replayed " << events.size() << " actions over " << steps << " updates, "
+            << SOLVER_NAMES[header.solver] << ", " << INTEGRATOR_NAMES[header.integrator] << ", "
+            << header.threads << " threads, " << GRAVSIM_PRECISION_NAME << " precision\n"
+            << elapsed.count() << " s, " << steps / elapsed.count() << " steps/s, "
+            << env.getParticles().size() << " particles left, fingerprint "
+            << std::hex << fingerprint(env.getParticles()) << std::dec << std::endl;
+        return 0;
+    }
+}
+
+
+// Steps an environment for a number of frames as fast as it can, without a window,
+// and reports how many steps it took per second.
+int main(int argc, char** argv)
+{
+    if (argc > 1 && (0 == std::strcmp(argv[1], "-h") || 0 == std::strcmp(argv[1], "--help")))
+    {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    if (argc > 2 && 0 == std::strcmp(argv[1], "--replay"))
+    {
+        return replay(argv[2], argc > 3 ? std::atoi(argv[3]) : 0);
+    }
+
+    // Anything that doesn't start with a digit is taken to be a snapshot.
+    const char* snapshot = argc > 1 && !std::isdigit(static_cast<unsigned char>(argv[1][0])) ? argv[1] : nullptr;
+    unsigned numParticles = argc > 1 && !snapshot ? std::atoi(argv[1]) : 10000;
+    int frames = argc > 2 ? std::atoi(argv[2]) : 100;
+    int solver = argc > 3 ? find(SOLVER_NAMES, argv[3]) : static_cast<int>(Environment::Solver::Direct);
+    int integrator = argc > 4 ? find(INTEGRATOR_NAMES, argv[4]) : static_cast<int>(Environment::Integrator::Euler);
+    unsigned threads = argc > 5 ? std::atoi(argv[5]) : ThreadPool::hardwareThreads();
+
+    if (solver < 0 || integrator < 0 || frames <= 0 || threads == 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Environment env(snapshot ? 0 : numParticles);
+    if (snapshot)
+    {
+        auto loadStart = std::chrono::steady_clock::now();
+        if (!Snapshot::load(env, snapshot))
+        {
+            Log::flush();
+            return 1;
+        }
+        std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+        numParticles = env.getParticles().size();
+        std::cout << "Loaded " << numParticles << " particles from " << snapshot << " in " << loadTime.count() << " s" << std::endl;
+    }
+    env.setSolver(static_cast<Environment::Solver>(solver));
+    env.setIntegrator(static_cast<Environment::Integrator>(integrator));
+    env.setThreads(threads);
+
+    Profiler& profiler = env.getProfiler();
+    std::FILE* csv = nullptr;
+    if (argc > 6 && 0 != std::strcmp(argv[6], "-"))
+    {
+        csv = std::fopen(argv[6], "w");
+        if (nullptr == csv)
+        {
+            std::cerr << "Couldn't open " << argv[6] << " for writing" << std::endl;
+            return 1;
+        }
+        profiler.setCsv(csv);
+    }
+
+    TrajectoryWriter trajectory;
+    if (argc > 8)
+    {
+        TrajectoryWriter::Options options;
+        options.decimation = argc > 9 ? std::atoi(argv[9]) : 1;
+        if (!trajectory.open(argv[8], options))
+        {
+            Log::flush();
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        env.update();
+        profiler.endFrame();
+        trajectory.write(env.getParticles(), env.getTime());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << numParticles << " particles, " << frames << " frames, "
+        << SOLVER_NAMES[solver] << ", " << INTEGRATOR_NAMES[integrator] << ", "
+        << threads << " threads, " << GRAVSIM_PRECISION_NAME << " precision\n"
+        << elapsed.count() << " s, " << frames / elapsed.count() << " steps/s, "
+        << env.getParticles().size() << " particles left" << std::endl;
+
+    // Only the physics runs here, so the drawing phases are left out.
+    std::printf("phase        min    avg    p99 (ms, last %u frames)\n", std::min<unsigned>(frames, Profiler::WINDOW));
+    for (Profiler::Phase phase : {Profiler::Phase::Forces, Profiler::Phase::Merges, Profiler::Phase::Explosions, Profiler::Phase::Removal})
+    {
+        Profiler::Stats stats = profiler.stats(phase);
+        std::printf("%-10s %6.2f %6.2f %6.2f\n", Profiler::phaseName(phase), stats.min, stats.avg, stats.p99);
+    }
+
+    if (csv)
+    {
+        profiler.setCsv(nullptr);
+        std::fclose(csv);
+    }
+
+    trajectory.close();
+
+    if (argc > 7 && 0 != std::strcmp(argv[7], "-") && !Snapshot::save(env, argv[7]))
+    {
+        Log::flush();
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+
+#include <cstddef>
+
+
+// Counts every heap allocation made through operator new, which includes every
+// standard container, on any thread. The counts only go up, so to find out how many
+// allocations a piece of code makes, take the difference from before and after it.
+//
+// Counting needs the replacement operator new in src/AllocationHooks.cpp, which
+// isn't part of the library, so programs that don't count don't pay for it. The
+// tests always link it, and the other executables do when GRAVSIM_COUNT_ALLOCATIONS
+// is turned on in CMake. Without it the counts stay at 0 and available is false.
+class AllocationCounter
+{
+public:
+    // Return true if the replacement operator new is linked in.
+    static bool available();
+
+    // Return the number of allocations made so far.
+    static unsigned long long allocations();
+
+    // Return the total number of bytes requested by those allocations.
+    static unsigned long long bytes();
+
+    // Count an allocation of this many bytes. Only the replacement operator new
+    // should call this.
+    static void record(std::size_t size);
+
+    // Mark the counts as available. The replacement operator new calls this before
+    // main starts.
+    static void install();
+};
+
+
+#endif
@@ -4,45 +4,60 @@
 
 #include <iostream>
 #include <cmath>
-#include <list>
-#include "Particle.hpp"
+#include <cstdlib>
+#include "ParticleStore.hpp"
+#include "Vec2.hpp"
 
 
-class Attacker : public Particle
+// An attacker roams around and shoots a laser at the nearest particle until it's
+// destroyed. Its body is a particle without gravity that lives in the ParticleStore,
+// and this class holds the rest of its state.
+class Attacker
 {
 public:
-    Attacker(
-        double x,
-        double y
-    );
+    // Constructor. Takes the ID of the particle that is this attacker's body.
+    Attacker(ParticleStore::Id body);
 
-    void update(std::list<Particle*>& particles) override;
+    // Move for dt seconds, then look for or shoot at a target.
+    void update(ParticleStore& particles, double dt=TIME_STEP);
 
-    void move() override;
+    void move(ParticleStore& particles, double dt=TIME_STEP);
 
-    bool lockedOn();
+    bool lockedOn(const ParticleStore& particles);
 
     int getWeaponStrength();
 
     // Fire the weapon.
     void fire();
 
-    // Return a pointer to the target, if there is one.
-    Particle* getTarget();
+    // Return the ID of this attacker's body.
+    ParticleStore::Id getBody();
 
-    SDL_Color getColor() override;
+    // Return the ID of the target, or ParticleStore::NO_ID if there isn't one.
+    ParticleStore::Id getTarget();
+
+    // The radius of an attacker's body.
+    static constexpr double RADIUS = 5;
 
 private:
+    friend class Snapshot;
+
     // Increase the weapon strength by a certain amount.
     void increaseWeaponStrength(double amount);
 
     double weaponDamage();
 
-    Particle* target;
+    // Forget about the current target.
+    void loseTarget();
+
+    ParticleStore::Id body;
+    ParticleStore::Id target;
     double ws;
-    double angle;
+    // The direction the attacker is moving in, or the zero vector before it has
+    // picked one.
+    Vec2<double> heading;
     int lifespan;
     int range;
 };
 
-#endif
\ No newline at end of file
+#endif
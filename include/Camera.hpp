@@ -0,0 +1,56 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+
+// Maps the environment onto the window, so the user can pan around it and zoom in
+// and out. The camera looks at a point of the environment, which is drawn in the
+// middle of the window, at some number of pixels per meter. It starts out showing
+// the environment at one pixel per meter with its top left corner in the top left
+// of the window, the way it was drawn before there was a camera.
+class Camera
+{
+public:
+    // The closest and furthest the camera can zoom, in pixels per meter.
+    static constexpr double MIN_ZOOM = 1.0 / 1024;
+    static constexpr double MAX_ZOOM = 64;
+
+    // Constructor, for a window of the given size in pixels.
+    Camera(double width, double height);
+
+    // Go back to where the camera started.
+    void reset();
+
+    // Move the view by some number of pixels.
+    void pan(double dx, double dy);
+
+    // Zoom in by a factor, or out if it's less than 1, keeping the point under the
+    // given pixel where it is.
+    void zoomAt(double factor, double screenX, double screenY);
+
+    // Return the number of pixels per meter.
+    double getZoom() const;
+
+    // Convert between positions in the environment and pixels in the window.
+    double toScreenX(double x) const;
+    double toScreenY(double y) const;
+    double toWorldX(double screenX) const;
+    double toWorldY(double screenY) const;
+
+    // Return the edges of the part of the environment in the window.
+    double left() const;
+    double top() const;
+    double right() const;
+    double bottom() const;
+
+private:
+    double width;
+    double height;
+
+    // The point in the middle of the window.
+    double centerX;
+    double centerY;
+    double zoom;
+};
+
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef CIRCLEBATCH_HPP
+#define CIRCLEBATCH_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include "Color.hpp"
+
+
+// Collects filled circles into one list of triangles, so a whole frame of particles
+// can be drawn with a single call to SDL_RenderGeometry instead of a few calls per
+// row of pixels in every circle. Each circle is a fan of triangles around its
+// center, with just enough sides that its edge is never more than half a pixel off
+// a true circle. The batch keeps its memory from one frame to the next.
+class CircleBatch
+{
+public:
+    // Laid out exactly like SDL_Vertex, so the vertices can be handed to SDL as they
+    // are, without the batch depending on SDL.
+    struct Vertex
+    {
+        float x;
+        float y;
+        std::uint8_t r;
+        std::uint8_t g;
+        std::uint8_t b;
+        std::uint8_t a;
+        float u;
+        float v;
+    };
+
+    // The fewest and most sides a circle is drawn with.
+    static constexpr unsigned MIN_SIDES = 6;
+    static constexpr unsigned MAX_SIDES = 96;
+
+    CircleBatch();
+
+    // Remove every circle, keeping the memory.
+    void clear();
+
+    // Add a filled circle.
+    void addCircle(double x, double y, double radius, Color color);
+
+    // Add a filled rectangle with its top left corner at x, y. Used for things too
+    // small to be worth drawing as circles.
+    void addRect(double x, double y, double width, double height, Color color);
+
+    // Return the vertices of every circle, and the vertex indices of their
+    // triangles, three per triangle.
+    const std::vector<Vertex>& vertices() const;
+    const std::vector<int>& indices() const;
+
+    // Return the number of sides a circle with this radius is drawn with.
+    static unsigned sidesFor(double radius);
+
+private:
+    // The points around a unit circle for each number of sides, worked out once.
+    std::vector<std::vector<float>> unitX;
+    std::vector<std::vector<float>> unitY;
+
+    std::vector<Vertex> circleVertices;
+    std::vector<int> circleIndices;
+};
+
+
+#endif
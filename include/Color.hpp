@@ -0,0 +1,17 @@
+#ifndef COLOR_HPP
+#define COLOR_HPP
+
+
+#include <cstdint>
+
+
+// An RGB color. This stands in for SDL_Color, so the physics doesn't depend on SDL.
+struct Color
+{
+    std::uint8_t r;
+    std::uint8_t g;
+    std::uint8_t b;
+};
+
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef DENSITYMAP_HPP
+#define DENSITYMAP_HPP
+
+
+#include <vector>
+#include "CircleBatch.hpp"
+#include "Color.hpp"
+
+
+// Adds up particles that are too small on screen to draw as circles, one pixel at
+// a time. Each pixel is drawn once however many particles land in it, brighter the
+// more of it they cover, so a zoomed out view of a crowded environment costs one
+// square per lit pixel instead of a circle per particle.
+//
+// Only the pixels something was added to are cleared, so clearing costs as much as
+// the last frame did rather than the whole window.
+class DensityMap
+{
+public:
+    // The least a lit pixel is dimmed to, so a lone particle doesn't disappear.
+    static constexpr float MIN_COVERAGE = 0.25f;
+
+    // Set the size of the window in pixels, and forget everything added.
+    void resize(unsigned width, unsigned height);
+
+    // Forget everything added.
+    void clear();
+
+    // Add a particle at a point in the window, covering an area of it in square
+    // pixels. Particles outside the window are ignored.
+    void add(double x, double y, double area, Color color);
+
+    // Add a square to the batch for each pixel with anything in it. Its color is the
+    // average color of what's in it, weighted by area, and dimmed by how little of
+    // the pixel it all covers.
+    void drawInto(CircleBatch& batch) const;
+
+    // Return the number of pixels with anything in them.
+    unsigned pixels() const;
+
+private:
+    struct Pixel
+    {
+        unsigned x;
+        unsigned y;
+        float area;
+        float r;
+        float g;
+        float b;
+    };
+
+    unsigned width = 0;
+    unsigned height = 0;
+
+    // For each pixel of the window, its index in lit, or -1 if nothing is in it.
+    std::vector<int> slot;
+    std::vector<Pixel> lit;
+};
+
+
+#endif
@@ -5,6 +5,7 @@
 static constexpr double GRAVITATIONAL_CONSTANT = 0.0001;
 static constexpr double ELASTICITY_CONSTANT = 0.9;
 static constexpr double PARTICLE_DENSITY = 5500;
+static constexpr double TIME_STEP = 1.0 / 60.0;
 
 
 #endif
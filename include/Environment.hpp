@@ -3,52 +3,285 @@
 
 
 #include <cstdlib>
-#include <list>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <utility>
 #include "Particle.hpp"
 #include "Attacker.hpp"
+#include "ParticleStore.hpp"
+#include "QuadTree.hpp"
+#include "GravityKernel.hpp"
+#include "FastMultipole.hpp"
+#include "ParticleMesh.hpp"
+#include "GravitySolver.hpp"
+#include "SpatialGrid.hpp"
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
 #include "EnvConstants.hpp"
 
 
 class Environment
 {
 public:
+    // The ways gravity between particles can be computed.
+    enum class Solver
+    {
+        // Every particle accelerates towards every other particle one at a time,
+        // using Particle::accelerateTowards. This is slow, and is kept around as
+        // a reference.
+        Reference,
+        // Every pair of particles is summed exactly with a vectorized kernel. This
+        // is the fastest choice for small and medium numbers of particles.
+        Direct,
+        // Distant groups of particles are approximated using a quadtree.
+        BarnesHut,
+        // Distant groups of particles are approximated using multipole expansions.
+        // This scales best to very large numbers of particles.
+        Multipole,
+        // Mass is spread onto a grid and solved with FFTs, with nearby pairs summed
+        // exactly. This suits dense scenes where particles are spread fairly evenly.
+        Mesh
+    };
+
+    // The ways particles can be moved forward in time. Neither is used by the
+    // Reference solver, which keeps its own way of moving particles.
+    enum class Integrator
+    {
+        // Move every particle, then apply the acceleration from where it started.
+        Euler,
+        // Drift half a step, kick with the acceleration from there, and drift the
+        // other half. This keeps the energy of orbits from drifting away over
+        // time, so larger steps can be taken for the same accuracy.
+        Leapfrog,
+        // Leapfrog, but each particle takes the step divided by its own power of
+        // two, picked from how quickly its velocity is changing. Only the particles
+        // finishing a step have their acceleration computed, so a few particles in
+        // tight orbits don't make every particle take small steps.
+        Block
+    };
+
+    // What getUpdateAllocations returns when allocations aren't being counted.
+    static constexpr unsigned long long NOT_COUNTED = ~0ull;
+
     // Constructor.
     Environment(unsigned numParticles=10);
 
-    // Destructor
-    ~Environment();
-
-    // Update the environment to move particles, resolve collisions, etc.
+    // Update the environment to move particles, resolve collisions, etc. Each
+    // update moves the environment forward by one time step.
     void update();
 
     // Generate a random particle.
-    Particle* genRandomParticle();
+    Particle genRandomParticle();
+
+    // Place a copy of a particle into the environment and return its ID, or
+    // ParticleStore::NO_ID if the store is full.
+    ParticleStore::Id placeParticle(Particle p);
+
+    // Place an attacker into the environment and return the ID of its body, or
+    // ParticleStore::NO_ID if the store is full.
+    ParticleStore::Id placeAttacker(double x, double y);
 
-    // Place a particle into the environment. A bool value determines if it
-    // can be influeced by gravity.
-    void placeParticle(Particle* p);
+    // Given some coordinates, return the ID of the particle at the coordinates,
+    // or ParticleStore::NO_ID if there isn't one.
+    ParticleStore::Id findParticle(double x, double y);
 
-    // Given some coordinates, return the particle at the coordinates, if any.
-    Particle* findParticle(double x, double y);
+    // Return a reference to the particles in this environment.
+    ParticleStore& getParticles();
 
-    // Return a reference to the list of particles in this environment.
-    std::list<Particle*>& getParticles();
+    // Return a reference to the attackers in this environment.
+    std::vector<Attacker>& getAttackers();
+
+    // Return the grid used to find colliding particles. It holds every particle as
+    // of the last collision check.
+    const SpatialGrid& getGrid();
 
     // Return a vector containing width and height of this environment.
     std::vector<unsigned> dimensions();
 
+    // Choose how gravity is computed.
+    void setSolver(Solver s);
+
+    // Return the way gravity is currently computed.
+    Solver getSolver();
+
+    // Set the opening angle used by the Barnes-Hut solver. Smaller angles are more
+    // accurate but slower.
+    void setOpeningAngle(double theta);
+
+    // Choose how particles are moved forward in time.
+    void setIntegrator(Integrator i);
+
+    // Return the way particles are moved forward in time.
+    Integrator getIntegrator();
+
+    // Set the number of seconds each update moves the environment forward by.
+    void setTimeStep(double dt);
+
+    // Return the number of seconds each update moves the environment forward by.
+    double getTimeStep();
+
+    // Return the number of seconds simulated so far.
+    double getTime();
+
+    // Return the number of particle accelerations the solver has computed so far.
+    unsigned long long getForceEvaluations();
+
+    // Return the number of heap allocations made while running the last update, by
+    // any thread. Once the scratch arrays have grown to fit, this should be 0 unless
+    // particles are being added. Return NOT_COUNTED if allocations aren't being
+    // counted, see AllocationCounter.
+    unsigned long long getUpdateAllocations();
+
+    // Return the profiler that times the phases of each update. Anything drawing the
+    // environment can time its own phases with it too. Frames are never ended here,
+    // that's left to whatever decides what a frame is.
+    Profiler& getProfiler();
+
+    // Set the order of the expansions used by the Multipole solver. Higher orders
+    // are more accurate but slower.
+    void setMultipoleOrder(unsigned order);
+
+    // Turn the Mesh solver's exact sum over nearby particles on or off. Without it
+    // the pull between close particles is softened.
+    void setMeshCorrection(bool on);
+
+    // Compute gravity with the current solver, and return its root mean square
+    // relative error against exact sums for a sample of particles.
+    double measureSolverError(unsigned samples=100);
+
+    // In deterministic mode every particle is pulled towards where the others were
+    // at the start of the frame, and sums are always done in the same order, so
+    // updates give bit for bit the same result for any number of threads. This
+    // also lets the Reference solver run on more than one thread.
+    void setDeterministic(bool on);
+
+    // Return true if the environment is in deterministic mode.
+    bool isDeterministic();
+
+    // Set the number of threads used to update the environment. Outside of
+    // deterministic mode, the Reference solver always runs on one thread.
+    void setThreads(unsigned threads);
+
+    // Return the number of threads used to update the environment.
+    unsigned getThreads();
+
 
 private:
-    // Returns true if particle p is out of bounds.
-    bool isOutsideBounds(Particle p);
+    friend class Snapshot;
+
+    // Returns true if the particle at index i is out of bounds.
+    bool isOutsideBounds(unsigned i);
+
+    // Work out how strongly each particle pulls. Particles without gravity and dead
+    // particles don't pull at all.
+    void collectMasses();
+
+    // Compute the acceleration of every particle with the current solver.
+    void computeAccelerations();
+
+    // Move every particle and pull it towards every other particle with
+    // Particle::pullTowards, using the positions from the start of the frame.
+    void referenceStep();
+
+    // Return the solver to use for anything other than Solver::Reference.
+    GravitySolver& activeSolver();
+
+    // Move every particle forward in time by one time step with the current
+    // integrator, computing accelerations as they're needed.
+    void step();
+
+    // Move every particle forward by one time step with block time steps.
+    void blockStep();
+
+    // Return how many times the time step should be halved for particle i, judging
+    // by its velocity and its last computed acceleration.
+    unsigned blockLevel(unsigned i);
+
+    // Move every particle along its velocity for h seconds.
+    void drift(double h);
+
+    // Apply the last computed acceleration of every particle for h seconds.
+    void kick(double h);
+
+    // Coalesce every pair of particles that are colliding. Nearby pairs are found
+    // with the grid in parallel, then merged one at a time in order of their indices,
+    // so the result is the same no matter how many threads there are.
+    void collide();
+
+    // Explode the particle at index i into fragments.
+    void explode(unsigned i);
 
     unsigned numParticles;
-    std::list<Particle*> particles;
+    ParticleStore particles;
+    std::vector<Attacker> attackers;
     unsigned width = 1300;
     unsigned height = 1200;
 
+    Solver solver = Solver::BarnesHut;
+    bool deterministic = false;
+    Integrator integrator = Integrator::Leapfrog;
+    double timeStep = TIME_STEP;
+    double time = 0;
+    unsigned long long forceEvaluations = 0;
+    unsigned long long updateAllocations = 0;
+    Profiler profiler;
+
+    // Block time steps are never smaller than the time step over 2^MAX_BLOCK_LEVEL.
+    static constexpr unsigned MAX_BLOCK_LEVEL = 10;
+    // The fraction by which a particle's velocity may change in one block step.
+    static constexpr double BLOCK_ACCURACY = 0.02;
+    // The mesh solver works out its Green's function when it's made, which takes a
+    // while and a few megabytes, so it's only made once the Mesh solver is first
+    // used. Copies of an environment get their own copy of it.
+    struct LazyMesh
+    {
+        LazyMesh() = default;
+        LazyMesh(const LazyMesh& other);
+        LazyMesh(LazyMesh&& other) = default;
+        LazyMesh& operator=(const LazyMesh& other);
+        LazyMesh& operator=(LazyMesh&& other) = default;
+
+        std::unique_ptr<ParticleMesh> mesh;
+        bool shortRange = true;
+    };
+
+    QuadTree tree;
+    GravityKernel kernel;
+    FastMultipole multipole;
+    LazyMesh mesh;
+    SpatialGrid grid;
+
+    // Copies of an environment share the same threads.
+    std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+
+    // Scratch arrays for the solvers, kept around so they don't have to be
+    // reallocated every frame.
+    std::vector<Real> bodyMass;
+    std::vector<Accum> accX;
+    std::vector<Accum> accY;
+    // For block time steps. The ID of the particle each acceleration belongs to,
+    // and where it was and its mass when it was computed, so they can be reused by
+    // the next update, whether each particle has one, each particle's level, the
+    // particles sorted by level with room to sort them again, and the particles
+    // finishing a step.
+    std::vector<ParticleStore::Id> accIds;
+    std::vector<Real> accFromX;
+    std::vector<Real> accFromY;
+    std::vector<Real> accFromMass;
+    std::vector<std::uint8_t> cached;
+    std::vector<std::uint8_t> stepLevel;
+    std::vector<unsigned> byLevel;
+    std::vector<unsigned> levelOrder;
+    std::vector<unsigned> active;
+    // Positions at the start of the frame, for the deterministic Reference solver.
+    std::vector<Real> frameX;
+    std::vector<Real> frameY;
+    // Particles near the one being checked, for each thread.
+    std::vector<std::vector<unsigned>> nearby;
+    // Colliding pairs found by each thread, and all of them together.
+    std::vector<std::vector<std::pair<unsigned, unsigned>>> contacts;
+    std::vector<std::pair<unsigned, unsigned>> collisions;
 };
 
 
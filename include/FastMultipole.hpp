@@ -0,0 +1,155 @@
+#ifndef FASTMULTIPOLE_HPP
+#define FASTMULTIPOLE_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include "GravitySolver.hpp"
+#include "ThreadPool.hpp"
+
+
+// A fast multipole method solver. The domain is split into a uniform quadtree of
+// square cells. The pull of the bodies in each cell is summarized by a Taylor
+// expansion about its center, which is shifted up the tree, converted into an
+// expansion about the center of each well separated cell, and shifted back down to
+// the leaves. Bodies in neighbouring leaves are summed exactly. The work grows
+// linearly with the number of bodies.
+//
+// Expansions are in Cartesian powers of the offset from the cell center, since
+// the pull falls off with the square of the distance, and that isn't a harmonic
+// function in the plane.
+class FastMultipole : public GravitySolver
+{
+public:
+    // Constructor. Higher orders are more accurate but slower. Leaves are made
+    // small enough to hold about leafSize bodies each.
+    FastMultipole(unsigned order=8, unsigned leafSize=32);
+
+    // Build the tree over the bodies and compute the acceleration of each one.
+    // The tree always covers the width x height domain, and grows to include any
+    // bodies outside of it.
+    void solve(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // The expansions of every cell are still built, but local expansions are only
+    // worked out for cells with a target in them.
+    void solveFor(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // Set the order of the expansions, between 1 and MAX_ORDER.
+    void setOrder(unsigned p);
+
+    // Return the order of the expansions.
+    unsigned getOrder() const;
+
+    // Return the number of levels below the root in the last tree that was built.
+    unsigned getLevels() const;
+
+    static constexpr unsigned MAX_ORDER = 16;
+
+    // Trees never get deeper than this, which caps the memory used by the
+    // expansions. Leaves just get fuller instead.
+    static constexpr unsigned MAX_LEVELS = 8;
+
+
+private:
+    // Return where the coefficient for x^a y^b is stored in an expansion.
+    static unsigned term(unsigned a, unsigned b);
+
+    // Return the index of the first cell of a level.
+    static unsigned levelStart(unsigned level);
+
+    // Write into d the derivatives of 1 / r at the offset (x, y), up to this order.
+    void derivatives(double x, double y, double* d) const;
+
+    // Shared by solve and solveFor. With no targets, every body is a target.
+    void run(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>* targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    );
+
+    // Sort the bodies into leaves and compute the expansion of every cell.
+    void upward(const std::vector<Real>& xs, const std::vector<Real>& ys, const std::vector<Real>& masses, ThreadPool* pool);
+
+    // Flag the cells that hold a target, and every cell above them.
+    void markNeeded(const std::vector<unsigned>* targets);
+
+    // Convert the expansions of well separated cells into local expansions about
+    // each needed cell, and push them down to the leaves.
+    void downward(ThreadPool* pool);
+
+    // Work out the acceleration of each target from its leaf's local expansion and
+    // the bodies in the neighbouring leaves.
+    void evaluate(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) const;
+
+    // Return the center of a cell along one axis.
+    double centerX(unsigned level, unsigned ix) const;
+    double centerY(unsigned level, unsigned iy) const;
+
+    // Run body over [begin, end) on the pool, or on this thread if there isn't one.
+    static void forEach(ThreadPool* pool, unsigned begin, unsigned end, unsigned grain, const ThreadPool::RangeTask& body);
+
+    unsigned order;
+    unsigned leafSize;
+    unsigned terms;
+    unsigned levels;
+
+    // Lower left corner and side length of the root cell.
+    double x0;
+    double y0;
+    double side;
+
+    // Number of bodies in each cell. Cells of a level are stored row by row, and
+    // the levels one after another, starting at the root.
+    std::vector<unsigned> counts;
+    // Whether each cell needs a local expansion.
+    std::vector<std::uint8_t> needed;
+
+    // Multipole and local expansions of each cell, terms coefficients apiece.
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+
+    // The bodies sorted by leaf. Leaf l holds bodies [leafStart[l], leafStart[l + 1]).
+    std::vector<unsigned> leafOf;
+    std::vector<unsigned> leafStart;
+    std::vector<unsigned> sorted;
+};
+
+
+#endif
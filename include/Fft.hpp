@@ -0,0 +1,89 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+
+// A radix-2 fast Fourier transform for a fixed power of two size. The bit reversal
+// permutation and the twiddle factors are worked out once, when it's made.
+class Fft
+{
+public:
+    // Constructor. The size must be a power of two.
+    Fft(unsigned n=1)
+        : n{n}, reversed(n), twiddles(n / 2)
+    {
+        unsigned bits = 0;
+        while ((1u << bits) < n)
+        {
+            ++bits;
+        }
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            unsigned r = 0;
+            for (unsigned b = 0; b < bits; ++b)
+            {
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            reversed[i] = r;
+        }
+
+        for (unsigned k = 0; k < n / 2; ++k)
+        {
+            double angle = -2 * M_PI * k / n;
+            twiddles[k] = std::complex<double>(std::cos(angle), std::sin(angle));
+        }
+    }
+
+    // Transform n values in place, spaced stride apart. The inverse transform isn't
+    // divided by n.
+    void transform(std::complex<double>* data, bool inverse, unsigned stride=1) const
+    {
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (i < reversed[i])
+            {
+                std::swap(data[i * stride], data[reversed[i] * stride]);
+            }
+        }
+
+        for (unsigned len = 2; len <= n; len *= 2)
+        {
+            unsigned half = len / 2;
+            unsigned step = n / len;
+
+            for (unsigned start = 0; start < n; start += len)
+            {
+                for (unsigned k = 0; k < half; ++k)
+                {
+                    std::complex<double> w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                    std::complex<double>& a = data[(start + k) * stride];
+                    std::complex<double>& b = data[(start + k + half) * stride];
+                    std::complex<double> t = w * b;
+                    b = a - t;
+                    a += t;
+                }
+            }
+        }
+    }
+
+    // Return the number of values in a transform.
+    unsigned size() const
+    {
+        return n;
+    }
+
+
+private:
+    unsigned n;
+    std::vector<unsigned> reversed;
+    std::vector<std::complex<double>> twiddles;
+};
+
+
+#endif
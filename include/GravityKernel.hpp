@@ -0,0 +1,139 @@
+#ifndef GRAVITYKERNEL_HPP
+#define GRAVITYKERNEL_HPP
+
+
+#include <vector>
+#include "GravitySolver.hpp"
+#include "ThreadPool.hpp"
+
+
+// Computes the exact gravitational acceleration of every body due to every other
+// body. Each pair is only evaluated once, and the equal and opposite pull is
+// applied to both bodies. The bodies are processed in tiles that fit in cache.
+//
+// The inner loop comes in a scalar, an AVX2 and an AVX-512 version. The fastest one
+// the CPU supports is picked at runtime. The float build handles twice as many pairs
+// per instruction, and the mixed build widens each float to a double as it's loaded.
+class GravityKernel : public GravitySolver
+{
+public:
+    enum class Variant
+    {
+        Scalar,
+        Avx2,
+        Avx512
+    };
+
+    // Constructor. Uses the best variant this CPU supports.
+    GravityKernel();
+
+    // Compute the acceleration of every body. The results are written into ax and
+    // ay, which are resized to the number of bodies. Bodies sitting exactly on top
+    // of each other don't pull on each other.
+    //
+    // If a pool with more than one thread is given, the bodies are split between
+    // the threads. Each thread then sums whole rows, since applying the pull to both
+    // bodies of a pair would have threads writing over each other.
+    void computeAccelerations(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool=nullptr
+    ) const;
+
+    // Same as computeAccelerations. The domain doesn't matter for an exact sum.
+    void solve(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // Sum whole rows for just the targets. Rows come out bit for bit the same as
+    // in deterministic mode.
+    void solveFor(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // In deterministic mode whole rows are always summed, even on one thread, so
+    // the result is bit for bit the same for any number of threads. It does twice
+    // the work of the single threaded path.
+    void setDeterministic(bool on);
+
+    // Return true if the kernel is in deterministic mode.
+    bool isDeterministic() const;
+
+    // Choose which variant to use. Returns false, and leaves the variant alone,
+    // if the CPU doesn't support it.
+    bool setVariant(Variant v);
+
+    // Return the variant in use.
+    Variant getVariant() const;
+
+    // Return true if this CPU can run the variant.
+    static bool isSupported(Variant v);
+
+    // Return the fastest variant this CPU can run.
+    static Variant best();
+
+    // The number of bodies in a tile.
+    static constexpr unsigned TILE = 256;
+
+    // Signature of the inner loops. They add the pull of each body j in [begin, end)
+    // to the acceleration of body i. The row functions also add the opposite pull
+    // to each body j, while the gather functions leave them alone.
+    typedef void (*RowFunction)(
+        const Real* x,
+        const Real* y,
+        const Real* m,
+        Accum* ax,
+        Accum* ay,
+        unsigned i,
+        unsigned begin,
+        unsigned end,
+        double constant
+    );
+
+
+private:
+    Variant variant;
+    bool deterministic;
+    RowFunction row;
+    RowFunction gather;
+};
+
+
+// The inner loops. The vector versions must only be called if the CPU supports
+// them. Off x86 they just call the scalar ones.
+void gravityRowScalar(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+void gravityRowAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+void gravityRowAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+void gravityGatherScalar(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+void gravityGatherAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+void gravityGatherAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant);
+
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef GRAVITYSOLVER_HPP
+#define GRAVITYSOLVER_HPP
+
+
+#include <vector>
+#include "Precision.hpp"
+#include "ThreadPool.hpp"
+
+
+// Something that can work out the gravitational acceleration of a set of bodies.
+// Environment keeps one of each kind and asks whichever one is selected.
+class GravitySolver
+{
+public:
+    virtual ~GravitySolver()=default;
+
+    // Compute the acceleration of every body due to every other body, writing the
+    // results into ax and ay. The bodies are expected to be roughly within the
+    // width x height domain. Bodies with no mass are pulled but don't pull. If a
+    // pool is given, the work may be split between its threads.
+    virtual void solve(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    )=0;
+
+    // Like solve, but only compute the acceleration of the bodies listed in
+    // targets. They are still pulled by every body. The other entries of ax and ay
+    // are left alone, and both are grown to the number of bodies if they're shorter.
+    virtual void solveFor(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    )=0;
+
+    // Compare accelerations computed by a solver against exact sums for a sample of
+    // evenly spaced bodies. Returns the root mean square of the relative error.
+    static double sampleError(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double constant,
+        const std::vector<Accum>& ax,
+        const std::vector<Accum>& ay,
+        unsigned samples
+    );
+};
+
+
+#endif
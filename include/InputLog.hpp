@@ -0,0 +1,113 @@
+#ifndef INPUTLOG_HPP
+#define INPUTLOG_HPP
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Environment.hpp"
+
+
+// Records everything a user does to an environment, so a session can be replayed
+// exactly, as fast as the machine can go. Everything random in an environment comes
+// from std::rand, so a recording only needs the seed and the settings the
+// environment started with, followed by each action and the number of updates
+// before it happened. Actions are recorded as what they did to the environment
+// rather than as raw key presses and mouse clicks, so replaying doesn't need a
+// window.
+//
+// A recording is a Header followed by one Event per action, ending with an End
+// event giving the number of updates in the session. Every number is little-endian.
+// A recording that was cut short is replayed up to its last action.
+class InputLog
+{
+public:
+    // Changes whenever the format does. Recordings with another version aren't read.
+    static constexpr std::uint32_t VERSION = 1;
+
+    enum class Action : std::uint32_t
+    {
+        // Place a particle with the radius, position and velocity of the event.
+        PlaceParticle,
+        // Freeze or unfreeze the particle at the position of the event.
+        ToggleFreeze,
+        // Place an attacker at the position of the event.
+        PlaceAttacker,
+        // The session ended. Nothing happens, but the updates up to it are replayed.
+        End
+    };
+
+    struct Header
+    {
+        // "GRAVINPT".
+        char magic[8];
+        std::uint32_t version;
+        // Passed to std::srand before the environment was made.
+        std::uint32_t seed;
+        // The number of random particles the environment was made with.
+        std::uint32_t particles;
+        std::uint32_t solver;
+        std::uint32_t integrator;
+        std::uint32_t deterministic;
+        std::uint32_t threads;
+        std::uint32_t reserved;
+        double timeStep;
+    };
+
+    struct Event
+    {
+        // The number of updates before the action.
+        std::uint64_t step;
+        Action action;
+        std::uint32_t reserved;
+        double radius;
+        double x;
+        double y;
+        double vx;
+        double vy;
+    };
+
+    InputLog() = default;
+
+    // Destructor. Stops recording.
+    ~InputLog();
+
+    InputLog(const InputLog&) = delete;
+    InputLog& operator=(const InputLog&) = delete;
+
+    // Seed std::rand and make an environment the way a recording says to.
+    static Environment start(const Header& header);
+
+    // Return the header for a session that seeded std::rand with seed and then made
+    // env with a number of random particles.
+    static Header headerFor(Environment& env, std::uint32_t seed, std::uint32_t particles);
+
+    // Start recording to a file. Return false, and log why, if it couldn't be created.
+    bool record(const char* path, const Header& header);
+
+    // Write an End event after the given number of updates, and stop recording.
+    void stop(std::uint64_t steps);
+
+    // Return true if actions are being recorded.
+    bool isRecording() const;
+
+    // Record an action if recording, and do it to the environment.
+    void apply(Environment& env, const Event& event);
+
+    // Do an action to the environment without recording it.
+    static void perform(Environment& env, const Event& event);
+
+    // Do each action to the environment before the update it's numbered with, and
+    // update the environment up to the last action.
+    static void replay(Environment& env, const std::vector<Event>& events);
+
+    // Read a whole recording. Return false, and log why, if it isn't one this build
+    // can read.
+    static bool load(const char* path, Header& header, std::vector<Event>& events);
+
+private:
+    std::FILE* file = nullptr;
+};
+
+
+#endif
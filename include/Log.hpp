@@ -0,0 +1,125 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+
+// How important a log message is. Messages below GRAVSIM_LOG_LEVEL are compiled out.
+enum class LogLevel
+{
+    Trace,
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+
+// The lowest level that gets compiled in, as a number. CMake sets it from the
+// GRAVSIM_LOG_LEVEL cache variable. Otherwise release builds only keep warnings and
+// errors, and debug builds keep everything but trace messages.
+#ifndef GRAVSIM_LOG_LEVEL
+#ifdef NDEBUG
+#define GRAVSIM_LOG_LEVEL 3
+#else
+#define GRAVSIM_LOG_LEVEL 1
+#endif
+#endif
+
+
+// Log a printf style message. Messages below GRAVSIM_LOG_LEVEL never reach Log::write,
+// and their arguments are never evaluated.
+#define GRAVSIM_LOG(level, ...) \
+    do \
+    { \
+        if constexpr (static_cast<int>(level) >= GRAVSIM_LOG_LEVEL) \
+        { \
+            Log::write(level, __VA_ARGS__); \
+        } \
+    } while (false)
+
+#define LOG_TRACE(...) GRAVSIM_LOG(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) GRAVSIM_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) GRAVSIM_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) GRAVSIM_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) GRAVSIM_LOG(LogLevel::Error, __VA_ARGS__)
+
+
+// Writes log messages from a background thread, so the threads logging them never
+// wait on I/O. Messages are formatted straight into a fixed ring of records, which
+// any number of threads can add to without locking or allocating. If the ring is
+// full the message is dropped and counted instead of waiting for room.
+//
+// The background thread sleeps while the ring is empty. Only a message that finds
+// it asleep takes a lock, to wake it up.
+class Log
+{
+public:
+    // The most records the ring can hold, and the longest message a record can hold.
+    // Longer messages are cut short.
+    static constexpr unsigned CAPACITY = 1024;
+    static constexpr unsigned MESSAGE_SIZE = 120;
+
+    // Format a message and add it to the ring. The first message starts the
+    // background thread.
+    static void write(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Wait until every message written so far has been written out.
+    static void flush();
+
+    // Send messages to a different file from now on. Messages still in the ring are
+    // written out to the old file first. Messages go to stderr by default.
+    static void setOutput(std::FILE* file);
+
+    // Return the number of messages dropped because the ring was full.
+    static unsigned long long dropped();
+
+    // Return the name of a level, as it's printed before each message.
+    static const char* levelName(LogLevel level);
+
+private:
+    struct Record
+    {
+        // The position in the ring this record can be written at next, or one past
+        // it once it's been written and is waiting to be read.
+        std::atomic<unsigned long long> sequence;
+        LogLevel level;
+        char text[MESSAGE_SIZE];
+    };
+
+    Log();
+    ~Log();
+
+    // Return the one log every message goes through.
+    static Log& instance();
+
+    // Run by the background thread. Writes out records until the log is destroyed.
+    void drain();
+
+    // Write out every record that's ready, and return the number written.
+    unsigned writeReady();
+
+    // Wake the background thread if it's waiting for a message.
+    void wake();
+
+    Record records[CAPACITY];
+    // The next position to write to, and the next position to read from.
+    std::atomic<unsigned long long> head{0};
+    std::atomic<unsigned long long> tail{0};
+    std::atomic<unsigned long long> droppedCount{0};
+    std::atomic<std::FILE*> output{stderr};
+    std::atomic<bool> stop{false};
+    // Set while the background thread is waiting for a message.
+    std::atomic<bool> sleeping{false};
+    std::mutex sleepMutex;
+    std::condition_variable woken;
+    std::thread writer;
+};
+
+
+#endif
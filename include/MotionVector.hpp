@@ -3,6 +3,7 @@
 
 
 #include <cmath>
+#include "Vec2.hpp"
 
 
 template <typename CompType>
@@ -37,46 +38,48 @@ public:
     void setY(CompType newY);
 
     // Return the magnitude of this MotionVector.
-    double magnitude();
+    double magnitude() const;
 
     // Return a MotionVector pointing in the same direction, but with
     // magnitude of 1.
-    MotionVector<CompType> unit();
+    MotionVector<CompType> unit() const;
 
     // Return the angle in radians that this vector is pointing at.
-    double angle();
+    double angle() const;
 
     // Perform the dot product operation between two MotionVectors.
     template <typename OtherCompType>
-    double dotProduct(const MotionVector<OtherCompType>& other);
+    double dotProduct(const MotionVector<OtherCompType>& other) const;
 
     // Overload the addition operator to support the addition of two MotionVectors.
     // Note that both vectors must be of the same type.
     template <typename OtherCompType>
-    MotionVector<CompType> operator+(const MotionVector<OtherCompType>& other);
+    MotionVector<CompType> operator+(const MotionVector<OtherCompType>& other) const;
 
     // Overload the multiplication operator to support multiplying the components
     // of the vector by a factor.
     template <typename FacType>
-    MotionVector<CompType> operator*(FacType factor);
+    MotionVector<CompType> operator*(FacType factor) const;
+
+    // Return the components as a Vec2.
+    Vec2<CompType> vec() const;
 
 
 private:
-    CompType x_comp;
-    CompType y_comp;
+    Vec2<CompType> comps;
 };
 
 
 template <typename CompType>
 MotionVector<CompType>::MotionVector()
-    : x_comp{0}, y_comp{0}
+    : comps{}
 {
 }
 
 
 template <typename CompType>
 MotionVector<CompType>::MotionVector(CompType x, CompType y)
-    : x_comp{x}, y_comp{y}
+    : comps{x, y}
 {
 }
 
@@ -84,7 +87,7 @@ MotionVector<CompType>::MotionVector(CompType x, CompType y)
 template <typename CompType>
 template <typename OtherCompType>
 MotionVector<CompType>::MotionVector(const MotionVector<OtherCompType>& other)
-    : x_comp{other.x()}, y_comp{other.y()}
+    : comps(other.x(), other.y())
 {
 }
 
@@ -93,8 +96,7 @@ template <typename CompType>
 template <typename OtherCompType>
 MotionVector<CompType>& MotionVector<CompType>::operator=(const MotionVector<OtherCompType>& other)
 {
-    x_comp = other.x_comp;
-    y_comp = other.y_comp;
+    comps = Vec2<CompType>(other.x(), other.y());
     return *this;
 }
 
@@ -102,90 +104,82 @@ MotionVector<CompType>& MotionVector<CompType>::operator=(const MotionVector<Oth
 template <typename CompType>
 CompType MotionVector<CompType>::x() const
 {
-    return x_comp;
+    return comps.x;
 }
 
 
 template <typename CompType>
 CompType MotionVector<CompType>::y() const
 {
-    return y_comp;
+    return comps.y;
 }
 
 
 template <typename CompType>
 void MotionVector<CompType>::setX(CompType newX)
 {
-    x_comp = newX;
+    comps.x = newX;
 }
 
 
 template <typename CompType>
 void MotionVector<CompType>::setY(CompType newY)
 {
-    y_comp = newY;
+    comps.y = newY;
 }
 
 
 template <typename CompType>
-double MotionVector<CompType>::magnitude()
+double MotionVector<CompType>::magnitude() const
 {
-    return std::sqrt(std::pow(x_comp, 2) + std::pow(y_comp, 2));
+    return std::sqrt(static_cast<double>(comps.squaredNorm()));
 }
 
 
 template <typename CompType>
-MotionVector<CompType> MotionVector<CompType>::unit()
+MotionVector<CompType> MotionVector<CompType>::unit() const
 {
-    // Initialize a new MotionVector.
-    MotionVector<CompType> newMV;
-
     // Scale the x and y components to make it a unit vector.
-    newMV.setX(x_comp / magnitude());
-    newMV.setY(y_comp / magnitude());
-
-    return newMV; 
+    double mag = magnitude();
+    return MotionVector<CompType>(comps.x / mag, comps.y / mag);
 }
 
 
 template <typename CompType>
-double MotionVector<CompType>::angle()
+double MotionVector<CompType>::angle() const
 {
-    return std::atan2(y_comp, x_comp);
+    return std::atan2(comps.y, comps.x);
 }
 
 
 template <typename CompType>
 template <typename OtherCompType>
-double MotionVector<CompType>::dotProduct(const MotionVector<OtherCompType>& other)
+double MotionVector<CompType>::dotProduct(const MotionVector<OtherCompType>& other) const
 {
-    return (x_comp * other.x()) + (y_comp * other.y());
+    return (comps.x * other.x()) + (comps.y * other.y());
 }
 
 
 template <typename CompType>
 template <typename OtherCompType>
-MotionVector<CompType> MotionVector<CompType>::operator+(const MotionVector<OtherCompType>& other)
+MotionVector<CompType> MotionVector<CompType>::operator+(const MotionVector<OtherCompType>& other) const
 {
-    MotionVector<CompType> newMV;
-
-    newMV.setX(x_comp + other.x());
-    newMV.setY(y_comp + other.y());
-
-    return newMV;
+    return MotionVector<CompType>(comps.x + other.x(), comps.y + other.y());
 }
 
 
 template <typename CompType>
 template <typename FacType>
-MotionVector<CompType> MotionVector<CompType>::operator*(FacType factor)
+MotionVector<CompType> MotionVector<CompType>::operator*(FacType factor) const
 {
-    MotionVector<CompType> newMV;
+    return MotionVector<CompType>(comps.x * factor, comps.y * factor);
+}
 
-    newMV.setX(x_comp * factor);
-    newMV.setY(y_comp * factor);
 
-    return newMV;
+template <typename CompType>
+Vec2<CompType> MotionVector<CompType>::vec() const
+{
+    return comps;
 }
 
 
@@ -3,10 +3,9 @@
 
 
 #include <iostream>
-#include <list>
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_ttf.h>
+#include "Color.hpp"
 #include "MotionVector.hpp"
+#include "Vec2.hpp"
 #include "EnvConstants.hpp"
 
 
@@ -18,35 +17,32 @@ public:
         double x,
         double y,
         MotionVector<double> vec,
-        SDL_Color col=SDL_Color{255, 255, 255},
+        Color col=Color{255, 255, 255},
         bool gravity=true,
         double density=5500
     );
 
-    virtual ~Particle()=default;
-
     // Return the x coordinate of this particle.
     double x();
 
     // Return the y coordinate of this particle.
     double y();
 
-    // Move and accelerate towards other particles.
-    virtual void update(std::list<Particle*>& particles);
-    
-    // Move the particle based on its vector's direction and speed.
-    virtual void move();
+    // Move the particle based on its vector's direction and speed, for dt seconds.
+    void move(double dt=TIME_STEP);
+
+    // Accelrate this particle towards a point for dt seconds.
+    void accelerateTowards(double x, double y, double constant, double pointMass=1, double dt=TIME_STEP);
 
-    // Accelrate this particle towards a point.
-    void accelerateTowards(double x, double y, double constant, double pointMass=1);
+    // Return the change in velocity over dt seconds of a particle pulled towards a
+    // point mass that is dx, dy away from it.
+    static void pullTowards(double dx, double dy, double constant, double pointMass, double& dvx, double& dvy,
+        double dt=TIME_STEP);
 
     // Collide with another particle, coalescing into a larger particle. An elasticity
     // constant simulates the loss of energy after collision.
     void coalesce(Particle& p2, double constant);
 
-    // Explode this particle.
-    void explode(std::list<Particle*>& particles);
-
     // Return the distance from this particle's center to a point.
     double distanceFrom(double x, double y);
 
@@ -80,15 +76,21 @@ public:
     // Return the mass of this particle.
     double getMass();
 
+    // Return the density of this particle.
+    double getDensity();
+
     // Change the mass of this particle by a set amount.
     void changeMass(double amount);
 
     // Return the motion vector that represents the velocity of this particle.
     MotionVector<double> getVelocity();
 
-    // Return an SDL_Color struct representing the r, g, and b values of this particle's color.
+    // Return the r, g, and b values of this particle's color.
     // The color starts off as white and turns orange if the particle is low mass.
-    virtual SDL_Color getColor();
+    Color getColor();
+
+    // Return the color of a particle that started out with a different mass.
+    static Color colorFor(double mass, double oriMass, Color col);
 
     // Simulate the effect of elasticity by applying a force to the particle's
     // motion vector. The elasticity constant is defined by the environment.
@@ -96,21 +98,18 @@ public:
 
 
 
-// The protected keyword acts like private, but now derived classes
-// can modify these member variables directly.
-protected:
+private:
     double rad;
     double oriRad;
-    double x_pos;
-    double y_pos;
+    Vec2<double> pos;
     double mass;
     double oriMass;
-    MotionVector<double> vec;
+    Vec2<double> vel;
     double density;
     bool absorbed;
     bool fixed;
     bool hasGrav;
-    SDL_Color color;
+    Color color;
 };
 
 
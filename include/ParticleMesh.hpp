@@ -0,0 +1,150 @@
+#ifndef PARTICLEMESH_HPP
+#define PARTICLEMESH_HPP
+
+
+#include <complex>
+#include <vector>
+#include "Fft.hpp"
+#include "GravitySolver.hpp"
+#include "ThreadPool.hpp"
+
+
+// A particle-mesh solver. Mass is spread onto a square grid with cloud-in-cell
+// weights, the potential is found by convolving the grid with the pull of a point
+// mass using FFTs, and the force is differenced from the potential and
+// interpolated back onto each body. The grid is padded to twice its size, so
+// bodies on opposite edges don't pull on each other through the boundary.
+//
+// The grid only carries the part of the pull that varies smoothly over a few
+// cells. With the short range correction on, the rest is summed directly between
+// nearby bodies (P3M). With it off, the pull of close bodies is softened.
+class ParticleMesh : public GravitySolver
+{
+public:
+    // Constructor. The number of cells along each side must be a power of two.
+    ParticleMesh(unsigned cells=256, bool shortRange=true);
+
+    // Compute the acceleration of every body. The grid always covers the
+    // width x height domain, and grows to include any bodies outside of it.
+    void solve(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // The whole grid is still solved, but only the targets are interpolated and
+    // corrected.
+    void solveFor(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // Turn the short range correction on or off.
+    void setShortRange(bool on);
+
+    // Return true if the short range correction is on.
+    bool hasShortRange() const;
+
+    // Return the number of cells along each side of the grid.
+    unsigned getCells() const;
+
+    // The grid carries erf(r / SPLIT) / r of the pull, with r in cells.
+    static constexpr double SPLIT = 2.0;
+
+    // The rest is only summed out to CUTOFF * SPLIT cells, where it has died away.
+    static constexpr double CUTOFF = 4.5;
+
+
+private:
+    // Shared by solve and solveFor. With no targets, every body is a target.
+    void run(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>* targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    );
+
+    // Spread the mass of each body over the four nearest grid points.
+    void deposit(const std::vector<Real>& xs, const std::vector<Real>& ys, const std::vector<Real>& masses);
+
+    // Transform every row and then every column of the padded grid.
+    void transform(std::vector<std::complex<double>>& data, bool inverse, ThreadPool* pool);
+
+    // Turn the mass on the grid into the gradient of the potential at each grid point.
+    void solveGrid(ThreadPool* pool);
+
+    // Sort the bodies into cells at least as wide as the short range cutoff.
+    void buildChains(const std::vector<Real>& xs, const std::vector<Real>& ys);
+
+    // Return the acceleration of body i, divided by the gravitational constant.
+    void accelerationOf(
+        unsigned i,
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double& ax,
+        double& ay
+    ) const;
+
+    // Return the grid coordinate of a position along one axis, and the weight of
+    // the grid point after it.
+    void locate(double v, double origin, unsigned& cell, double& weight) const;
+
+    unsigned cells;
+    bool shortRange;
+
+    // Transforms along one side of the padded grid.
+    Fft fft;
+
+    // Position of the first grid point, and the spacing between grid points.
+    double x0;
+    double y0;
+    double spacing;
+
+    // The transform of the pull of a unit mass, for a grid spacing of 1.
+    std::vector<std::complex<double>> green;
+
+    // The padded grid, holding mass and then potential.
+    std::vector<std::complex<double>> grid;
+
+    // A column of the grid for each thread, copied out to be transformed.
+    std::vector<std::complex<double>> columnBuffer;
+
+    // Gradient of the potential at each grid point.
+    std::vector<double> gradX;
+    std::vector<double> gradY;
+
+    // The short range pull, relative to the full pull, tabulated against the
+    // squared distance in units of SPLIT cells.
+    std::vector<double> correction;
+
+    // The bodies sorted into chaining cells. Cell c holds [chainStart[c], chainStart[c + 1]).
+    unsigned chainDim;
+    double chainSize;
+    std::vector<unsigned> chainOf;
+    std::vector<unsigned> chainStart;
+    std::vector<unsigned> chained;
+};
+
+
+#endif
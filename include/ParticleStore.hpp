@@ -0,0 +1,152 @@
+#ifndef PARTICLESTORE_HPP
+#define PARTICLESTORE_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include "EnvConstants.hpp"
+#include "Precision.hpp"
+
+
+// Contiguous storage for every particle in an environment. Each property lives in
+// its own array, so loops that only touch positions or velocities stream through
+// memory instead of hopping between heap allocated objects.
+//
+// Particles are addressed by index, which changes as particles are removed, or by
+// ID, which stays the same for as long as the particle exists. An ID is a slot
+// number plus the generation of that slot. When a particle is removed its slot's
+// generation goes up, and the slot is handed out again later. An old ID still
+// names the old generation, so it can never be mistaken for the new particle.
+// IDs are 64 bits, half slot and half generation, so the number of particles is
+// only limited by memory.
+class ParticleStore
+{
+public:
+    // Bits stored in the flags array.
+    enum Flag : std::uint8_t
+    {
+        // The particle pulls on, and is pulled by, other particles.
+        GRAVITY = 1,
+        // The particle is held in place.
+        FROZEN = 2,
+        // The particle has been absorbed or destroyed, and will be removed.
+        DEAD = 4,
+        // The particle is the body of an attacker.
+        ATTACKER = 8
+    };
+
+    // The ID of a particle.
+    typedef std::uint64_t Id;
+
+    // Returned in place of an index that doesn't exist.
+    static constexpr unsigned NONE = ~0u;
+
+    // Returned in place of an ID that doesn't exist.
+    static constexpr Id NO_ID = ~Id(0);
+
+    // The low SLOT_BITS bits of an ID are its slot, and the rest are the generation.
+    static constexpr unsigned SLOT_BITS = 32;
+
+    // Add a particle and return its ID. Returns NO_ID, and logs an error, if all
+    // 2^SLOT_BITS - 1 slots are in use.
+    Id add(
+        double radius,
+        double x,
+        double y,
+        double vx,
+        double vy,
+        double density,
+        std::uint8_t flags
+    );
+
+    // Return the number of particles.
+    unsigned size() const;
+
+    // Return true if there are no particles.
+    bool empty() const;
+
+    // Make room for n particles without reallocating.
+    void reserve(unsigned n);
+
+    // Remove every particle.
+    void clear();
+
+    // Remove the particle at index i by moving the last particle into its place.
+    void remove(unsigned i);
+
+    // Remove every particle flagged as DEAD. Particles only ever move to a lower
+    // index, but they don't keep their relative order.
+    void removeDead();
+
+    // Return the index of the particle with this ID, or NONE if it has been removed.
+    unsigned indexOf(Id id) const;
+
+    // Return the ID of the particle at index i.
+    Id idAt(unsigned i) const;
+
+    // Return true if the particle at index i has the flag set.
+    bool hasFlag(unsigned i, Flag f) const;
+
+    // Set or clear a flag on the particle at index i.
+    void setFlag(unsigned i, Flag f);
+    void clearFlag(unsigned i, Flag f);
+
+    // Move particle i based on its velocity, for dt seconds.
+    void move(unsigned i, double dt=TIME_STEP);
+
+    // Accelerate particle i towards a point for dt seconds. This is the same
+    // calculation as Particle::accelerateTowards.
+    void accelerateTowards(unsigned i, double x, double y, double constant, double pointMass=1, double dt=TIME_STEP);
+
+    // Merge particles i and j if they are colliding. The lighter one is absorbed
+    // into the heavier one and flagged as DEAD. Return true if they merged.
+    bool coalesce(unsigned i, unsigned j, double constant);
+
+    // Return the distance from the center of particle i to a point.
+    double distanceFrom(unsigned i, double x, double y) const;
+
+    // Return true if particles i and j are colliding.
+    bool isColliding(unsigned i, unsigned j) const;
+
+    // Freeze particle i in place, or let it move again.
+    void freeze(unsigned i);
+    void unFreeze(unsigned i);
+
+    // Per particle data, indexed by position in the store. See Precision.hpp for
+    // what Real is.
+    std::vector<Real> x;
+    std::vector<Real> y;
+    std::vector<Real> vx;
+    std::vector<Real> vy;
+    std::vector<Real> mass;
+    std::vector<Real> radius;
+    std::vector<Real> density;
+    // Mass and radius the particle was created with.
+    std::vector<Real> oriMass;
+    std::vector<Real> oriRad;
+    std::vector<std::uint8_t> flags;
+
+
+private:
+    // Snapshots save and restore the IDs too.
+    friend class Snapshot;
+
+    static constexpr Id SLOT_MASK = (Id(1) << SLOT_BITS) - 1;
+    static constexpr std::uint32_t MAX_GENERATION = ~std::uint32_t(0);
+
+    // Free the slot of a removed particle, so it can be handed out again.
+    void release(Id id);
+
+    // ID of the particle at each index.
+    std::vector<Id> ids;
+    // Index of the particle in each slot, or NONE if the slot is free.
+    std::vector<unsigned> slots;
+    // Current generation of each slot.
+    std::vector<std::uint32_t> generations;
+    // Slots that can be handed out again. A slot that has been through every
+    // generation is retired instead, so IDs are never repeated.
+    std::vector<unsigned> freeSlots;
+};
+
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef PRECISION_HPP
+#define PRECISION_HPP
+
+
+// The floating point types the simulation is built with. Particles are stored as
+// Real, and accelerations are summed and stored as Accum. The build picks one of
+// three modes:
+//
+// - By default both are double.
+// - With GRAVSIM_FLOAT both are float. This halves the memory every frame streams
+//   through and doubles the number of pairs each SIMD instruction handles, at the
+//   cost of accuracy.
+// - With GRAVSIM_MIXED particles are stored as float but forces are worked out and
+//   summed in double, so long sums don't lose precision.
+#if defined(GRAVSIM_FLOAT) && defined(GRAVSIM_MIXED)
+#error "Define at most one of GRAVSIM_FLOAT and GRAVSIM_MIXED."
+#elif defined(GRAVSIM_FLOAT)
+typedef float Real;
+typedef float Accum;
+#define GRAVSIM_PRECISION_NAME "float"
+#elif defined(GRAVSIM_MIXED)
+typedef float Real;
+typedef double Accum;
+#define GRAVSIM_PRECISION_NAME "mixed"
+#else
+typedef double Real;
+typedef double Accum;
+#define GRAVSIM_PRECISION_NAME "double"
+#endif
+
+
+#endif
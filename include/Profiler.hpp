@@ -0,0 +1,113 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+
+#include <chrono>
+#include <cstdio>
+
+
+// Times the phases of each frame, and keeps the times of the last few frames so
+// slow frames can be traced back to the phase they spent their time in. Phases can
+// be nested, and each phase is only charged for the time spent in it and not in the
+// phases inside it, so the phases of a frame add up to the time spent in all of them.
+class Profiler
+{
+public:
+    // The parts of a frame that are timed.
+    enum class Phase
+    {
+        // Computing gravity and moving particles.
+        Forces,
+        // Coalescing colliding particles.
+        Merges,
+        // Breaking particles with no mass left into fragments.
+        Explosions,
+        // Finding and removing dead particles.
+        Removal,
+        // Drawing particles and effects.
+        Circles,
+        // Drawing text.
+        Text,
+        // Handing the frame to the screen.
+        Present,
+        // Not a phase, just the number of them.
+        Count
+    };
+
+    static constexpr unsigned PHASES = static_cast<unsigned>(Phase::Count);
+    // The number of frames the statistics are taken over.
+    static constexpr unsigned WINDOW = 120;
+
+    // The time spent in a phase over the last WINDOW frames, in milliseconds.
+    struct Stats
+    {
+        double min;
+        double avg;
+        double p99;
+    };
+
+    // Times a phase for as long as it exists.
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, Phase phase);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& profiler;
+        Phase outer;
+    };
+
+    // Charge some time to a phase in the current frame.
+    void add(Phase phase, std::chrono::nanoseconds time);
+
+    // Finish the current frame. Its times are added to the statistics, and written
+    // to the CSV file if there is one.
+    void endFrame();
+
+    // Return the statistics for a phase over the last WINDOW frames.
+    Stats stats(Phase phase) const;
+
+    // Return the time spent in a phase in the last finished frame, in milliseconds.
+    double last(Phase phase) const;
+
+    // Return the number of frames finished so far.
+    unsigned long long frames() const;
+
+    // Write one line for every finished frame to a file, with the time of each phase
+    // in milliseconds. A header line is written straight away. Pass nullptr to stop.
+    void setCsv(std::FILE* file);
+
+    // Turn timing on or off. Scopes don't read the clock while it's off.
+    void setEnabled(bool on);
+
+    // Return the name of a phase, as it's used in the CSV header.
+    static const char* phaseName(Phase phase);
+
+private:
+    // Start timing a phase inside whatever phase is running, and return that phase.
+    Phase begin(Phase phase);
+
+    // Stop timing the running phase and go back to timing the outer one.
+    void end(Phase outer);
+
+    bool enabled = true;
+    // The phase being timed, or Phase::Count if there isn't one, and when it was
+    // last charged for.
+    Phase running = Phase::Count;
+    std::chrono::steady_clock::time_point since;
+
+    // Time spent in each phase in the current frame.
+    std::chrono::nanoseconds current[PHASES] = {};
+    // A ring of the times of the last WINDOW frames.
+    double history[PHASES][WINDOW] = {};
+    unsigned long long finished = 0;
+
+    std::FILE* csv = nullptr;
+};
+
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef QUADTREE_HPP
+#define QUADTREE_HPP
+
+
+#include <vector>
+#include "GravitySolver.hpp"
+#include "ThreadPool.hpp"
+
+
+// A Barnes-Hut quadtree. It is rebuilt every frame from the positions and masses
+// of the bodies, and approximates the pull of any sufficiently distant group of
+// bodies by the pull of their combined mass at their center of mass.
+class QuadTree : public GravitySolver
+{
+public:
+    // Constructor. The opening angle decides how far away a group of bodies must be
+    // before it is treated as a single body. An angle of 0 gives the exact sum.
+    QuadTree(double theta=0.5);
+
+    // Rebuild the tree over the given bodies. The tree always covers the
+    // width x height domain, and grows to include any bodies outside of it.
+    void build(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height
+    );
+
+    // Compute the acceleration of every body the tree was built from. The results
+    // are written into ax and ay, which are resized to the number of bodies. If a
+    // pool is given, the bodies are split between its threads.
+    void computeAccelerations(
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool=nullptr
+    ) const;
+
+    // Build the tree and compute every acceleration in one go.
+    void solve(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // Build the tree and compute the acceleration of the targets.
+    void solveFor(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& masses,
+        const std::vector<unsigned>& targets,
+        double width,
+        double height,
+        double constant,
+        std::vector<Accum>& ax,
+        std::vector<Accum>& ay,
+        ThreadPool* pool
+    ) override;
+
+    // Compute the acceleration felt at a point. Bodies sitting exactly on the point
+    // are ignored, so a body never attracts itself.
+    void accelerationAt(double x, double y, double constant, Accum& ax, Accum& ay) const;
+
+    // Set the opening angle used by future acceleration queries.
+    void setOpeningAngle(double theta);
+
+    // Return the opening angle.
+    double openingAngle() const;
+
+    // Return the number of nodes in the tree.
+    unsigned size() const;
+
+
+private:
+    struct Node
+    {
+        // Lower left corner and side length of the square this node covers.
+        double x0;
+        double y0;
+        double side;
+
+        // Total mass and center of mass of the bodies inside this node.
+        double mass;
+        double comX;
+        double comY;
+
+        // Index of the first of four consecutive children, or -1 for a leaf.
+        int child;
+
+        // Index of the first body in this leaf, or -1 if it is empty.
+        int body;
+    };
+
+    // Insert body i into the tree.
+    void insert(int i);
+
+    // Split leaf n into four children.
+    void subdivide(int n);
+
+    // Return the index of the child of node n that contains the point.
+    int childFor(int n, double x, double y) const;
+
+    double theta;
+    std::vector<Node> nodes;
+
+    // Bodies that end up in the same leaf at the maximum depth are chained together.
+    std::vector<int> next;
+
+    // Copies of the positions and masses the tree was last built from.
+    std::vector<Real> bodyX;
+    std::vector<Real> bodyY;
+    std::vector<Real> bodyMass;
+
+    // Leaves at this depth are never split, so bodies on top of each other
+    // can't make the tree infinitely deep.
+    static constexpr int MAX_DEPTH = 48;
+};
+
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef RENDERFRAME_HPP
+#define RENDERFRAME_HPP
+
+
+#include <vector>
+#include "Color.hpp"
+#include "Environment.hpp"
+#include "Precision.hpp"
+#include "Profiler.hpp"
+#include "SpatialGrid.hpp"
+
+
+// Everything the window needs to draw one frame of an environment, copied out of it
+// so the window can draw while the simulation carries on updating. Frames are handed
+// from the simulation thread to the window through a TripleBuffer, and reuse their
+// memory from one frame to the next.
+//
+// Each frame has a grid of its particles, built on the simulation thread along with
+// the rest of the frame, so the window can find the ones in view without looking at
+// every particle.
+class RenderFrame
+{
+public:
+    // An attacker firing at a particle.
+    struct Laser
+    {
+        float ax;
+        float ay;
+        float tx;
+        float ty;
+        int strength;
+    };
+
+    // Copy the particles, lasers and profiler statistics of the environment, after
+    // the given number of updates, and build the grid.
+    void capture(Environment& env, unsigned long long updates);
+
+    // Replace the contents of out with the index of every particle that overlaps
+    // the rectangle.
+    void visible(double left, double top, double right, double bottom, std::vector<unsigned>& out) const;
+
+    // Return the number of particles.
+    unsigned size() const;
+
+    // Return the index of the particle with an ID, or ParticleStore::NONE if it isn't
+    // in this frame.
+    unsigned indexOf(ParticleStore::Id id) const;
+
+    // Return the ID of a particle covering a point, or ParticleStore::NO_ID if there
+    // isn't one. Works like Environment::findParticle.
+    ParticleStore::Id findParticle(double x, double y) const;
+
+    // The particles, in the same order as in the environment.
+    std::vector<Real> x;
+    std::vector<Real> y;
+    std::vector<Real> radius;
+    std::vector<Color> color;
+    std::vector<ParticleStore::Id> ids;
+
+    std::vector<Laser> lasers;
+
+    // The environment's profiler statistics for each phase.
+    Profiler::Stats phases[Profiler::PHASES];
+
+    unsigned long long updates = 0;
+    double time = 0;
+
+private:
+    SpatialGrid grid;
+};
+
+
+#endif
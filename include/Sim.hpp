@@ -2,8 +2,12 @@
 #define SIM_HPP
 
 
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <list>
+#include <mutex>
+#include <thread>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <vector>
@@ -11,6 +15,13 @@
 #include "Particle.hpp"
 #include "Attacker.hpp"
 #include "Environment.hpp"
+#include "InputLog.hpp"
+#include "CircleBatch.hpp"
+#include "TextBatch.hpp"
+#include "Camera.hpp"
+#include "DensityMap.hpp"
+#include "RenderFrame.hpp"
+#include "TripleBuffer.hpp"
 
 
 class Sim
@@ -24,54 +35,121 @@ public:
     // Destructor.
     ~Sim();
 
-    // Runs an SDL game loop.
+    // Record everything the user does from the start of the session to a file, so
+    // it can be replayed with the headless runner. Call before run.
+    bool record(const char* path);
+
+    // Runs an SDL game loop. The environment is updated on a thread of its own, so
+    // drawing never holds up the simulation and the simulation never holds up
+    // drawing. Everything the user does is sent to that thread as a Command, and it
+    // publishes a RenderFrame for the window to draw whenever it has updated.
     int run();
 
     
 
 private:
+    // Something for the simulation thread to do to the environment.
+    struct Command
+    {
+        enum class Type
+        {
+            // Apply event through the input log. Its step is filled in when it's
+            // applied.
+            Input,
+            // Place a particle of event's radius at event's position, in orbit
+            // around the particle with ID center.
+            PlaceOrbit,
+            SaveSnapshot,
+            LoadSnapshot
+        };
+
+        Type type;
+        InputLog::Event event;
+        ParticleStore::Id center;
+    };
+
     // Return true if SDL video elements are initialized successfully.
     bool Init();
 
+    // Render every glyph of the font into the atlas texture, once. The font is
+    // grav.ttf next to the executable, unless GRAVSIM_FONT names another one. Return
+    // false, and log why, if there's no font, in which case no text is drawn.
+    bool loadFont();
+
     // Handle any SDL_Event.
     void handleEvent(SDL_Event* Event);
 
     // Draw an SDL circle at the given x and y coordinates, with a 
     // specified radius and opacity.
-    void drawSDLCircle(double x, double y, double radius, bool filled, SDL_Color color);
+    void drawSDLCircle(double x, double y, double radius, bool filled, Color color);
 
     // Given points xc and yc for the center of a circle, and points x y
     // on the edge of the circle, draw the corresponding points in all 8 octants,
     // and lines between them.
     void drawCirclePixels(double xc, double yc, double x, double y, bool filled);
 
-    // Draw all the particles to the screen.
-    void drawParticles();
+    // Draw the particles of a frame that are in view. Particles smaller than
+    // MIN_CIRCLE_RADIUS on screen are added up a pixel at a time instead of being
+    // drawn as circles.
+    void drawParticles(const RenderFrame& frame);
 
-    // Draw effects for particles that have them.
-    void drawParticleEffects(Particle* p);
+    // Draw every circle in the batch with one call. Return false if the renderer
+    // can't draw triangles.
+    bool drawBatch();
+
+    // Draw the laser of an attacker.
+    void drawParticleEffects(const RenderFrame::Laser& laser);
 
     // Draw a laser depending on how powerful it is.
     void drawAttackerLaser(int tier, double angle, double ax, double ay, double tx, double ty);
 
-    // Draw the screen.
-    void drawScreen();
+    // Draw a frame to the screen.
+    void drawScreen(const RenderFrame& frame);
+
+    // Queue the profilers' statistics for each phase to be drawn in the corner.
+    void addProfilerText(const RenderFrame& frame);
 
     // Queue some text to be drawn.
     void addText(std::string text, int x, int y);
 
-    // Draw text to the screen at specified coordinates.
-    void drawText(const char* text, int x, int y) const;
+    // Draw all the queued text with one call, and empty the queue.
+    void drawText();
 
     // Generate a random Particle.
     Particle genParticle();
+
+    // Queue a command for the simulation thread.
+    void send(const Command& command);
+
+    // Run by the simulation thread. Carry out commands, keep the environment
+    // updated in step with real time, and publish frames, until the window closes.
+    void simulate();
+
+    // Carry out a command on the simulation thread.
+    void perform(const Command& command);
     
     SDL_Window* win;
     SDL_Surface* winSurface;
     SDL_Renderer* ren;
     Environment env;
 
-    bool running;
+    // Cleared when the window closes, which stops both threads.
+    std::atomic<bool> running;
+
+    // The thread updating the environment. Only it touches env, input and updates
+    // while the window is open.
+    std::thread simulation;
+
+    // Commands waiting for the simulation thread, guarded by commandLock.
+    std::mutex commandLock;
+    std::vector<Command> commands;
+
+    // Frames from the simulation thread to the window.
+    TripleBuffer<RenderFrame> frames;
+
+    // Times the drawing phases. The environment's own profiler belongs to the
+    // simulation thread, so its statistics come with each frame.
+    Profiler renderProfiler;
 
     // For ghost particles.
       struct Text
@@ -88,12 +166,56 @@ private:
     int fontSize;
     std::list<Text> texts; // List of items to print.
 
-    // For freezing particles.
-    Particle* frozenP;
+    // The seed std::rand was given before the environment was made, the number of
+    // random particles it was made with, and the number of updates so far. These are
+    // what a recording needs to start the session over.
+    std::uint32_t seed;
+    unsigned initialParticles;
+    unsigned long long updates;
+    // Everything the user does to the environment goes through here.
+    InputLog input;
+
+    // What part of the environment is in the window. The arrow keys and dragging
+    // with the middle button pan, the mouse wheel zooms, and 0 goes back to the
+    // start. While a particle is being placed the wheel changes its size instead.
+    Camera camera;
+    bool panning;
+
+    // The particles in view this frame, and the ones among them too small to draw
+    // as circles.
+    std::vector<unsigned> inView;
+    DensityMap density;
+
+    // Every particle to be drawn this frame.
+    CircleBatch circles;
+    // Set once SDL_RenderGeometry has failed, so it isn't tried again.
+    bool geometryFailed;
+
+    // Every glyph of the font, and the text to be drawn from it this frame.
+    SDL_Texture* glyphAtlas;
+    TextBatch textBatch;
+
+    // Whether the profiler's statistics are drawn. Toggled with P.
+    bool showProfiler;
 
     // For choosing orbit particles.
-    Particle* orbitCenter;
+    ParticleStore::Id orbitCenter;
     bool choosingOrbit;
+
+    // The most real time, in seconds, the simulation thread may spend catching up
+    // before it publishes a frame.
+    static constexpr double PHYSICS_BUDGET = 1.0 / 30.0;
+
+    // The shortest time, in seconds, between frames drawn by the window.
+    static constexpr double FRAME_INTERVAL = 1.0 / 60.0;
+
+    // The smallest radius, in pixels, a particle is drawn as a circle with.
+    static constexpr double MIN_CIRCLE_RADIUS = 1;
+
+    // How much one turn of the mouse wheel zooms, and how many pixels one press of
+    // an arrow key pans.
+    static constexpr double ZOOM_STEP = 1.25;
+    static constexpr double PAN_STEP = 50;
 };
 
 
@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+#include "Environment.hpp"
+
+
+// Saves and restores the whole state of an environment: every particle, the IDs
+// handed out so far, the attackers, the dimensions and the simulation time.
+//
+// A snapshot is a fixed size header followed by one section per array, in the same
+// layout the arrays have in memory, so loading one is a matter of mapping the file
+// and copying each section over in bulk. Every number is little-endian, and each
+// section starts on a multiple of SECTION_ALIGNMENT bytes. Particles are stored with
+// the precision they were saved with, and converted if they're loaded by a build
+// with a different precision.
+//
+// The arrays aren't used in place from the mapping. ParticleStore keeps its arrays
+// in vectors that own their memory, so each section is copied into its vector once,
+// with no parsing per particle. Loading therefore takes one pass over the file and
+// needs the memory for the particles on top of the mapping while it runs, which is
+// about 90 bytes per particle in a double build.
+//
+// The sections, in order, are:
+//     x, y, vx, vy, mass, radius, density, oriMass, oriRad   one Real per particle
+//     flags                                                  one byte per particle
+//     ids                                                    uint64 per particle
+//     slots, generations                                     uint32 per slot
+//     freeSlots                                              uint32 per free slot
+//     attackers                                              one AttackerRecord each
+class Snapshot
+{
+public:
+    // Changes whenever the layout does. Snapshots with another version aren't loaded.
+    static constexpr std::uint32_t VERSION = 2;
+
+    static constexpr std::size_t SECTION_ALIGNMENT = 64;
+
+    struct Header
+    {
+        // "GRAVSNAP".
+        char magic[8];
+        std::uint32_t version;
+        // The size of each stored Real, 4 or 8.
+        std::uint32_t realBytes;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint64_t particles;
+        std::uint64_t slots;
+        std::uint64_t freeSlots;
+        std::uint64_t attackers;
+        // Seconds simulated so far, and the length of each update.
+        double time;
+        double timeStep;
+    };
+
+    struct AttackerRecord
+    {
+        std::uint64_t body;
+        std::uint64_t target;
+        double weaponStrength;
+        double headingX;
+        double headingY;
+        std::int32_t lifespan;
+        std::int32_t range;
+    };
+
+    // Write the environment to a file. Return false, and log why, if it couldn't
+    // be written.
+    static bool save(const Environment& env, const char* path);
+
+    // Replace the environment with the one saved in a file. Return false, and log
+    // why, if the file isn't a snapshot this build can read. The environment is
+    // left alone if loading fails.
+    static bool load(Environment& env, const char* path);
+
+private:
+    // Where each section starts in the file, and where the file ends.
+    struct Layout
+    {
+        std::size_t reals[9];
+        std::size_t flags;
+        std::size_t ids;
+        std::size_t slots;
+        std::size_t generations;
+        std::size_t freeSlots;
+        std::size_t attackers;
+        std::size_t end;
+    };
+
+    // Return where each section of a snapshot with this header goes.
+    static Layout layoutFor(const Header& header);
+};
+
+
+#endif
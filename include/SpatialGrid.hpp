@@ -0,0 +1,108 @@
+#ifndef SPATIALGRID_HPP
+#define SPATIALGRID_HPP
+
+
+#include <cstdint>
+#include <vector>
+#include "Precision.hpp"
+
+
+// A uniform grid over the plane, used to find particles that are near each other
+// without checking every pair. Cells are twice as wide as a typical particle, so
+// two particles can only touch if they're in the same cell or in neighbouring
+// cells. Cells are hashed into a table, so the grid doesn't need to know how big
+// the environment is.
+//
+// Circles too wide for a cell are kept in a separate list of big circles instead,
+// so one huge body doesn't make every cell huge. Every big circle is a candidate
+// for every other circle, which is cheap as long as there are only a few of them.
+//
+// The grid is rebuilt from scratch every time rather than updated, since every
+// particle moves every frame and most change cell often enough that an update
+// would touch most of the table anyway. A rebuild is two passes over the circles.
+class SpatialGrid
+{
+public:
+    // A circle is big if its radius is more than BIG_RADIUS times the mean radius,
+    // and it doesn't fit in a cell. Cells are only as wide as the widest circle
+    // that isn't big, or the minimum size they're given.
+    static constexpr double BIG_RADIUS = 4;
+
+    SpatialGrid();
+
+    // Rebuild the grid over the given circles. The buffers from the last build are
+    // reused, so rebuilding every frame doesn't allocate once they're big enough.
+    // Cells can be made wider than they need to be, so a query over a large area
+    // doesn't have to walk through lots of empty cells.
+    void build(
+        const std::vector<Real>& xs,
+        const std::vector<Real>& ys,
+        const std::vector<Real>& radii,
+        double minCellSize=0
+    );
+
+    // Append to out the index of every circle after i that shares or neighbours
+    // circle i's cell. Each pair is only reported once, by its lower index. The
+    // candidates still have to be checked to see if they really touch.
+    void candidatesFor(unsigned i, std::vector<unsigned>& out) const;
+
+    // Append to out the index of every circle in a cell that touches the rectangle,
+    // or neighbours one that does, which takes in every circle that overlaps it.
+    // The candidates still have to be checked to see if they really overlap it. When
+    // the rectangle covers more cells than there are circles, every circle is
+    // checked instead of every cell.
+    void query(double left, double top, double right, double bottom, std::vector<unsigned>& out) const;
+
+    // Return the most candidates candidatesFor can append for any circle.
+    unsigned maxCandidates() const;
+
+    // Return the width of a cell.
+    double getCellSize() const;
+
+    // Return the number of circles in the grid, and how many of them are big.
+    unsigned size() const;
+    unsigned bigCount() const;
+
+
+private:
+    struct Big
+    {
+        unsigned index;
+        double x;
+        double y;
+        double radius;
+    };
+
+    // Call visit with every circle that isn't big, from index first on, in a cell
+    // that touches the rectangle or neighbours one that does.
+    template <typename Visit>
+    void forEachSmallIn(double left, double top, double right, double bottom, unsigned first, Visit visit) const;
+
+    // Return the cell coordinate along one axis.
+    std::int64_t cellCoord(double v) const;
+
+    // Return the bucket a cell hashes to.
+    unsigned bucketFor(std::int64_t cx, std::int64_t cy) const;
+
+    double cellSize;
+
+    // Cell coordinates of each circle.
+    std::vector<std::int64_t> cellX;
+    std::vector<std::int64_t> cellY;
+
+    // The circles sorted by bucket. Bucket b holds entries [start[b], start[b + 1]),
+    // in increasing order of index. The big circles go in one more bucket after the
+    // last one a cell can hash to, and big holds them in the same order.
+    std::vector<unsigned> start;
+    std::vector<unsigned> entries;
+    std::vector<unsigned> bucketOf;
+    std::vector<Big> big;
+    unsigned mask;
+    // Number of circles in the fullest bucket, and the most circles that aren't big
+    // any big circle has as candidates.
+    unsigned largestBucket;
+    unsigned largestReach;
+};
+
+
+#endif
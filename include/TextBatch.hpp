@@ -0,0 +1,93 @@
+#ifndef TEXTBATCH_HPP
+#define TEXTBATCH_HPP
+
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CircleBatch.hpp"
+#include "Color.hpp"
+
+
+// Collects the text for a frame into one list of textured quads, so it can all be
+// drawn with a single call to SDL_RenderGeometry from one atlas texture holding
+// every glyph of the font. The batch only knows where each glyph is in the atlas,
+// so it doesn't depend on SDL or on the font.
+//
+// Most text is the same from one frame to the next, so the quads for each string
+// are worked out once and kept. A string that hasn't been drawn for KEEP_FRAMES
+// frames is forgotten.
+class TextBatch
+{
+public:
+    // The same layout as the circles, so both can be handed to SDL as they are.
+    typedef CircleBatch::Vertex Vertex;
+
+    // The first and last characters in the atlas. Anything else is drawn as '?'.
+    static constexpr char FIRST = ' ';
+    static constexpr char LAST = '~';
+
+    // The number of frames a string is kept for after it was last drawn.
+    static constexpr unsigned long long KEEP_FRAMES = 60;
+
+    struct Glyph
+    {
+        // Where the glyph is in the atlas, in pixels.
+        int atlasX;
+        int atlasY;
+        int width;
+        int height;
+        // How far to move along the line after drawing the glyph.
+        int advance;
+    };
+
+    // Set where glyphs will be in an atlas of this width, in rows from the top,
+    // and return the height the atlas needs to be.
+    static int pack(std::vector<Glyph>& glyphs, int atlasWidth);
+
+    // Use these glyphs, one for each character from FIRST to LAST, from an atlas of
+    // the given size. Forget every string worked out so far.
+    void setGlyphs(const std::vector<Glyph>& glyphs, int atlasWidth, int atlasHeight);
+
+    // Return true if there are glyphs to draw with.
+    bool hasGlyphs() const;
+
+    // Remove all the text, keeping the memory, and start a new frame.
+    void clear();
+
+    // Add a line of text with its top left corner at x, y. Does nothing without
+    // glyphs.
+    void addText(const std::string& text, float x, float y, Color color);
+
+    // Return the vertices of every glyph, four per glyph going clockwise from the
+    // top left, and the vertex indices of their triangles, six per glyph.
+    const std::vector<Vertex>& vertices() const;
+    const std::vector<int>& indices() const;
+
+    // Return the number of strings whose quads are being kept.
+    std::size_t cached() const;
+
+private:
+    struct Layout
+    {
+        // The corners of each glyph, relative to the start of the string.
+        std::vector<Vertex> vertices;
+        unsigned long long lastUsed;
+    };
+
+    // Return the layout for a string, working it out if it isn't kept.
+    Layout& layout(const std::string& text);
+
+    std::vector<Glyph> glyphs;
+    float atlasWidth = 1;
+    float atlasHeight = 1;
+
+    std::unordered_map<std::string, Layout> layouts;
+    unsigned long long frame = 0;
+
+    std::vector<Vertex> textVertices;
+    std::vector<int> textIndices;
+};
+
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of worker threads that split loops between them. Each worker has its
+// own queue of chunks, and a worker that runs out of chunks steals from the others,
+// so uneven chunks still keep every thread busy.
+class ThreadPool
+{
+public:
+    // A task is handed the range of indices [begin, end) it should process, and the
+    // number of the worker running it, which is always less than size().
+    //
+    // A task only refers to the function it's made from, rather than copying it like
+    // std::function would, so making one never allocates. The function has to
+    // outlive the task, which it does when a lambda is passed straight to parallelFor.
+    class RangeTask
+    {
+    public:
+        template <typename F>
+        RangeTask(const F& f)
+            : function{&f}, invoke{[](const void* target, unsigned begin, unsigned end, unsigned worker) {
+                (*static_cast<const F*>(target))(begin, end, worker);
+            }}
+        {
+        }
+
+        void operator()(unsigned begin, unsigned end, unsigned worker) const
+        {
+            invoke(function, begin, end, worker);
+        }
+
+    private:
+        const void* function;
+        void (*invoke)(const void* function, unsigned begin, unsigned end, unsigned worker);
+    };
+
+    // Constructor. The thread calling parallelFor counts as one of the threads, so a
+    // pool of 1 thread runs everything on the caller.
+    ThreadPool(unsigned threads=1);
+
+    // Destructor. Stops and joins the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)=delete;
+    ThreadPool& operator=(const ThreadPool&)=delete;
+
+    // Return the number of threads, including the caller.
+    unsigned size() const;
+
+    // Split [begin, end) into chunks of at most grain indices, and run the task on
+    // every chunk. Returns once all of the chunks are done.
+    void parallelFor(unsigned begin, unsigned end, unsigned grain, const RangeTask& task);
+
+    // Return the number of threads the hardware can run at once.
+    static unsigned hardwareThreads();
+
+
+private:
+    struct Chunk
+    {
+        unsigned begin;
+        unsigned end;
+    };
+
+    // Chunks [front, chunks.size()) are still to be run. The owner takes them from
+    // the front and thieves from the back. The vector is only cleared once it's
+    // empty, so it keeps its capacity from one job to the next.
+    struct Queue
+    {
+        std::mutex lock;
+        std::vector<Chunk> chunks;
+        unsigned front = 0;
+    };
+
+    // Wait for work and run it until the pool is destroyed.
+    void workerLoop(unsigned worker);
+
+    // Run chunks until every queue is empty.
+    void runChunks(unsigned worker);
+
+    // Take a chunk from the worker's own queue, or steal one from another worker.
+    // Returns false if there's nothing left.
+    bool takeChunk(unsigned worker, Chunk& chunk);
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex jobLock;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const RangeTask* job;
+    unsigned generation;
+    unsigned active;
+    bool stopping;
+    std::atomic<unsigned> remaining;
+};
+
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// The file format shared by TrajectoryWriter and TrajectoryReader, which record
+// particles over time for analysis after a run.
+//
+// A trajectory file is a FileHeader followed by chunks. Each chunk is a ChunkHeader
+// and then a run of frames, each of which is a FrameHeader and the encoded arrays of
+// that frame. When the file is closed properly an index of the chunks and a Trailer
+// are added to the end, so a reader can find any frame straight away. Without them
+// the reader finds the chunks by walking through the file, so a run that crashed can
+// still be read up to its last full chunk. Every number is little-endian.
+//
+// The first frame of each chunk stands on its own, and every frame after it is
+// stored as the difference from the frame before, so decoding a frame only ever
+// needs its own chunk. A frame holds the 64 bit ID of each particle and then each
+// recorded field, and each array is encoded in three steps:
+//
+// 1. Delta. IDs have the ID at the same index in the previous frame subtracted.
+//    Field values are XORed with the same particle's value in the previous frame,
+//    which leaves their top bytes zero when they've barely changed. Particles that
+//    weren't at the same index in the previous frame, and every particle in the
+//    first frame of a chunk, use the value before them in the same array instead.
+// 2. Shuffle. The first byte of every value is stored, then the second byte of every
+//    value, and so on, so the zero bytes end up next to each other.
+// 3. Runs. The bytes of the whole frame are stored as runs. A control byte below 128
+//    is followed by that many plus one bytes to copy, and a control byte of 128 or
+//    more stands for that many minus 127 zero bytes.
+class Trajectory
+{
+public:
+    // Bits for the fields a trajectory records. IDs are always recorded.
+    enum Field : std::uint32_t
+    {
+        POSITION = 1,
+        VELOCITY = 2,
+        MASS = 4,
+        ALL = POSITION | VELOCITY | MASS
+    };
+
+    // Changes whenever the format does. Files with another version aren't read.
+    static constexpr std::uint32_t VERSION = 2;
+
+    struct FileHeader
+    {
+        // "GRAVTRAJ".
+        char magic[8];
+        std::uint32_t version;
+        // The size of each stored value, 4 or 8.
+        std::uint32_t realBytes;
+        std::uint32_t fields;
+        // Only every decimation-th update was recorded.
+        std::uint32_t decimation;
+        // The most frames in a chunk.
+        std::uint32_t chunkFrames;
+        std::uint32_t reserved;
+    };
+
+    struct ChunkHeader
+    {
+        // "CHNK".
+        char magic[4];
+        std::uint32_t frames;
+        std::uint64_t firstFrame;
+        // The number of bytes of frames after this header.
+        std::uint64_t bytes;
+    };
+
+    struct FrameHeader
+    {
+        // The number of updates before this frame was recorded, and the simulation
+        // time it was recorded at.
+        std::uint64_t step;
+        double time;
+        std::uint32_t particles;
+        // The number of encoded bytes after this header.
+        std::uint32_t bytes;
+    };
+
+    struct IndexEntry
+    {
+        std::uint64_t offset;
+        std::uint64_t firstFrame;
+    };
+
+    struct Trailer
+    {
+        std::uint64_t indexOffset;
+        std::uint64_t chunks;
+        std::uint64_t frames;
+        // "GRAVTIDX".
+        char magic[8];
+    };
+
+    static const char FILE_MAGIC[8];
+    static const char CHUNK_MAGIC[4];
+    static const char TRAILER_MAGIC[8];
+
+    // The fields, in the order they're stored in a frame, and the bit each belongs to.
+    static constexpr unsigned FIELDS = 5;
+    static constexpr Field FIELD_BITS[FIELDS] = {POSITION, POSITION, VELOCITY, VELOCITY, MASS};
+
+    // Step 1 for IDs. Store the difference of each ID from the one it's compared to
+    // in out, which has room for n IDs.
+    static void deltaIds(const std::uint64_t* ids, unsigned n, const std::uint64_t* previous, unsigned previousN, std::uint64_t* out);
+
+    // Undo deltaIds in place.
+    static void undeltaIds(std::uint64_t* ids, unsigned n, const std::uint64_t* previous, unsigned previousN);
+
+    // Step 1 for the bits of field values, 32 or 64 bits wide. previous holds the
+    // previous frame's values and ids, with previousN particles.
+    template <typename U>
+    static void deltaValues(const U* values, const std::uint64_t* ids, unsigned n, const U* previous, const std::uint64_t* previousIds, unsigned previousN, U* out);
+
+    // Undo deltaValues in place.
+    template <typename U>
+    static void undeltaValues(U* values, const std::uint64_t* ids, unsigned n, const U* previous, const std::uint64_t* previousIds, unsigned previousN);
+
+    // Step 2. Shuffle n values of width bytes each into out, or unshuffle them back.
+    static void shuffle(const void* values, unsigned n, unsigned width, char* out);
+    static void unshuffle(const char* shuffled, unsigned n, unsigned width, void* out);
+
+    // Step 3. Append the runs for a block of bytes to out.
+    static void encodeRuns(const char* bytes, std::size_t n, std::vector<char>& out);
+
+    // Undo encodeRuns, filling exactly n bytes. Return false if the runs don't make
+    // up exactly n bytes.
+    static bool decodeRuns(const char* runs, std::size_t size, char* bytes, std::size_t n);
+};
+
+
+#endif
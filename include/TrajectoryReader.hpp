@@ -0,0 +1,92 @@
+#ifndef TRAJECTORYREADER_HPP
+#define TRAJECTORYREADER_HPP
+
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Trajectory.hpp"
+
+
+// Reads the frames of a trajectory file written by TrajectoryWriter, in any order.
+// Reading frames in order only decodes each frame once. Jumping to a frame decodes
+// its chunk from the start up to it.
+class TrajectoryReader
+{
+public:
+    // One recorded frame. Fields that weren't recorded are left empty.
+    struct Frame
+    {
+        // The number of updates before the frame was recorded, and the simulation
+        // time it was recorded at.
+        std::uint64_t step;
+        double time;
+        std::vector<std::uint64_t> ids;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> vx;
+        std::vector<double> vy;
+        std::vector<double> mass;
+    };
+
+    TrajectoryReader() = default;
+
+    // Destructor. Closes the file.
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    // Open a trajectory file. Return false, and log why, if it isn't one this build
+    // can read.
+    bool open(const char* path);
+
+    void close();
+
+    // Return the number of frames in the file.
+    std::uint64_t frames() const;
+
+    // Return the Trajectory::Field bits recorded in the file.
+    std::uint32_t fields() const;
+
+    // Return how many updates there were between recorded frames.
+    unsigned decimation() const;
+
+    // Read frame number i into out. Return false, and log why, if there's no such
+    // frame or it's corrupt.
+    bool read(std::uint64_t i, Frame& out);
+
+private:
+    // Read the chunk at position c in the index, and get ready to decode its first frame.
+    bool loadChunk(std::size_t c);
+
+    // Decode the next frame of the loaded chunk on top of the last one.
+    bool decodeNext();
+
+    std::FILE* file = nullptr;
+    Trajectory::FileHeader header;
+    std::vector<Trajectory::IndexEntry> index;
+    std::uint64_t total = 0;
+
+    // The loaded chunk, or NO_CHUNK, where the next frame in it starts, and its number.
+    static constexpr std::size_t NO_CHUNK = ~std::size_t(0);
+    std::size_t loaded = NO_CHUNK;
+    std::vector<char> chunk;
+    std::size_t cursor = 0;
+    std::uint64_t next = 0;
+    std::uint64_t chunkEnd = 0;
+
+    // The last decoded frame, with the bits of each field widened to 64 bits.
+    Trajectory::FrameHeader current;
+    std::vector<std::uint64_t> ids;
+    std::vector<std::uint64_t> bits[Trajectory::FIELDS];
+
+    // Scratch space for decoding.
+    std::vector<char> raw;
+    std::vector<std::uint64_t> newIds;
+    std::vector<std::uint64_t> newBits;
+    std::vector<std::uint32_t> narrow;
+};
+
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef TRAJECTORYWRITER_HPP
+#define TRAJECTORYWRITER_HPP
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "ParticleStore.hpp"
+#include "Trajectory.hpp"
+
+
+// Streams the particles of a running simulation to a trajectory file. See
+// Trajectory.hpp for the format.
+//
+// write only copies the particles into a spare frame and hands it to a background
+// thread, which encodes the frames and writes them out a chunk at a time, so the
+// thread stepping the simulation never waits on the disk. There are only a few spare
+// frames. If the background thread falls so far behind that they're all in use, the
+// frame is dropped and counted instead of waiting for one.
+class TrajectoryWriter
+{
+public:
+    struct Options
+    {
+        // Record every decimation-th call to write.
+        unsigned decimation = 1;
+        // The Trajectory::Field bits to record.
+        std::uint32_t fields = Trajectory::ALL;
+        // The most frames in a chunk. Longer chunks compress better, but a reader
+        // seeking to a frame has to decode the frames before it in its chunk.
+        unsigned chunkFrames = 32;
+        // The most frames that can wait for the background thread at once.
+        unsigned queueFrames = 4;
+    };
+
+    TrajectoryWriter() = default;
+
+    // Destructor. Closes the file.
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // Start a new trajectory file, closing any open one first. Return false, and log
+    // why, if the file couldn't be created.
+    bool open(const char* path, const Options& options);
+    bool open(const char* path);
+
+    // Record the particles, if this call is one that the decimation keeps. Call it
+    // once per update, with the simulation time.
+    void write(const ParticleStore& particles, double time);
+
+    // Wait for every frame to be written, add the index, and close the file.
+    void close();
+
+    // Return true if a file is open.
+    bool isOpen() const;
+
+    // Return the number of frames handed to the background thread so far, and the
+    // number dropped because it was too far behind.
+    unsigned long long written() const;
+    unsigned long long dropped() const;
+
+private:
+    // An unsigned integer as wide as a Real, to hold its bits while encoding.
+    typedef std::conditional<sizeof(Real) == 4, std::uint32_t, std::uint64_t>::type Bits;
+
+    struct Frame
+    {
+        std::uint64_t step;
+        double time;
+        std::vector<std::uint64_t> ids;
+        std::vector<Bits> fields[Trajectory::FIELDS];
+    };
+
+    // Run by the background thread. Encodes frames as they arrive, until the file is
+    // closed and every frame has been encoded.
+    void drain();
+
+    // Encode a frame against the one before it onto the end of the chunk.
+    void encode(const Frame& frame, const Frame* previous);
+
+    // Write the chunk out and start a new one.
+    void writeChunk();
+
+    std::FILE* file = nullptr;
+    Options options;
+
+    // Calls to write so far, and frames recorded so far.
+    unsigned long long calls = 0;
+    std::atomic<unsigned long long> frames{0};
+    std::atomic<unsigned long long> droppedFrames{0};
+
+    // Frames waiting to be encoded, and frames free to be written into. Both are
+    // guarded by lock.
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::unique_ptr<Frame>> pending;
+    std::vector<std::unique_ptr<Frame>> spare;
+    unsigned allocated = 0;
+    bool stop = false;
+    std::thread encoder;
+
+    // Only touched by the background thread. The chunk being built, where each chunk
+    // starts in the file, and scratch space for encoding.
+    std::vector<char> chunk;
+    unsigned chunkFrames = 0;
+    std::uint64_t chunkFirst = 0;
+    std::uint64_t encoded = 0;
+    std::uint64_t offset = 0;
+    std::vector<Trajectory::IndexEntry> index;
+    std::vector<char> shuffled;
+    std::vector<std::uint64_t> idDelta;
+    std::vector<Bits> delta;
+    bool failed = false;
+};
+
+
+#endif
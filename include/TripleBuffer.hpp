@@ -0,0 +1,68 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+
+#include <atomic>
+
+
+// Hands values from one thread to another without either ever waiting. The writer
+// fills the back value and publishes it, and the reader takes the latest published
+// value whenever it's ready for one. There are three values, so the writer always
+// has one to fill while the reader holds another and the third waits in the middle.
+// Values published while the reader is busy replace each other, so the reader only
+// ever sees the latest.
+//
+// Only one thread may write and only one may read. The values are reused, so any
+// memory they own is kept from one use to the next.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Return the value to fill. Only the writer may call this.
+    T& back()
+    {
+        return values[backIndex];
+    }
+
+    // Hand the back value to the reader and start filling another. Only the writer
+    // may call this.
+    void publish()
+    {
+        unsigned old = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel);
+        backIndex = old & INDEX;
+    }
+
+    // Take the latest published value, if there's one the reader hasn't seen. Return
+    // true if front changed. Only the reader may call this.
+    bool update()
+    {
+        if (0 == (middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+
+        unsigned old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = old & INDEX;
+        return true;
+    }
+
+    // Return the value the reader last took. Only the reader may call this.
+    const T& front() const
+    {
+        return values[frontIndex];
+    }
+
+private:
+    // The middle holds the index of a value, with FRESH set when it was published
+    // since the reader last took it.
+    static constexpr unsigned INDEX = 3;
+    static constexpr unsigned FRESH = 4;
+
+    T values[3];
+    unsigned backIndex = 0;
+    std::atomic<unsigned> middle{1};
+    unsigned frontIndex = 2;
+};
+
+
+#endif
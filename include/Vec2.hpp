@@ -0,0 +1,183 @@
+#ifndef VEC2_HPP
+#define VEC2_HPP
+
+
+#include <cmath>
+#include <cstdint>
+
+
+// A plain two component vector. Everything is worked out with multiplies and adds
+// on the components, never by going through an angle, and everything that doesn't
+// need a square root can be used in constant expressions.
+template <typename T>
+struct Vec2
+{
+    T x;
+    T y;
+
+    constexpr Vec2()
+        : x{0}, y{0}
+    {
+    }
+
+    constexpr Vec2(T x, T y)
+        : x{x}, y{y}
+    {
+    }
+
+    constexpr Vec2& operator+=(const Vec2& other)
+    {
+        x += other.x;
+        y += other.y;
+        return *this;
+    }
+
+    constexpr Vec2& operator-=(const Vec2& other)
+    {
+        x -= other.x;
+        y -= other.y;
+        return *this;
+    }
+
+    constexpr Vec2& operator*=(T factor)
+    {
+        x *= factor;
+        y *= factor;
+        return *this;
+    }
+
+    constexpr Vec2& operator/=(T divisor)
+    {
+        x /= divisor;
+        y /= divisor;
+        return *this;
+    }
+
+    // Add other * factor to this vector.
+    constexpr Vec2& addScaled(const Vec2& other, T factor)
+    {
+        x += other.x * factor;
+        y += other.y * factor;
+        return *this;
+    }
+
+    constexpr T dot(const Vec2& other) const
+    {
+        return x * other.x + y * other.y;
+    }
+
+    // Return the square of the length. Comparing squared lengths saves a square root.
+    constexpr T squaredNorm() const
+    {
+        return x * x + y * y;
+    }
+
+    T norm() const
+    {
+        return std::sqrt(squaredNorm());
+    }
+
+    // Return a vector of length 1 pointing the same way, or the zero vector if this
+    // is the zero vector.
+    Vec2 normalized() const
+    {
+        T length = norm();
+        return length > 0 ? Vec2(x / length, y / length) : Vec2();
+    }
+};
+
+
+template <typename T>
+constexpr Vec2<T> operator+(Vec2<T> a, const Vec2<T>& b)
+{
+    return a += b;
+}
+
+
+template <typename T>
+constexpr Vec2<T> operator-(Vec2<T> a, const Vec2<T>& b)
+{
+    return a -= b;
+}
+
+
+template <typename T>
+constexpr Vec2<T> operator-(const Vec2<T>& a)
+{
+    return Vec2<T>(-a.x, -a.y);
+}
+
+
+template <typename T>
+constexpr Vec2<T> operator*(Vec2<T> a, T factor)
+{
+    return a *= factor;
+}
+
+
+template <typename T>
+constexpr Vec2<T> operator*(T factor, Vec2<T> a)
+{
+    return a *= factor;
+}
+
+
+template <typename T>
+constexpr Vec2<T> operator/(Vec2<T> a, T divisor)
+{
+    return a /= divisor;
+}
+
+
+template <typename T>
+constexpr bool operator==(const Vec2<T>& a, const Vec2<T>& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+
+template <typename T>
+constexpr bool operator!=(const Vec2<T>& a, const Vec2<T>& b)
+{
+    return !(a == b);
+}
+
+
+// Return a * factor + b, as a single multiply-add on each component.
+template <typename T>
+constexpr Vec2<T> fma(const Vec2<T>& a, T factor, const Vec2<T>& b)
+{
+    return Vec2<T>(a.x * factor + b.x, a.y * factor + b.y);
+}
+
+
+// Batch operations over vectors stored as separate x and y arrays, the way
+// ParticleStore keeps them. Each is a single pass with no branches in the loop body,
+// so the compiler can turn it into SIMD instructions.
+
+// For every i in [begin, end), add (dx[i], dy[i]) * factor to (x[i], y[i]), unless
+// flags[i] has any of the skip bits set. The sum is worked out in the type of the
+// offsets, which may be wider than the type of the vectors being added to.
+template <typename T, typename U>
+void addScaled(
+    T* x,
+    T* y,
+    const U* dx,
+    const U* dy,
+    U factor,
+    const std::uint8_t* flags,
+    std::uint8_t skip,
+    unsigned begin,
+    unsigned end
+)
+{
+    for (unsigned i = begin; i < end; ++i)
+    {
+        bool moves = !(flags[i] & skip);
+        x[i] = moves ? x[i] + dx[i] * factor : x[i];
+        y[i] = moves ? y[i] + dy[i] * factor : y[i];
+    }
+}
+
+
+#endif
@@ -0,0 +1,41 @@
+#include "AllocationCounter.hpp"
+#include <atomic>
+
+
+namespace
+{
+    std::atomic<bool> installed{false};
+    std::atomic<unsigned long long> allocationCount{0};
+    std::atomic<unsigned long long> byteCount{0};
+}
+
+
+bool AllocationCounter::available()
+{
+    return installed.load(std::memory_order_relaxed);
+}
+
+
+unsigned long long AllocationCounter::allocations()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+
+unsigned long long AllocationCounter::bytes()
+{
+    return byteCount.load(std::memory_order_relaxed);
+}
+
+
+void AllocationCounter::record(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    byteCount.fetch_add(size, std::memory_order_relaxed);
+}
+
+
+void AllocationCounter::install()
+{
+    installed.store(true, std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#include "AllocationCounter.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+// Replaces the global operator new so AllocationCounter can count every allocation.
+// This file is left out of the library and only linked into the executables that
+// want the counts, since every allocation pays for an atomic add.
+namespace
+{
+    const bool installed = (AllocationCounter::install(), true);
+
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        AllocationCounter::record(size);
+
+        // aligned_alloc wants a size that's a multiple of the alignment.
+        size = std::max<std::size_t>(size, 1);
+        void* p = alignment > alignof(std::max_align_t)
+            ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+            : std::malloc(size);
+
+        if (nullptr == p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+
+// The replaceable forms of operator new. The array and nothrow forms that aren't
+// replaced here call these ones.
+void* operator new(std::size_t size)
+{
+    return allocate(size, 0);
+}
+
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
@@ -1,117 +1,115 @@
 #include "Attacker.hpp"
+#include "Log.hpp"
 
 
-Attacker::Attacker(double x, double y)
-    :Particle{
-        5,
-        x, y,
-        MotionVector<double>(0, 0),
-        SDL_Color{255, 0, 0},
-        false  // No gravity
-    }, target{nullptr}, ws{1}, angle{-1}, lifespan{100}, range{200}
+Attacker::Attacker(ParticleStore::Id body)
+    : body{body}, target{ParticleStore::NO_ID}, ws{1}, heading{}, lifespan{100}, range{200}
 {
 }
 
 
-void Attacker::update(std::list<Particle*>& particles)
+void Attacker::update(ParticleStore& particles, double dt)
 {
-    move();
+    move(particles, dt);
 
-    if (nullptr != target)
+    unsigned self = particles.indexOf(body);
+
+    if (ParticleStore::NO_ID != target)
     {
+        unsigned t = particles.indexOf(target);
+
         // Check if the target is still nearby or still exists.
-        if (target->isAbsorbed() || target->getMass() <= 0 || distanceFrom(target->x(), target->y()) > range + 100)
+        if (ParticleStore::NONE == t || particles.hasFlag(t, ParticleStore::DEAD) || particles.mass[t] <= 0
+            || particles.distanceFrom(self, particles.x[t], particles.y[t]) > range + 100)
         {
-            std::cout << "Target too far away." << (target->isAbsorbed() ? 1 : 0) << std::endl;
-            target = nullptr;
-            ws = 1;
+            LOG_INFO("Target too far away.%d", ParticleStore::NONE == t ? 1 : 0);
+            loseTarget();
         }
         // If it is nearby and the attacker is locked on, inflict damage.
-        else if (lockedOn())
+        else if (lockedOn(particles))
         {
             increaseWeaponStrength(0.25);
-            target->changeMass(-weaponDamage());
-            if (target->getMass() <= 0)
+            particles.mass[t] -= weaponDamage();
+            if (particles.mass[t] <= 0)
             {
                 // If the target gets destroyed, reset the weapon strength.
-                std::cout << "Destroyed target." << std::endl;
-                target = nullptr;
-                ws = 1;
+                LOG_INFO("Destroyed target.");
+                loseTarget();
             }
-            // std::cout << "Reduced target mass by " << std::pow(ws, ws / 20) << std::endl;
+            // LOG_DEBUG("Reduced target mass by %g", std::pow(ws, ws / 20));
         }
         return;
     }
 
-    Particle* closest = nullptr;
+    unsigned closest = ParticleStore::NONE;
     double closestDist = range + 1;
     double thisDist = range + 1;
 
-    for (Particle* p : particles)
+    for (unsigned i = 0; i < particles.size(); ++i)
     {
-        if (( thisDist = distanceFrom(p->x(), p->y()) ) < closestDist && p != this && p->hasGravity())
+        if (!particles.hasFlag(i, ParticleStore::GRAVITY) || particles.hasFlag(i, ParticleStore::DEAD))
+        {
+            continue;
+        }
+
+        if (( thisDist = particles.distanceFrom(self, particles.x[i], particles.y[i]) ) < closestDist)
         {
-            closest = p;
+            closest = i;
             closestDist = thisDist;
         }
     }
 
-    if (nullptr != closest)
+    if (ParticleStore::NONE != closest)
     {
-        target = closest;
+        target = particles.idAt(closest);
     }
 }
 
 
-void Attacker::move()
+void Attacker::move(ParticleStore& particles, double dt)
 {
-    if (fixed)
+    unsigned self = particles.indexOf(body);
+
+    if (particles.hasFlag(self, ParticleStore::FROZEN))
     {
         return;
     }
 
+    unsigned t = particles.indexOf(target);
+
     // If there is no target, then move randomly.
-    if (nullptr == target)
+    if (ParticleStore::NONE == t)
     {
-        if (angle < 0) // If the angle hasn't been initialized yet.
+        // Pick a new direction if there isn't one yet, and every so often after that.
+        if (Vec2<double>() == heading || std::rand() % 1000 < 5)
         {
-            // Choose a random angle.
-            angle = std::fmod(std::rand(), 2 * 3.14);
-        }
-        else
-        {
-            int chance = std::rand() % 1000;
-
-            if (chance < 5)
-            {
-                angle = std::fmod(std::rand(), 2 * 3.14);
-            }
+            double angle = std::fmod(std::rand(), 2 * 3.14);
+            heading = Vec2<double>(std::cos(angle), std::sin(angle));
         }
     }
     // Otherwise, move towards the target.
     else
     {
-        double dx = target->x() - x_pos;
-        double dy = target->y() - y_pos;
-        angle = std::atan2(dy, dx);
+        heading = Vec2<double>(particles.x[t] - particles.x[self], particles.y[t] - particles.y[self]).normalized();
     }
-    
-    int magnitude = 25;
 
-    double dx = magnitude * std::cos(angle);
-    double dy = magnitude * std::sin(angle);
+    int magnitude = 25;
 
-    if (nullptr == target || distanceFrom(target->x(), target->y()) > target->getRadius() + 100)
+    if (ParticleStore::NONE == t
+        || particles.distanceFrom(self, particles.x[t], particles.y[t]) > particles.radius[t] + 100)
     {
-        x_pos += dx * (1 / 60.0);
-        y_pos += dy * (1 / 60.0);
+        particles.x[self] += heading.x * magnitude * dt;
+        particles.y[self] += heading.y * magnitude * dt;
     }
 }
 
 
-bool Attacker::lockedOn()
+bool Attacker::lockedOn(const ParticleStore& particles)
 {
-    return (nullptr != target) && (distanceFrom(target->x(), target->y()) <= range);
+    unsigned self = particles.indexOf(body);
+    unsigned t = particles.indexOf(target);
+
+    return (ParticleStore::NONE != t) && (particles.distanceFrom(self, particles.x[t], particles.y[t]) <= range);
 }
 
 
@@ -127,16 +125,15 @@ void Attacker::fire()
 }
 
 
-// Return a pointer to the target, if there is one.
-Particle* Attacker::getTarget()
+ParticleStore::Id Attacker::getBody()
 {
-    return target;
+    return body;
 }
 
 
-SDL_Color Attacker::getColor()
+ParticleStore::Id Attacker::getTarget()
 {
-    return color;
+    return target;
 }
 
 
@@ -146,6 +143,13 @@ void Attacker::increaseWeaponStrength(double amount)
 }
 
 
+void Attacker::loseTarget()
+{
+    target = ParticleStore::NO_ID;
+    ws = 1;
+}
+
+
 double Attacker::weaponDamage()
 {
     if (ws < 20)
@@ -0,0 +1,91 @@
+#include "Camera.hpp"
+#include <algorithm>
+
+
+Camera::Camera(double width, double height)
+    : width{width}, height{height}
+{
+    reset();
+}
+
+
+void Camera::reset()
+{
+    centerX = width / 2;
+    centerY = height / 2;
+    zoom = 1;
+}
+
+
+void Camera::pan(double dx, double dy)
+{
+    centerX -= dx / zoom;
+    centerY -= dy / zoom;
+}
+
+
+void Camera::zoomAt(double factor, double screenX, double screenY)
+{
+    double x = toWorldX(screenX);
+    double y = toWorldY(screenY);
+
+    zoom = std::min(MAX_ZOOM, std::max(MIN_ZOOM, zoom * factor));
+
+    // Move the center so x, y is back under the same pixel.
+    centerX = x - (screenX - width / 2) / zoom;
+    centerY = y - (screenY - height / 2) / zoom;
+}
+
+
+double Camera::getZoom() const
+{
+    return zoom;
+}
+
+
+double Camera::toScreenX(double x) const
+{
+    return (x - centerX) * zoom + width / 2;
+}
+
+
+double Camera::toScreenY(double y) const
+{
+    return (y - centerY) * zoom + height / 2;
+}
+
+
+double Camera::toWorldX(double screenX) const
+{
+    return (screenX - width / 2) / zoom + centerX;
+}
+
+
+double Camera::toWorldY(double screenY) const
+{
+    return (screenY - height / 2) / zoom + centerY;
+}
+
+
+double Camera::left() const
+{
+    return toWorldX(0);
+}
+
+
+double Camera::top() const
+{
+    return toWorldY(0);
+}
+
+
+double Camera::right() const
+{
+    return toWorldX(width);
+}
+
+
+double Camera::bottom() const
+{
+    return toWorldY(height);
+}
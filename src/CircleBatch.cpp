@@ -0,0 +1,103 @@
+#include "CircleBatch.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+CircleBatch::CircleBatch()
+    : unitX(MAX_SIDES + 1), unitY(MAX_SIDES + 1)
+{
+    const double PI = std::atan(1) * 4;
+
+    for (unsigned sides = MIN_SIDES; sides <= MAX_SIDES; ++sides)
+    {
+        unitX[sides].resize(sides);
+        unitY[sides].resize(sides);
+        for (unsigned s = 0; s < sides; ++s)
+        {
+            unitX[sides][s] = std::cos(2 * PI * s / sides);
+            unitY[sides][s] = std::sin(2 * PI * s / sides);
+        }
+    }
+}
+
+
+void CircleBatch::clear()
+{
+    circleVertices.clear();
+    circleIndices.clear();
+}
+
+
+void CircleBatch::addCircle(double x, double y, double radius, Color color)
+{
+    unsigned sides = sidesFor(radius);
+    const std::vector<float>& ux = unitX[sides];
+    const std::vector<float>& uy = unitY[sides];
+
+    int center = circleVertices.size();
+    float cx = x;
+    float cy = y;
+    float r = radius;
+
+    circleVertices.push_back(Vertex{cx, cy, color.r, color.g, color.b, 255, 0, 0});
+    for (unsigned s = 0; s < sides; ++s)
+    {
+        circleVertices.push_back(Vertex{cx + r * ux[s], cy + r * uy[s], color.r, color.g, color.b, 255, 0, 0});
+    }
+
+    for (unsigned s = 0; s < sides; ++s)
+    {
+        circleIndices.push_back(center);
+        circleIndices.push_back(center + 1 + s);
+        circleIndices.push_back(center + 1 + (s + 1) % sides);
+    }
+}
+
+
+void CircleBatch::addRect(double x, double y, double width, double height, Color color)
+{
+    int first = circleVertices.size();
+    float left = x;
+    float top = y;
+    float right = x + width;
+    float bottom = y + height;
+
+    circleVertices.push_back(Vertex{left, top, color.r, color.g, color.b, 255, 0, 0});
+    circleVertices.push_back(Vertex{right, top, color.r, color.g, color.b, 255, 0, 0});
+    circleVertices.push_back(Vertex{right, bottom, color.r, color.g, color.b, 255, 0, 0});
+    circleVertices.push_back(Vertex{left, bottom, color.r, color.g, color.b, 255, 0, 0});
+
+    for (int corner : {0, 1, 2, 0, 2, 3})
+    {
+        circleIndices.push_back(first + corner);
+    }
+}
+
+
+const std::vector<CircleBatch::Vertex>& CircleBatch::vertices() const
+{
+    return circleVertices;
+}
+
+
+const std::vector<int>& CircleBatch::indices() const
+{
+    return circleIndices;
+}
+
+
+unsigned CircleBatch::sidesFor(double radius)
+{
+    // A side of a polygon with n sides strays r(1 - cos(pi / n)) from the circle at
+    // its middle, so this is the smallest n that keeps that within half a pixel.
+    const double PI = std::atan(1) * 4;
+    const double TOLERANCE = 0.5;
+
+    if (radius <= TOLERANCE)
+    {
+        return MIN_SIDES;
+    }
+
+    double sides = std::ceil(PI / std::acos(1 - TOLERANCE / radius));
+    return std::min<double>(MAX_SIDES, std::max<double>(MIN_SIDES, sides));
+}
@@ -0,0 +1,75 @@
+#include "DensityMap.hpp"
+#include <algorithm>
+
+
+void DensityMap::resize(unsigned width, unsigned height)
+{
+    this->width = width;
+    this->height = height;
+    slot.assign(static_cast<std::size_t>(width) * height, -1);
+    lit.clear();
+}
+
+
+void DensityMap::clear()
+{
+    for (const Pixel& p : lit)
+    {
+        slot[static_cast<std::size_t>(p.y) * width + p.x] = -1;
+    }
+    lit.clear();
+}
+
+
+void DensityMap::add(double x, double y, double area, Color color)
+{
+    // Written this way round so NaN is ignored too.
+    if (!(x >= 0 && y >= 0 && x < width && y < height))
+    {
+        return;
+    }
+
+    unsigned px = x;
+    unsigned py = y;
+    int& s = slot[static_cast<std::size_t>(py) * width + px];
+    if (s < 0)
+    {
+        s = lit.size();
+        lit.push_back(Pixel{px, py, 0, 0, 0, 0});
+    }
+
+    Pixel& p = lit[s];
+    float a = area;
+    p.area += a;
+    p.r += a * color.r;
+    p.g += a * color.g;
+    p.b += a * color.b;
+}
+
+
+void DensityMap::drawInto(CircleBatch& batch) const
+{
+    for (const Pixel& p : lit)
+    {
+        if (!(p.area > 0))
+        {
+            continue;
+        }
+
+        // The background is black, so dimming the color is the same as blending it.
+        float coverage = std::min(1.0f, std::max(MIN_COVERAGE, p.area));
+        float scale = coverage / p.area;
+        Color color{
+            static_cast<std::uint8_t>(std::min(255.0f, p.r * scale)),
+            static_cast<std::uint8_t>(std::min(255.0f, p.g * scale)),
+            static_cast<std::uint8_t>(std::min(255.0f, p.b * scale))
+        };
+        batch.addRect(p.x, p.y, 1, 1, color);
+    }
+}
+
+
+unsigned DensityMap::pixels() const
+{
+    return lit.size();
+}
@@ -1,57 +1,119 @@
 #include "Environment.hpp"
+#include <algorithm>
+#include <cmath>
+#include "AllocationCounter.hpp"
+#include "Log.hpp"
 
 
 Environment::Environment(unsigned numParticles)
     : numParticles{numParticles}
 {
-    particles = std::list<Particle*>();
+    particles.reserve(numParticles);
 
     for (unsigned i = 0; i < numParticles; ++i){
-        particles.push_back(genRandomParticle());
+        placeParticle(genRandomParticle());
     }
 }
 
 
-Environment::~Environment()
+void Environment::update()
 {
-    // Delete the particles array.
-    while (!particles.empty())
+    unsigned long long allocationsBefore = AllocationCounter::allocations();
+
+    if (solver != Solver::Reference)
     {
-        delete particles.front();
-        particles.pop_front();
+        {
+            Profiler::Scope scope(profiler, Profiler::Phase::Forces);
+            step();
+        }
+        Profiler::Scope scope(profiler, Profiler::Phase::Merges);
+        collide();
     }
-}
+    else if (deterministic)
+    {
+        {
+            Profiler::Scope scope(profiler, Profiler::Phase::Forces);
+            referenceStep();
+        }
+        Profiler::Scope scope(profiler, Profiler::Phase::Merges);
+        collide();
+    }
+    else
+    {
+        // Moving, pulling and merging are all mixed together here, so it's all
+        // counted as forces.
+        Profiler::Scope scope(profiler, Profiler::Phase::Forces);
 
+        // Each particle in turn moves, accelerates towards every other particle
+        // and coalesces with anything it hits.
+        for (unsigned i = 0; i < particles.size(); ++i)
+        {
+            if (particles.hasFlag(i, ParticleStore::ATTACKER) || particles.hasFlag(i, ParticleStore::DEAD))
+            {
+                continue;
+            }
 
-void Environment::update()
-{
-    for (Particle* p : particles)
+            particles.move(i, timeStep);
+            particles.radius[i] = Particle::calcRad(particles.mass[i], particles.density[i]);
+
+            for (unsigned j = 0; j < particles.size(); ++j)
+            {
+                if (j == i || !particles.hasFlag(j, ParticleStore::GRAVITY) || particles.hasFlag(j, ParticleStore::DEAD))
+                {
+                    continue;
+                }
+
+                particles.accelerateTowards(i, particles.x[j], particles.y[j], GRAVITATIONAL_CONSTANT, particles.mass[j], timeStep);
+
+                // Stop once this particle has been absorbed by another.
+                if (particles.coalesce(i, j, ELASTICITY_CONSTANT) && particles.hasFlag(i, ParticleStore::DEAD))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Attackers change the mass of their targets, so they go one at a time.
+    for (Attacker& a : attackers)
     {
-        p->update(particles);
+        a.update(particles, timeStep);
     }
-    
 
-    // Remove any absorbed particles, particles outside the screen, or particles with no mass.
-    for (auto it = particles.begin(); it != particles.end();)
+    Profiler::Scope scope(profiler, Profiler::Phase::Removal);
+
+    // Flag any absorbed particles, particles outside the screen, or particles with no mass.
+    // Exploding adds fragments to the end of the store, which get checked too.
+    for (unsigned i = 0; i < particles.size(); ++i)
     {
-        if ((*it)->isAbsorbed() || isOutsideBounds(*(*it)) || (*it)->getMass() <= 0)
+        if (particles.hasFlag(i, ParticleStore::DEAD) || isOutsideBounds(i) || particles.mass[i] <= 0)
         {
-            if ((*it)->getMass() <= 0)
+            if (particles.mass[i] <= 0)
             {
-                (*it)->explode(particles);
+                explode(i);
             }
-            delete (*it); // Free up dynamically allocated memory.
-            it = particles.erase(it);
-        }
-        else
-        {
-            ++it;
+            particles.setFlag(i, ParticleStore::DEAD);
         }
     }
+
+    particles.removeDead();
+
+    // Attackers whose bodies were removed are gone too.
+    attackers.erase(
+        std::remove_if(attackers.begin(), attackers.end(), [this](Attacker& a) {
+            return particles.indexOf(a.getBody()) == ParticleStore::NONE;
+        }),
+        attackers.end()
+    );
+
+    time += timeStep;
+    updateAllocations = AllocationCounter::available()
+        ? AllocationCounter::allocations() - allocationsBefore
+        : NOT_COUNTED;
 }
 
 
-Particle* Environment::genRandomParticle()
+Particle Environment::genRandomParticle()
 {
     double radius = std::rand() % 5 + 1;
 
@@ -62,36 +124,76 @@ Particle* Environment::genRandomParticle()
     // 0 Motion Vector.
     MotionVector<double> vec = MotionVector<double>(0, 0);
 
-    return new Particle(radius, x, y, vec);
+    return Particle(radius, x, y, vec);
 }
 
 
-void Environment::placeParticle(Particle* p)
+ParticleStore::Id Environment::placeParticle(Particle p)
 {
-    particles.push_back(p);
+    std::uint8_t flags = 0;
+    if (p.hasGravity())
+    {
+        flags |= ParticleStore::GRAVITY;
+    }
+    if (p.isFrozen())
+    {
+        flags |= ParticleStore::FROZEN;
+    }
+
+    return particles.add(
+        p.getRadius(),
+        p.x(), p.y(),
+        p.getVelocity().x(), p.getVelocity().y(),
+        p.getDensity(),
+        flags
+    );
 }
 
 
-Particle* Environment::findParticle(double x, double y)
+ParticleStore::Id Environment::placeAttacker(double x, double y)
 {
-    for (auto it = particles.begin(); it != particles.end(); ++it)
+    // Attackers have no gravity.
+    ParticleStore::Id body = particles.add(Attacker::RADIUS, x, y, 0, 0, PARTICLE_DENSITY, ParticleStore::ATTACKER);
+    if (ParticleStore::NO_ID != body)
     {
-        if (std::hypot(x - (*it)->x(), y - (*it)->y()) <= (*it)->getRadius())
+        attackers.push_back(Attacker(body));
+    }
+    return body;
+}
+
+
+ParticleStore::Id Environment::findParticle(double x, double y)
+{
+    for (unsigned i = 0; i < particles.size(); ++i)
+    {
+        if (particles.distanceFrom(i, x, y) <= particles.radius[i])
         {
-            return (*it);
+            return particles.idAt(i);
         }
     }
 
-    return nullptr;
+    return ParticleStore::NO_ID;
 }
 
 
-std::list<Particle*>& Environment::getParticles()
+ParticleStore& Environment::getParticles()
 {
     return particles;
 }
 
 
+std::vector<Attacker>& Environment::getAttackers()
+{
+    return attackers;
+}
+
+
+const SpatialGrid& Environment::getGrid()
+{
+    return grid;
+}
+
+
 std::vector<unsigned> Environment::dimensions()
 {
     std::vector<unsigned> dim = {width, height};
@@ -99,22 +201,624 @@ std::vector<unsigned> Environment::dimensions()
 }
 
 
-bool Environment::isOutsideBounds(Particle p)
+void Environment::setSolver(Solver s)
+{
+    solver = s;
+}
+
+
+Environment::Solver Environment::getSolver()
+{
+    return solver;
+}
+
+
+void Environment::setOpeningAngle(double theta)
+{
+    tree.setOpeningAngle(theta);
+}
+
+
+void Environment::setIntegrator(Integrator i)
+{
+    integrator = i;
+}
+
+
+Environment::Integrator Environment::getIntegrator()
+{
+    return integrator;
+}
+
+
+void Environment::setTimeStep(double dt)
+{
+    timeStep = dt;
+}
+
+
+double Environment::getTimeStep()
+{
+    return timeStep;
+}
+
+
+double Environment::getTime()
+{
+    return time;
+}
+
+
+unsigned long long Environment::getForceEvaluations()
+{
+    return forceEvaluations;
+}
+
+
+unsigned long long Environment::getUpdateAllocations()
+{
+    return updateAllocations;
+}
+
+
+Profiler& Environment::getProfiler()
+{
+    return profiler;
+}
+
+
+void Environment::setMultipoleOrder(unsigned order)
+{
+    multipole.setOrder(order);
+}
+
+
+void Environment::setMeshCorrection(bool on)
+{
+    mesh.shortRange = on;
+    if (mesh.mesh)
+    {
+        mesh.mesh->setShortRange(on);
+    }
+}
+
+
+Environment::LazyMesh::LazyMesh(const LazyMesh& other)
+    : mesh{other.mesh ? std::make_unique<ParticleMesh>(*other.mesh) : nullptr}, shortRange{other.shortRange}
+{
+}
+
+
+Environment::LazyMesh& Environment::LazyMesh::operator=(const LazyMesh& other)
+{
+    mesh = other.mesh ? std::make_unique<ParticleMesh>(*other.mesh) : nullptr;
+    shortRange = other.shortRange;
+    return *this;
+}
+
+
+double Environment::measureSolverError(unsigned samples)
+{
+    computeAccelerations();
+    return GravitySolver::sampleError(particles.x, particles.y, bodyMass, GRAVITATIONAL_CONSTANT, accX, accY, samples);
+}
+
+
+void Environment::setDeterministic(bool on)
+{
+    deterministic = on;
+    kernel.setDeterministic(on);
+}
+
+
+bool Environment::isDeterministic()
+{
+    return deterministic;
+}
+
+
+void Environment::setThreads(unsigned threads)
+{
+    pool = std::make_shared<ThreadPool>(threads);
+}
+
+
+unsigned Environment::getThreads()
+{
+    return pool->size();
+}
+
+
+void Environment::collectMasses()
+{
+    bodyMass.resize(particles.size());
+
+    for (unsigned i = 0; i < particles.size(); ++i)
+    {
+        // Particles without gravity don't pull on anything.
+        bool pulls = particles.hasFlag(i, ParticleStore::GRAVITY) && !particles.hasFlag(i, ParticleStore::DEAD);
+        bodyMass[i] = pulls ? particles.mass[i] : 0;
+    }
+}
+
+
+void Environment::computeAccelerations()
+{
+    collectMasses();
+    activeSolver().solve(particles.x, particles.y, bodyMass, width, height, GRAVITATIONAL_CONSTANT, accX, accY, pool.get());
+    forceEvaluations += particles.size();
+
+    // These don't line up with the end of a block step, so they can't be reused.
+    accIds.clear();
+}
+
+
+GravitySolver& Environment::activeSolver()
+{
+    switch (solver)
+    {
+        case Solver::BarnesHut:
+            return tree;
+        case Solver::Multipole:
+            return multipole;
+        case Solver::Mesh:
+            if (!mesh.mesh)
+            {
+                mesh.mesh = std::make_unique<ParticleMesh>();
+                mesh.mesh->setShortRange(mesh.shortRange);
+            }
+            return *mesh.mesh;
+        default:
+            return kernel;
+    }
+}
+
+
+void Environment::referenceStep()
+{
+    collectMasses();
+
+    // The front buffer. Particles are only ever pulled towards these positions,
+    // while their new positions are written to the store.
+    frameX = particles.x;
+    frameY = particles.y;
+
+    pool->parallelFor(0, particles.size(), 256, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            if (particles.hasFlag(i, ParticleStore::ATTACKER) || particles.hasFlag(i, ParticleStore::DEAD))
+            {
+                continue;
+            }
+
+            double dvx = 0;
+            double dvy = 0;
+            for (unsigned j = 0; j < particles.size(); ++j)
+            {
+                if (j == i || bodyMass[j] == 0)
+                {
+                    continue;
+                }
+
+                double px;
+                double py;
+                Particle::pullTowards(frameX[j] - frameX[i], frameY[j] - frameY[i], GRAVITATIONAL_CONSTANT, bodyMass[j], px, py, timeStep);
+                dvx += px;
+                dvy += py;
+            }
+
+            particles.move(i, timeStep);
+            if (!particles.hasFlag(i, ParticleStore::FROZEN))
+            {
+                particles.vx[i] += dvx;
+                particles.vy[i] += dvy;
+            }
+            particles.radius[i] = Particle::calcRad(particles.mass[i], particles.density[i]);
+        }
+    });
+}
+
+
+void Environment::step()
+{
+    if (integrator == Integrator::Block)
+    {
+        blockStep();
+        return;
+    }
+
+    if (integrator == Integrator::Leapfrog)
+    {
+        drift(timeStep / 2);
+        computeAccelerations();
+        kick(timeStep);
+        drift(timeStep / 2);
+    }
+    else
+    {
+        computeAccelerations();
+        drift(timeStep);
+        kick(timeStep);
+    }
+}
+
+
+void Environment::blockStep()
+{
+    collectMasses();
+    unsigned n = particles.size();
+    std::uint8_t stationary = ParticleStore::FROZEN | ParticleStore::ATTACKER;
+
+    // The last block step ended with every particle's acceleration computed, but
+    // merges, attackers and anything else since then may have moved particles or
+    // changed their mass. Only the accelerations of particles that are still where
+    // they were, with the same mass, are reused, and anything placed since then
+    // needs one too. The reused ones still don't account for changes to the other
+    // particles. Removing particles only ever moves the others to a lower index, so
+    // going up through the old indices, each acceleration can be moved to its
+    // particle's new index without overwriting one that hasn't been moved yet.
+    accX.resize(std::max<std::size_t>(accX.size(), n));
+    accY.resize(std::max<std::size_t>(accY.size(), n));
+    cached.assign(n, 0);
+    for (unsigned k = 0; k < accIds.size(); ++k)
+    {
+        unsigned i = particles.indexOf(accIds[k]);
+        if (ParticleStore::NONE != i && particles.x[i] == accFromX[k] && particles.y[i] == accFromY[k]
+            && particles.mass[i] == accFromMass[k])
+        {
+            accX[i] = accX[k];
+            accY[i] = accY[k];
+            cached[i] = 1;
+        }
+    }
+
+    active.clear();
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (!cached[i])
+        {
+            active.push_back(i);
+        }
+    }
+    accX.resize(n);
+    accY.resize(n);
+
+    if (!active.empty())
+    {
+        activeSolver().solveFor(particles.x, particles.y, bodyMass, active, width, height, GRAVITATIONAL_CONSTANT, accX, accY, pool.get());
+        forceEvaluations += active.size();
+    }
+
+    stepLevel.resize(n);
+    unsigned maxLevel = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        stepLevel[i] = blockLevel(i);
+        maxLevel = std::max<unsigned>(maxLevel, stepLevel[i]);
+    }
+
+    // The step is split into ticks the size of the smallest block step. A particle
+    // on level l finishes a step every ticks >> l ticks.
+    unsigned ticks = 1u << maxLevel;
+    double tick = timeStep / ticks;
+
+    // The particles are kept sorted by level, with each level starting at
+    // levelStart[level]. Every level finishing a step on a tick is above every level
+    // that isn't, so the particles to kick are always the ones from some level on.
+    // They're the only ones that can change level, and never to a level below that
+    // one, so only they need sorting again.
+    unsigned levelStart[MAX_BLOCK_LEVEL + 2] = {};
+    auto sortLevels = [&](unsigned low) {
+        unsigned begin = levelStart[low];
+        unsigned count[MAX_BLOCK_LEVEL + 2] = {};
+        for (unsigned k = begin; k < n; ++k)
+        {
+            ++count[stepLevel[byLevel[k]]];
+        }
+        for (unsigned level = low; level <= maxLevel + 1; ++level)
+        {
+            levelStart[level] = level == low ? begin : levelStart[level - 1] + count[level - 1];
+        }
+
+        // Copy every level, not just up to maxLevel, so the copy has a fixed size.
+        unsigned next[MAX_BLOCK_LEVEL + 2];
+        std::copy(levelStart, levelStart + MAX_BLOCK_LEVEL + 2, next);
+        for (unsigned k = begin; k < n; ++k)
+        {
+            levelOrder[next[stepLevel[byLevel[k]]]++] = byLevel[k];
+        }
+        std::copy(levelOrder.begin() + begin, levelOrder.begin() + n, byLevel.begin() + begin);
+    };
+
+    byLevel.resize(n);
+    levelOrder.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        byLevel[i] = i;
+    }
+    levelStart[0] = 0;
+    sortLevels(0);
+
+    auto halfKick = [&](unsigned i) {
+        if (!(particles.flags[i] & stationary))
+        {
+            double h = (ticks >> stepLevel[i]) * tick / 2;
+            particles.vx[i] += accX[i] * h;
+            particles.vy[i] += accY[i] * h;
+        }
+    };
+
+    pool->parallelFor(0, n, 4096, [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            halfKick(i);
+        }
+    });
+
+    unsigned drifted = 0;
+    for (unsigned t = 1; t <= ticks; ++t)
+    {
+        // Level l finishes a step when t is a multiple of 2^(maxLevel - l).
+        unsigned low = maxLevel;
+        for (unsigned multiple = t; low > 0 && multiple % 2 == 0; multiple /= 2)
+        {
+            --low;
+        }
+        active.assign(byLevel.begin() + levelStart[low], byLevel.begin() + n);
+        if (active.empty())
+        {
+            continue;
+        }
+
+        // Everything has to be in place before anything is pulled.
+        drift((t - drifted) * tick);
+        drifted = t;
+
+        activeSolver().solveFor(particles.x, particles.y, bodyMass, active, width, height, GRAVITATIONAL_CONSTANT, accX, accY, pool.get());
+        forceEvaluations += active.size();
+
+        pool->parallelFor(0, active.size(), 1024, [&](unsigned begin, unsigned end, unsigned) {
+            for (unsigned a = begin; a < end; ++a)
+            {
+                unsigned i = active[a];
+                halfKick(i);
+
+                if (t == ticks)
+                {
+                    continue;
+                }
+
+                // Start the next step, on a new level if need be. Steps can't go
+                // below one tick, and each one has to start on a multiple of its
+                // own length so it finishes in line with everything else.
+                unsigned level = std::min(blockLevel(i), maxLevel);
+                while (t % (ticks >> level) != 0)
+                {
+                    ++level;
+                }
+                stepLevel[i] = level;
+                halfKick(i);
+            }
+        });
+
+        if (t != ticks)
+        {
+            sortLevels(low);
+        }
+    }
+
+    accIds.resize(n);
+    accFromX.assign(particles.x.begin(), particles.x.end());
+    accFromY.assign(particles.y.begin(), particles.y.end());
+    accFromMass.assign(particles.mass.begin(), particles.mass.end());
+    for (unsigned i = 0; i < n; ++i)
+    {
+        accIds[i] = particles.idAt(i);
+        if (!particles.hasFlag(i, ParticleStore::ATTACKER))
+        {
+            particles.radius[i] = Particle::calcRad(particles.mass[i], particles.density[i]);
+        }
+    }
+}
+
+
+unsigned Environment::blockLevel(unsigned i)
+{
+    double acc = Vec2<double>(accX[i], accY[i]).norm();
+    if (!(acc > 0) || (particles.flags[i] & (ParticleStore::FROZEN | ParticleStore::ATTACKER)))
+    {
+        return 0;
+    }
+
+    // Long enough for the velocity to change by a small fraction, but no shorter
+    // than it takes to fall the same fraction of the particle's own radius from rest.
+    double speed = Vec2<double>(particles.vx[i], particles.vy[i]).norm();
+    double wanted = std::max(BLOCK_ACCURACY * speed / acc, std::sqrt(2 * BLOCK_ACCURACY * particles.radius[i] / acc));
+
+    unsigned level = 0;
+    while (level < MAX_BLOCK_LEVEL && timeStep / (1u << level) > wanted)
+    {
+        ++level;
+    }
+    return level;
+}
+
+
+void Environment::drift(double h)
+{
+    // Attackers move themselves, and frozen particles don't move at all.
+    std::uint8_t stationary = ParticleStore::FROZEN | ParticleStore::ATTACKER;
+
+    pool->parallelFor(0, particles.size(), 4096, [&](unsigned begin, unsigned end, unsigned) {
+        addScaled(particles.x.data(), particles.y.data(), particles.vx.data(), particles.vy.data(), Real(h),
+            particles.flags.data(), stationary, begin, end);
+    });
+}
+
+
+void Environment::kick(double h)
+{
+    std::uint8_t stationary = ParticleStore::FROZEN | ParticleStore::ATTACKER;
+
+    pool->parallelFor(0, particles.size(), 4096, [&](unsigned begin, unsigned end, unsigned) {
+        addScaled(particles.vx.data(), particles.vy.data(), accX.data(), accY.data(), Accum(h),
+            particles.flags.data(), stationary, begin, end);
+
+        for (unsigned i = begin; i < end; ++i)
+        {
+            if (!particles.hasFlag(i, ParticleStore::ATTACKER))
+            {
+                particles.radius[i] = Particle::calcRad(particles.mass[i], particles.density[i]);
+            }
+        }
+    });
+}
+
+
+void Environment::collide()
+{
+    grid.build(particles.x, particles.y, particles.radius);
+
+    nearby.resize(pool->size());
+    contacts.resize(pool->size());
+    for (auto& c : contacts)
+    {
+        c.clear();
+    }
+
+    // Which thread checks which particle changes from run to run, so make room for
+    // the most any of them could need up front. Otherwise a thread's buffer can
+    // grow whenever it happens to pick up a more crowded part of the grid. Leave some
+    // headroom, so particles drifting into a slightly more crowded cell don't grow
+    // them again.
+    for (auto& n : nearby)
+    {
+        if (n.capacity() < grid.maxCandidates())
+        {
+            n.reserve(2 * grid.maxCandidates());
+        }
+    }
+
+    // Find every pair of particles that's touching. This only reads the particles,
+    // and each thread writes to its own lists.
+    pool->parallelFor(0, particles.size(), 1024, [&](unsigned begin, unsigned end, unsigned worker) {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            if (!particles.hasFlag(i, ParticleStore::GRAVITY) || particles.hasFlag(i, ParticleStore::DEAD))
+            {
+                continue;
+            }
+
+            nearby[worker].clear();
+            grid.candidatesFor(i, nearby[worker]);
+
+            for (unsigned j : nearby[worker])
+            {
+                if (particles.hasFlag(j, ParticleStore::GRAVITY) && !particles.hasFlag(j, ParticleStore::DEAD)
+                    && particles.isColliding(i, j))
+                {
+                    contacts[worker].push_back(std::make_pair(i, j));
+                }
+            }
+        }
+    });
+
+    collisions.clear();
+    for (auto& c : contacts)
+    {
+        collisions.insert(collisions.end(), c.begin(), c.end());
+    }
+    std::sort(collisions.begin(), collisions.end());
+
+    // Merging moves and grows particles, so each pair is checked again as it's
+    // merged. Pairs that only start touching because of a merge are caught next frame.
+    for (auto& pair : collisions)
+    {
+        if (!particles.hasFlag(pair.first, ParticleStore::DEAD) && !particles.hasFlag(pair.second, ParticleStore::DEAD))
+        {
+            particles.coalesce(pair.first, pair.second, ELASTICITY_CONSTANT);
+        }
+    }
+}
+
+
+void Environment::explode(unsigned i)
+{
+    Profiler::Scope scope(profiler, Profiler::Phase::Explosions);
+    double oriRad = particles.oriRad[i];
+
+    if (oriRad < 3)
+    {
+        return;
+    }
+
+    // Copy what we need, since placing fragments can reallocate the store.
+    MotionVector<double> vec(particles.vx[i], particles.vy[i]);
+    double fragmentAngle;
+    int fragmentVelocity = 100;
+    int fragmentRadius;
+    double fragmentX;
+    double fragmentY;
+    double xLBound = particles.x[i] - (oriRad / 2);
+    double xHBound = particles.x[i] + (oriRad / 2);
+    double yLBound = particles.y[i] - (oriRad / 2);
+    double yHBound = particles.y[i] + (oriRad / 2);
+
+    for (int f = 0; f < oriRad; ++f)
+    {
+        fragmentAngle = std::fmod(std::rand(), 2 * 3.14);
+        MotionVector<double> fragMot = MotionVector<double>(
+            fragmentVelocity* std::cos(fragmentAngle),
+            fragmentVelocity* std::sin(fragmentAngle)
+        );
+        if (oriRad < 25)
+        {
+            fragmentRadius = 1;
+        }
+        else if (oriRad < 50)
+        {
+            fragmentRadius = 1 + std::rand() % 2;
+        }
+        else
+        {
+            fragmentRadius = 1 + std::rand() % 3;
+        }
+
+        fragmentX = xLBound + std::fmod(std::rand(), xHBound - xLBound);
+        fragmentY = yLBound + std::fmod(std::rand(), yHBound - yLBound);
+
+        LOG_TRACE("Generated (%g, %g)", fragmentX, fragmentY);
+        LOG_TRACE("This is between x: [%g, %g] y: [%g, %g]", xLBound, xHBound, yLBound, yHBound);
+
+        placeParticle(Particle(
+            fragmentRadius,
+            fragmentX,
+            fragmentY,
+            fragMot + vec
+        ));
+    }
+}
+
+
+bool Environment::isOutsideBounds(unsigned i)
 {
     bool outX = false;
     bool outY = false;
+    double x = particles.x[i];
+    double y = particles.y[i];
+    double rad = particles.radius[i];
 
     // Check if outside x bounds.
-    if (p.x() < -p.getRadius() || p.x() > width + p.getRadius())
+    if (x < -rad || x > width + rad)
     {
-        std::cout << "Particle is out of x bounds." << std::endl;
+        LOG_DEBUG("Particle is out of x bounds.");
         outX = true;
     }
 
     // Check if outside y bounds.
-    if (p.y() < -p.getRadius() || p.y() > height + p.getRadius())
+    if (y < -rad || y > height + rad)
     {
-        std::cout << "Particle is out of y bounds." << std::endl;
+        LOG_DEBUG("Particle is out of y bounds.");
         outY = true;
     }
 
@@ -0,0 +1,592 @@
+#include "FastMultipole.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+    // Number of coefficients in an expansion of the maximum order.
+    constexpr unsigned MAX_TERMS = (FastMultipole::MAX_ORDER + 1) * (FastMultipole::MAX_ORDER + 2) / 2;
+
+    // Return a table of 1 / k! for every k an expansion needs.
+    const double* inverseFactorials()
+    {
+        static const std::vector<double> table = [] {
+            std::vector<double> t(FastMultipole::MAX_ORDER + 1, 1);
+            for (unsigned k = 1; k < t.size(); ++k)
+            {
+                t[k] = t[k - 1] / k;
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    // Fill out[k] with v^k / k! for k from 0 to p.
+    void scaledPowers(double v, unsigned p, double* out)
+    {
+        const double* invFact = inverseFactorials();
+        double power = 1;
+        for (unsigned k = 0; k <= p; ++k)
+        {
+            out[k] = power * invFact[k];
+            power *= v;
+        }
+    }
+}
+
+
+FastMultipole::FastMultipole(unsigned order, unsigned leafSize)
+    : leafSize{std::max(leafSize, 1u)}, levels{0}, x0{0}, y0{0}, side{1}
+{
+    setOrder(order);
+}
+
+
+void FastMultipole::solve(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    ax.assign(xs.size(), 0);
+    ay.assign(xs.size(), 0);
+    run(xs, ys, masses, nullptr, width, height, constant, ax, ay, pool);
+}
+
+
+void FastMultipole::solveFor(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>& targets,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    if (ax.size() < xs.size())
+    {
+        ax.resize(xs.size());
+        ay.resize(xs.size());
+    }
+    run(xs, ys, masses, &targets, width, height, constant, ax, ay, pool);
+}
+
+
+void FastMultipole::run(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>* targets,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    unsigned n = xs.size();
+
+    // Find a square that covers the domain and every body.
+    double minX = 0;
+    double minY = 0;
+    double maxX = width;
+    double maxY = height;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        minX = std::min<double>(minX, xs[i]);
+        minY = std::min<double>(minY, ys[i]);
+        maxX = std::max<double>(maxX, xs[i]);
+        maxY = std::max<double>(maxY, ys[i]);
+    }
+
+    x0 = minX;
+    y0 = minY;
+    // Pad the square a little so bodies on the far edges land inside it.
+    side = std::max(std::max(maxX - minX, maxY - minY) * (1 + 1e-9), 1e-9);
+
+    // Split until the leaves hold about leafSize bodies each.
+    levels = 0;
+    while (levels < MAX_LEVELS && (static_cast<unsigned long long>(n) >> (2 * levels)) > leafSize)
+    {
+        ++levels;
+    }
+
+    upward(xs, ys, masses, pool);
+    markNeeded(targets);
+    downward(pool);
+    // The bodies sorted by leaf keep neighbouring bodies together.
+    evaluate(xs, ys, masses, targets ? *targets : sorted, constant, ax, ay, pool);
+}
+
+
+void FastMultipole::setOrder(unsigned p)
+{
+    order = std::min(std::max(p, 1u), MAX_ORDER);
+    terms = (order + 1) * (order + 2) / 2;
+}
+
+
+unsigned FastMultipole::getOrder() const
+{
+    return order;
+}
+
+
+unsigned FastMultipole::getLevels() const
+{
+    return levels;
+}
+
+
+unsigned FastMultipole::term(unsigned a, unsigned b)
+{
+    // Coefficients are grouped by total degree.
+    unsigned degree = a + b;
+    return degree * (degree + 1) / 2 + b;
+}
+
+
+unsigned FastMultipole::levelStart(unsigned level)
+{
+    // 1 + 4 + 16 + ... cells come before this level.
+    return ((1u << (2 * level)) - 1) / 3;
+}
+
+
+void FastMultipole::derivatives(double x, double y, double* d) const
+{
+    // With r^{(k)} standing for 2^k times the k-th derivative of (r^2)^{-1/2} with
+    // respect to r^2, taking a derivative along x gives
+    //   dx^{t+1} dy^u r^{(k)} = t dx^{t-1} dy^u r^{(k+1)} + x dx^t dy^u r^{(k+1)}
+    // and likewise along y. Working down from k = order to k = 0 builds every
+    // derivative of 1 / r we need.
+    double buffers[2][MAX_TERMS];
+    double* higher = buffers[0];
+    double* current = buffers[1];
+
+    double invDistSq = 1 / (x * x + y * y);
+    double invDist = std::sqrt(invDistSq);
+
+    // (-1)^k (2k - 1)!! / r^{2k + 1} for every k.
+    double base[MAX_ORDER + 1];
+    base[0] = invDist;
+    for (unsigned k = 1; k <= order; ++k)
+    {
+        base[k] = -base[k - 1] * (2.0 * k - 1) * invDistSq;
+    }
+
+    for (unsigned k = order + 1; k-- > 0;)
+    {
+        unsigned top = order - k;
+        current[0] = base[k];
+
+        for (unsigned degree = 1; degree <= top; ++degree)
+        {
+            for (unsigned u = 0; u <= degree; ++u)
+            {
+                unsigned t = degree - u;
+                double value;
+                if (t > 0)
+                {
+                    value = x * higher[term(t - 1, u)];
+                    if (t > 1)
+                    {
+                        value += (t - 1) * higher[term(t - 2, u)];
+                    }
+                }
+                else
+                {
+                    value = y * higher[term(0, u - 1)];
+                    if (u > 1)
+                    {
+                        value += (u - 1) * higher[term(0, u - 2)];
+                    }
+                }
+                current[term(t, u)] = value;
+            }
+        }
+
+        std::swap(higher, current);
+    }
+
+    std::copy(higher, higher + terms, d);
+}
+
+
+void FastMultipole::upward(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    ThreadPool* pool
+)
+{
+    unsigned n = xs.size();
+    unsigned dim = 1u << levels;
+    double leafSide = side / dim;
+
+    counts.assign(levelStart(levels + 1), 0);
+    multipoles.resize(counts.size() * terms);
+    locals.resize(counts.size() * terms);
+
+    // Counting sort of the bodies into leaves.
+    unsigned* leafCounts = counts.data() + levelStart(levels);
+    leafOf.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double fx = (xs[i] - x0) / leafSide;
+        double fy = (ys[i] - y0) / leafSide;
+        // Anything that isn't a sensible number goes in the first leaf.
+        unsigned ix = fx >= 0 ? std::min<double>(fx, dim - 1) : 0;
+        unsigned iy = fy >= 0 ? std::min<double>(fy, dim - 1) : 0;
+        leafOf[i] = iy * dim + ix;
+        ++leafCounts[leafOf[i]];
+    }
+
+    // After this, leafStart[l + 1] is where leaf l ends.
+    leafStart.assign(dim * dim + 1, 0);
+    for (unsigned l = 0; l < dim * dim; ++l)
+    {
+        leafStart[l + 1] = leafStart[l] + leafCounts[l];
+    }
+
+    sorted.resize(n);
+    for (unsigned i = n; i-- > 0;)
+    {
+        sorted[--leafStart[leafOf[i] + 1]] = i;
+    }
+
+    // Filling from the end moved each start one leaf early, so shift them back.
+    for (unsigned l = 0; l < dim * dim; ++l)
+    {
+        leafStart[l] = leafStart[l + 1];
+    }
+    leafStart[dim * dim] = n;
+
+    // Expansions of the leaves, straight from their bodies.
+    forEach(pool, 0, dim * dim, 64, [&](unsigned begin, unsigned end, unsigned) {
+        double px[MAX_ORDER + 1];
+        double py[MAX_ORDER + 1];
+
+        for (unsigned l = begin; l < end; ++l)
+        {
+            double* m = multipoles.data() + static_cast<std::size_t>(levelStart(levels) + l) * terms;
+            std::fill(m, m + terms, 0);
+
+            double cx = centerX(levels, l % dim);
+            double cy = centerY(levels, l / dim);
+
+            for (unsigned s = leafStart[l]; s < leafStart[l + 1]; ++s)
+            {
+                unsigned i = sorted[s];
+                if (masses[i] == 0)
+                {
+                    continue;
+                }
+
+                // The expansion is in powers of the center's offset from the body.
+                scaledPowers(cx - xs[i], order, px);
+                scaledPowers(cy - ys[i], order, py);
+                for (unsigned a = 0; a <= order; ++a)
+                {
+                    for (unsigned b = 0; a + b <= order; ++b)
+                    {
+                        m[term(a, b)] += masses[i] * px[a] * py[b];
+                    }
+                }
+            }
+        }
+    });
+
+    // Shift the expansions of each group of four children to their parent's center.
+    for (unsigned level = levels; level-- > 0;)
+    {
+        unsigned parentDim = 1u << level;
+
+        forEach(pool, 0, parentDim * parentDim, 64, [&](unsigned begin, unsigned end, unsigned) {
+            double px[MAX_ORDER + 1];
+            double py[MAX_ORDER + 1];
+
+            for (unsigned c = begin; c < end; ++c)
+            {
+                unsigned cx = c % parentDim;
+                unsigned cy = c / parentDim;
+                unsigned parent = levelStart(level) + c;
+                double* m = multipoles.data() + static_cast<std::size_t>(parent) * terms;
+                std::fill(m, m + terms, 0);
+                counts[parent] = 0;
+
+                for (unsigned k = 0; k < 4; ++k)
+                {
+                    unsigned kx = 2 * cx + (k & 1);
+                    unsigned ky = 2 * cy + (k >> 1);
+                    unsigned child = levelStart(level + 1) + ky * 2 * parentDim + kx;
+                    if (counts[child] == 0)
+                    {
+                        continue;
+                    }
+                    counts[parent] += counts[child];
+
+                    const double* mc = multipoles.data() + static_cast<std::size_t>(child) * terms;
+                    scaledPowers(centerX(level, cx) - centerX(level + 1, kx), order, px);
+                    scaledPowers(centerY(level, cy) - centerY(level + 1, ky), order, py);
+
+                    for (unsigned a = 0; a <= order; ++a)
+                    {
+                        for (unsigned b = 0; a + b <= order; ++b)
+                        {
+                            double sum = 0;
+                            for (unsigned i = 0; i <= a; ++i)
+                            {
+                                for (unsigned j = 0; j <= b; ++j)
+                                {
+                                    sum += mc[term(i, j)] * px[a - i] * py[b - j];
+                                }
+                            }
+                            m[term(a, b)] += sum;
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+
+void FastMultipole::markNeeded(const std::vector<unsigned>* targets)
+{
+    if (nullptr == targets)
+    {
+        needed.resize(counts.size());
+        for (unsigned c = 0; c < counts.size(); ++c)
+        {
+            needed[c] = counts[c] > 0;
+        }
+        return;
+    }
+
+    needed.assign(counts.size(), 0);
+    unsigned leafDim = 1u << levels;
+    for (unsigned i : *targets)
+    {
+        unsigned ix = leafOf[i] % leafDim;
+        unsigned iy = leafOf[i] / leafDim;
+
+        // Walk up until reaching a cell that's already been flagged.
+        for (unsigned level = levels + 1; level-- > 0; ix /= 2, iy /= 2)
+        {
+            unsigned cell = levelStart(level) + (iy << level) + ix;
+            if (needed[cell])
+            {
+                break;
+            }
+            needed[cell] = 1;
+        }
+    }
+}
+
+
+void FastMultipole::downward(ThreadPool* pool)
+{
+    // Nothing is well separated from anything until the cells are a quarter of
+    // the root.
+    std::fill(locals.begin(), locals.begin() + static_cast<std::size_t>(levelStart(std::min(levels, 1u) + 1)) * terms, 0);
+
+    for (unsigned level = 2; level <= levels; ++level)
+    {
+        int dim = 1 << level;
+
+        forEach(pool, 0, dim * dim, 16, [&](unsigned begin, unsigned end, unsigned) {
+            double px[MAX_ORDER + 1];
+            double py[MAX_ORDER + 1];
+            double d[MAX_TERMS];
+
+            for (unsigned c = begin; c < end; ++c)
+            {
+                unsigned cell = levelStart(level) + c;
+                if (!needed[cell])
+                {
+                    continue;
+                }
+
+                int ix = c % dim;
+                int iy = c / dim;
+                double cx = centerX(level, ix);
+                double cy = centerY(level, iy);
+                double* loc = locals.data() + static_cast<std::size_t>(cell) * terms;
+
+                // Start from the parent's local expansion, shifted to this cell's center.
+                unsigned parent = levelStart(level - 1) + (iy / 2) * (dim / 2) + ix / 2;
+                const double* lp = locals.data() + static_cast<std::size_t>(parent) * terms;
+                scaledPowers(cx - centerX(level - 1, ix / 2), order, px);
+                scaledPowers(cy - centerY(level - 1, iy / 2), order, py);
+
+                for (unsigned a = 0; a <= order; ++a)
+                {
+                    for (unsigned b = 0; a + b <= order; ++b)
+                    {
+                        double sum = 0;
+                        for (unsigned i = a; i <= order; ++i)
+                        {
+                            for (unsigned j = b; i + j <= order; ++j)
+                            {
+                                sum += lp[term(i, j)] * px[i - a] * py[j - b];
+                            }
+                        }
+                        loc[term(a, b)] = sum;
+                    }
+                }
+
+                // Add the cells that are children of the parent's neighbours, but
+                // aren't neighbours of this cell.
+                int firstX = std::max(ix / 2 - 1, 0) * 2;
+                int lastX = std::min(ix / 2 + 1, dim / 2 - 1) * 2 + 1;
+                int firstY = std::max(iy / 2 - 1, 0) * 2;
+                int lastY = std::min(iy / 2 + 1, dim / 2 - 1) * 2 + 1;
+
+                for (int sy = firstY; sy <= lastY; ++sy)
+                {
+                    for (int sx = firstX; sx <= lastX; ++sx)
+                    {
+                        unsigned source = levelStart(level) + sy * dim + sx;
+                        if (std::abs(sx - ix) <= 1 && std::abs(sy - iy) <= 1)
+                        {
+                            continue;
+                        }
+                        if (counts[source] == 0)
+                        {
+                            continue;
+                        }
+
+                        const double* m = multipoles.data() + static_cast<std::size_t>(source) * terms;
+                        derivatives(cx - centerX(level, sx), cy - centerY(level, sy), d);
+
+                        for (unsigned a = 0; a <= order; ++a)
+                        {
+                            for (unsigned b = 0; a + b <= order; ++b)
+                            {
+                                double sum = 0;
+                                for (unsigned i = 0; a + b + i <= order; ++i)
+                                {
+                                    for (unsigned j = 0; a + b + i + j <= order; ++j)
+                                    {
+                                        sum += m[term(i, j)] * d[term(a + i, b + j)];
+                                    }
+                                }
+                                loc[term(a, b)] += sum;
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+
+void FastMultipole::evaluate(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>& targets,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+) const
+{
+    int dim = 1 << levels;
+
+    // Each target is only listed once, so threads never write to the same body.
+    forEach(pool, 0, targets.size(), 256, [&](unsigned begin, unsigned end, unsigned) {
+        double px[MAX_ORDER + 1];
+        double py[MAX_ORDER + 1];
+
+        for (unsigned t = begin; t < end; ++t)
+        {
+            unsigned i = targets[t];
+            unsigned l = leafOf[i];
+            int ix = l % dim;
+            int iy = l / dim;
+            const double* loc = locals.data() + static_cast<std::size_t>(levelStart(levels) + l) * terms;
+
+            // The far field is the gradient of the local expansion.
+            double fx = 0;
+            double fy = 0;
+            scaledPowers(xs[i] - centerX(levels, ix), order - 1, px);
+            scaledPowers(ys[i] - centerY(levels, iy), order - 1, py);
+            for (unsigned a = 0; a < order; ++a)
+            {
+                for (unsigned b = 0; a + b < order; ++b)
+                {
+                    double p = px[a] * py[b];
+                    fx += loc[term(a + 1, b)] * p;
+                    fy += loc[term(a, b + 1)] * p;
+                }
+            }
+
+            // The near field is summed exactly.
+            double nx = 0;
+            double ny = 0;
+            for (int ny0 = std::max(iy - 1, 0); ny0 <= std::min(iy + 1, dim - 1); ++ny0)
+            {
+                for (int nx0 = std::max(ix - 1, 0); nx0 <= std::min(ix + 1, dim - 1); ++nx0)
+                {
+                    unsigned neighbour = ny0 * dim + nx0;
+                    for (unsigned s = leafStart[neighbour]; s < leafStart[neighbour + 1]; ++s)
+                    {
+                        unsigned j = sorted[s];
+                        double dx = xs[j] - xs[i];
+                        double dy = ys[j] - ys[i];
+                        double distSq = dx * dx + dy * dy;
+                        if (distSq > 0)
+                        {
+                            double scale = masses[j] / (distSq * std::sqrt(distSq));
+                            nx += dx * scale;
+                            ny += dy * scale;
+                        }
+                    }
+                }
+            }
+
+            ax[i] = constant * (fx + nx);
+            ay[i] = constant * (fy + ny);
+        }
+    });
+}
+
+
+double FastMultipole::centerX(unsigned level, unsigned ix) const
+{
+    return x0 + (ix + 0.5) * side / (1u << level);
+}
+
+
+double FastMultipole::centerY(unsigned level, unsigned iy) const
+{
+    return y0 + (iy + 0.5) * side / (1u << level);
+}
+
+
+void FastMultipole::forEach(ThreadPool* pool, unsigned begin, unsigned end, unsigned grain, const ThreadPool::RangeTask& body)
+{
+    if (pool)
+    {
+        pool->parallelFor(begin, end, grain, body);
+    }
+    else
+    {
+        body(begin, end, 0);
+    }
+}
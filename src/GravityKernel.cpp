@@ -0,0 +1,272 @@
+#include "GravityKernel.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+GravityKernel::GravityKernel()
+    : variant{Variant::Scalar}, deterministic{false}, row{gravityRowScalar}, gather{gravityGatherScalar}
+{
+    setVariant(best());
+}
+
+
+void GravityKernel::computeAccelerations(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+) const
+{
+    unsigned n = xs.size();
+
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    if (deterministic || (nullptr != pool && pool->size() > 1))
+    {
+        // Each chunk is a tile of rows, which is swept across every tile of columns.
+        // Every row is summed in the same order however the rows are split up.
+        auto rows = [&](unsigned begin, unsigned end, unsigned) {
+            for (unsigned tileJ = 0; tileJ < n; tileJ += TILE)
+            {
+                unsigned endJ = std::min(tileJ + TILE, n);
+
+                for (unsigned i = begin; i < end; ++i)
+                {
+                    gather(xs.data(), ys.data(), masses.data(), ax.data(), ay.data(), i, tileJ, endJ, constant);
+                }
+            }
+        };
+
+        if (nullptr != pool)
+        {
+            pool->parallelFor(0, n, TILE, rows);
+        }
+        else
+        {
+            rows(0, n, 0);
+        }
+        return;
+    }
+
+    // Only pairs (i, j) with i < j are visited. A tile against itself covers the
+    // upper triangle, and a tile against a later tile covers the whole block.
+    for (unsigned tileI = 0; tileI < n; tileI += TILE)
+    {
+        unsigned endI = std::min(tileI + TILE, n);
+
+        for (unsigned tileJ = tileI; tileJ < n; tileJ += TILE)
+        {
+            unsigned endJ = std::min(tileJ + TILE, n);
+
+            for (unsigned i = tileI; i < endI; ++i)
+            {
+                unsigned begin = tileJ == tileI ? i + 1 : tileJ;
+                row(xs.data(), ys.data(), masses.data(), ax.data(), ay.data(), i, begin, endJ, constant);
+            }
+        }
+    }
+}
+
+
+void GravityKernel::solve(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double,
+    double,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    computeAccelerations(xs, ys, masses, constant, ax, ay, pool);
+}
+
+
+void GravityKernel::solveFor(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>& targets,
+    double,
+    double,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    unsigned n = xs.size();
+
+    if (ax.size() < n)
+    {
+        ax.resize(n);
+        ay.resize(n);
+    }
+
+    auto rows = [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned t = begin; t < end; ++t)
+        {
+            unsigned i = targets[t];
+            ax[i] = 0;
+            ay[i] = 0;
+
+            for (unsigned tileJ = 0; tileJ < n; tileJ += TILE)
+            {
+                gather(xs.data(), ys.data(), masses.data(), ax.data(), ay.data(), i, tileJ, std::min(tileJ + TILE, n), constant);
+            }
+        }
+    };
+
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, targets.size(), 64, rows);
+    }
+    else
+    {
+        rows(0, targets.size(), 0);
+    }
+}
+
+
+void GravityKernel::setDeterministic(bool on)
+{
+    deterministic = on;
+}
+
+
+bool GravityKernel::isDeterministic() const
+{
+    return deterministic;
+}
+
+
+bool GravityKernel::setVariant(Variant v)
+{
+    if (!isSupported(v))
+    {
+        return false;
+    }
+
+    variant = v;
+
+    switch (v)
+    {
+        case Variant::Avx512:
+            row = gravityRowAvx512;
+            gather = gravityGatherAvx512;
+            break;
+        case Variant::Avx2:
+            row = gravityRowAvx2;
+            gather = gravityGatherAvx2;
+            break;
+        default:
+            row = gravityRowScalar;
+            gather = gravityGatherScalar;
+            break;
+    }
+
+    return true;
+}
+
+
+GravityKernel::Variant GravityKernel::getVariant() const
+{
+    return variant;
+}
+
+
+bool GravityKernel::isSupported(Variant v)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    switch (v)
+    {
+        case Variant::Avx512:
+            return __builtin_cpu_supports("avx512f");
+        case Variant::Avx2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default:
+            return true;
+    }
+#else
+    return v == Variant::Scalar;
+#endif
+}
+
+
+GravityKernel::Variant GravityKernel::best()
+{
+    if (isSupported(Variant::Avx512))
+    {
+        return Variant::Avx512;
+    }
+    if (isSupported(Variant::Avx2))
+    {
+        return Variant::Avx2;
+    }
+    return Variant::Scalar;
+}
+
+
+void gravityRowScalar(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    Accum xi = x[i];
+    Accum yi = y[i];
+    Accum mi = m[i];
+    Accum aix = 0;
+    Accum aiy = 0;
+
+    for (unsigned j = begin; j < end; ++j)
+    {
+        Accum dx = x[j] - xi;
+        Accum dy = y[j] - yi;
+        Accum distSq = dx * dx + dy * dy;
+
+        if (distSq > 0)
+        {
+            // G / r^3, so that multiplying by dx and dy also normalizes the direction.
+            Accum scale = Accum(constant) / (distSq * std::sqrt(distSq));
+            aix += m[j] * scale * dx;
+            aiy += m[j] * scale * dy;
+            ax[j] -= mi * scale * dx;
+            ay[j] -= mi * scale * dy;
+        }
+    }
+
+    ax[i] += aix;
+    ay[i] += aiy;
+}
+
+
+void gravityGatherScalar(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    Accum xi = x[i];
+    Accum yi = y[i];
+    Accum aix = 0;
+    Accum aiy = 0;
+
+    for (unsigned j = begin; j < end; ++j)
+    {
+        Accum dx = x[j] - xi;
+        Accum dy = y[j] - yi;
+        Accum distSq = dx * dx + dy * dy;
+
+        // This also skips body i itself.
+        if (distSq > 0)
+        {
+            Accum scale = Accum(constant) / (distSq * std::sqrt(distSq));
+            aix += m[j] * scale * dx;
+            aiy += m[j] * scale * dy;
+        }
+    }
+
+    ax[i] += aix;
+    ay[i] += aiy;
+}
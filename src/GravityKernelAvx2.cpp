@@ -0,0 +1,173 @@
+#include "GravityKernel.hpp"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+// Load four values as doubles. The mixed build stores positions and masses as floats.
+__attribute__((target("avx2,fma")))
+static inline __m256d load4(const double* p)
+{
+    return _mm256_loadu_pd(p);
+}
+
+
+__attribute__((target("avx2,fma")))
+static inline __m256d load4(const float* p)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+
+// This is compiled for AVX2 regardless of the flags the rest of the program is
+// built with. GravityKernel only calls it if the CPU supports AVX2. When symmetric
+// is true, the pull is applied to body j as well as body i.
+//
+// The double and mixed builds sum in double, four pairs at a time.
+template <bool symmetric, typename T>
+__attribute__((target("avx2,fma")))
+static void rowAvx2(const T* x, const T* y, const T* m, double* ax, double* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    __m256d xi = _mm256_set1_pd(x[i]);
+    __m256d yi = _mm256_set1_pd(y[i]);
+    __m256d mi = _mm256_set1_pd(m[i]);
+    __m256d g = _mm256_set1_pd(constant);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d aix = zero;
+    __m256d aiy = zero;
+
+    unsigned j = begin;
+    for (; j + 4 <= end; j += 4)
+    {
+        __m256d dx = _mm256_sub_pd(load4(x + j), xi);
+        __m256d dy = _mm256_sub_pd(load4(y + j), yi);
+        __m256d distSq = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+
+        // G / r^3, zeroed for bodies on top of body i.
+        __m256d scale = _mm256_div_pd(g, _mm256_mul_pd(distSq, _mm256_sqrt_pd(distSq)));
+        scale = _mm256_and_pd(scale, _mm256_cmp_pd(distSq, zero, _CMP_GT_OQ));
+
+        __m256d sdx = _mm256_mul_pd(scale, dx);
+        __m256d sdy = _mm256_mul_pd(scale, dy);
+        __m256d mj = load4(m + j);
+
+        aix = _mm256_fmadd_pd(mj, sdx, aix);
+        aiy = _mm256_fmadd_pd(mj, sdy, aiy);
+
+        // Body j is pulled back towards body i.
+        if (symmetric)
+        {
+            _mm256_storeu_pd(ax + j, _mm256_fnmadd_pd(mi, sdx, _mm256_loadu_pd(ax + j)));
+            _mm256_storeu_pd(ay + j, _mm256_fnmadd_pd(mi, sdy, _mm256_loadu_pd(ay + j)));
+        }
+    }
+
+    // Whatever doesn't fill a whole vector is done one body at a time.
+    if (symmetric)
+    {
+        gravityRowScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+    else
+    {
+        gravityGatherScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+
+    double sums[4];
+    _mm256_storeu_pd(sums, aix);
+    ax[i] += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    _mm256_storeu_pd(sums, aiy);
+    ay[i] += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+
+#ifdef GRAVSIM_FLOAT
+
+// The float build works out and sums everything in float, eight pairs at a time.
+template <bool symmetric>
+__attribute__((target("avx2,fma")))
+static void rowAvx2(const float* x, const float* y, const float* m, float* ax, float* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    __m256 xi = _mm256_set1_ps(x[i]);
+    __m256 yi = _mm256_set1_ps(y[i]);
+    __m256 mi = _mm256_set1_ps(m[i]);
+    __m256 g = _mm256_set1_ps(constant);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 aix = zero;
+    __m256 aiy = zero;
+
+    unsigned j = begin;
+    for (; j + 8 <= end; j += 8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+        __m256 distSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+
+        __m256 scale = _mm256_div_ps(g, _mm256_mul_ps(distSq, _mm256_sqrt_ps(distSq)));
+        scale = _mm256_and_ps(scale, _mm256_cmp_ps(distSq, zero, _CMP_GT_OQ));
+
+        __m256 sdx = _mm256_mul_ps(scale, dx);
+        __m256 sdy = _mm256_mul_ps(scale, dy);
+        __m256 mj = _mm256_loadu_ps(m + j);
+
+        aix = _mm256_fmadd_ps(mj, sdx, aix);
+        aiy = _mm256_fmadd_ps(mj, sdy, aiy);
+
+        if (symmetric)
+        {
+            _mm256_storeu_ps(ax + j, _mm256_fnmadd_ps(mi, sdx, _mm256_loadu_ps(ax + j)));
+            _mm256_storeu_ps(ay + j, _mm256_fnmadd_ps(mi, sdy, _mm256_loadu_ps(ay + j)));
+        }
+    }
+
+    if (symmetric)
+    {
+        gravityRowScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+    else
+    {
+        gravityGatherScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+
+    float sums[8];
+    _mm256_storeu_ps(sums, aix);
+    ax[i] += ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+    _mm256_storeu_ps(sums, aiy);
+    ay[i] += ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+}
+
+#endif
+
+
+void gravityRowAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    rowAvx2<true>(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+
+void gravityGatherAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    rowAvx2<false>(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+#else
+
+void gravityRowAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    gravityRowScalar(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+
+void gravityGatherAvx2(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    gravityGatherScalar(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "GravityKernel.hpp"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+// Load eight values as doubles. The mixed build stores positions and masses as floats.
+// The zero-masked conversion is used because GCC warns about the undefined vector the
+// unmasked one starts from.
+__attribute__((target("avx512f")))
+static inline __m512d load8(const double* p)
+{
+    return _mm512_loadu_pd(p);
+}
+
+
+__attribute__((target("avx512f")))
+static inline __m512d load8(const float* p)
+{
+    return _mm512_maskz_cvtps_pd(0xFF, _mm256_loadu_ps(p));
+}
+
+
+// This is compiled for AVX-512 regardless of the flags the rest of the program is
+// built with. GravityKernel only calls it if the CPU supports AVX-512. When symmetric
+// is true, the pull is applied to body j as well as body i.
+//
+// The double and mixed builds sum in double, eight pairs at a time.
+template <bool symmetric, typename T>
+__attribute__((target("avx512f")))
+static void rowAvx512(const T* x, const T* y, const T* m, double* ax, double* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    __m512d xi = _mm512_set1_pd(x[i]);
+    __m512d yi = _mm512_set1_pd(y[i]);
+    __m512d mi = _mm512_set1_pd(m[i]);
+    __m512d g = _mm512_set1_pd(constant);
+    __m512d zero = _mm512_setzero_pd();
+    __m512d aix = zero;
+    __m512d aiy = zero;
+
+    unsigned j = begin;
+    for (; j + 8 <= end; j += 8)
+    {
+        __m512d dx = _mm512_sub_pd(load8(x + j), xi);
+        __m512d dy = _mm512_sub_pd(load8(y + j), yi);
+        __m512d distSq = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+
+        // G / r^3, zeroed for bodies on top of body i.
+        __mmask8 apart = _mm512_cmp_pd_mask(distSq, zero, _CMP_GT_OQ);
+        __m512d dist = _mm512_maskz_sqrt_pd(apart, distSq);
+        __m512d scale = _mm512_maskz_div_pd(apart, g, _mm512_mul_pd(distSq, dist));
+
+        __m512d sdx = _mm512_mul_pd(scale, dx);
+        __m512d sdy = _mm512_mul_pd(scale, dy);
+        __m512d mj = load8(m + j);
+
+        aix = _mm512_fmadd_pd(mj, sdx, aix);
+        aiy = _mm512_fmadd_pd(mj, sdy, aiy);
+
+        // Body j is pulled back towards body i.
+        if (symmetric)
+        {
+            _mm512_storeu_pd(ax + j, _mm512_fnmadd_pd(mi, sdx, _mm512_loadu_pd(ax + j)));
+            _mm512_storeu_pd(ay + j, _mm512_fnmadd_pd(mi, sdy, _mm512_loadu_pd(ay + j)));
+        }
+    }
+
+    // Whatever doesn't fill a whole vector is done one body at a time.
+    if (symmetric)
+    {
+        gravityRowScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+    else
+    {
+        gravityGatherScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+
+    double sums[8];
+    _mm512_storeu_pd(sums, aix);
+    ax[i] += ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+    _mm512_storeu_pd(sums, aiy);
+    ay[i] += ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+}
+
+
+#ifdef GRAVSIM_FLOAT
+
+// Add up the sixteen lanes in a fixed order. This is compiled for AVX-512 too, since
+// mixing in SSE code while the vector registers are in use is slow.
+__attribute__((target("avx512f")))
+static inline float sum16(const float* s)
+{
+    float lo = ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+    float hi = ((s[8] + s[9]) + (s[10] + s[11])) + ((s[12] + s[13]) + (s[14] + s[15]));
+    return lo + hi;
+}
+
+
+// The float build works out and sums everything in float, sixteen pairs at a time.
+template <bool symmetric>
+__attribute__((target("avx512f")))
+static void rowAvx512(const float* x, const float* y, const float* m, float* ax, float* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    __m512 xi = _mm512_set1_ps(x[i]);
+    __m512 yi = _mm512_set1_ps(y[i]);
+    __m512 mi = _mm512_set1_ps(m[i]);
+    __m512 g = _mm512_set1_ps(constant);
+    __m512 zero = _mm512_setzero_ps();
+    __m512 aix = zero;
+    __m512 aiy = zero;
+
+    unsigned j = begin;
+    for (; j + 16 <= end; j += 16)
+    {
+        __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), xi);
+        __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), yi);
+        __m512 distSq = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+
+        __mmask16 apart = _mm512_cmp_ps_mask(distSq, zero, _CMP_GT_OQ);
+        __m512 dist = _mm512_maskz_sqrt_ps(apart, distSq);
+        __m512 scale = _mm512_maskz_div_ps(apart, g, _mm512_mul_ps(distSq, dist));
+
+        __m512 sdx = _mm512_mul_ps(scale, dx);
+        __m512 sdy = _mm512_mul_ps(scale, dy);
+        __m512 mj = _mm512_loadu_ps(m + j);
+
+        aix = _mm512_fmadd_ps(mj, sdx, aix);
+        aiy = _mm512_fmadd_ps(mj, sdy, aiy);
+
+        if (symmetric)
+        {
+            _mm512_storeu_ps(ax + j, _mm512_fnmadd_ps(mi, sdx, _mm512_loadu_ps(ax + j)));
+            _mm512_storeu_ps(ay + j, _mm512_fnmadd_ps(mi, sdy, _mm512_loadu_ps(ay + j)));
+        }
+    }
+
+    if (symmetric)
+    {
+        gravityRowScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+    else
+    {
+        gravityGatherScalar(x, y, m, ax, ay, i, j, end, constant);
+    }
+
+    float sums[16];
+    _mm512_storeu_ps(sums, aix);
+    ax[i] += sum16(sums);
+    _mm512_storeu_ps(sums, aiy);
+    ay[i] += sum16(sums);
+}
+
+#endif
+
+
+void gravityRowAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    rowAvx512<true>(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+
+void gravityGatherAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    rowAvx512<false>(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+#else
+
+void gravityRowAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    gravityRowScalar(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+
+void gravityGatherAvx512(const Real* x, const Real* y, const Real* m, Accum* ax, Accum* ay,
+    unsigned i, unsigned begin, unsigned end, double constant)
+{
+    gravityGatherScalar(x, y, m, ax, ay, i, begin, end, constant);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "GravitySolver.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+double GravitySolver::sampleError(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double constant,
+    const std::vector<Accum>& ax,
+    const std::vector<Accum>& ay,
+    unsigned samples
+)
+{
+    unsigned n = xs.size();
+    samples = std::min(samples, n);
+
+    double sumSq = 0;
+    unsigned counted = 0;
+
+    for (unsigned s = 0; s < samples; ++s)
+    {
+        unsigned i = static_cast<unsigned long long>(s) * n / samples;
+
+        double exactX = 0;
+        double exactY = 0;
+        for (unsigned j = 0; j < n; ++j)
+        {
+            double dx = xs[j] - xs[i];
+            double dy = ys[j] - ys[i];
+            double distSq = dx * dx + dy * dy;
+            if (distSq > 0)
+            {
+                double scale = constant * masses[j] / (distSq * std::sqrt(distSq));
+                exactX += dx * scale;
+                exactY += dy * scale;
+            }
+        }
+
+        double exact = std::hypot(exactX, exactY);
+        if (exact > 0)
+        {
+            double err = std::hypot(ax[i] - exactX, ay[i] - exactY) / exact;
+            sumSq += err * err;
+            ++counted;
+        }
+    }
+
+    return counted > 0 ? std::sqrt(sumSq / counted) : 0;
+}
@@ -0,0 +1,221 @@
+#include "InputLog.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "Log.hpp"
+
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Input logs are only supported on little-endian machines.");
+static_assert(sizeof(InputLog::Header) == 48, "Input log header has padding.");
+static_assert(sizeof(InputLog::Event) == 56, "Input log event has padding.");
+
+
+namespace
+{
+    const char MAGIC[8] = {'G', 'R', 'A', 'V', 'I', 'N', 'P', 'T'};
+}
+
+
+InputLog::~InputLog()
+{
+    if (file)
+    {
+        std::fclose(file);
+    }
+}
+
+
+Environment InputLog::start(const Header& header)
+{
+    std::srand(header.seed);
+
+    Environment env(header.particles);
+    env.setSolver(static_cast<Environment::Solver>(header.solver));
+    env.setIntegrator(static_cast<Environment::Integrator>(header.integrator));
+    env.setDeterministic(header.deterministic != 0);
+    env.setThreads(header.threads);
+    env.setTimeStep(header.timeStep);
+    return env;
+}
+
+
+InputLog::Header InputLog::headerFor(Environment& env, std::uint32_t seed, std::uint32_t particles)
+{
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.seed = seed;
+    header.particles = particles;
+    header.solver = static_cast<std::uint32_t>(env.getSolver());
+    header.integrator = static_cast<std::uint32_t>(env.getIntegrator());
+    header.deterministic = env.isDeterministic();
+    header.threads = env.getThreads();
+    header.timeStep = env.getTimeStep();
+    return header;
+}
+
+
+bool InputLog::record(const char* path, const Header& header)
+{
+    if (file)
+    {
+        std::fclose(file);
+    }
+
+    file = std::fopen(path, "wb");
+    if (nullptr == file)
+    {
+        LOG_ERROR("Couldn't open %s to record input: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fflush(file);
+    return true;
+}
+
+
+void InputLog::stop(std::uint64_t steps)
+{
+    if (nullptr == file)
+    {
+        return;
+    }
+
+    Event end{steps, Action::End, 0, 0, 0, 0, 0, 0};
+    std::fwrite(&end, sizeof(end), 1, file);
+    if (0 != std::fclose(file))
+    {
+        LOG_ERROR("Couldn't finish writing the input log");
+    }
+    file = nullptr;
+}
+
+
+bool InputLog::isRecording() const
+{
+    return nullptr != file;
+}
+
+
+void InputLog::apply(Environment& env, const Event& event)
+{
+    if (file)
+    {
+        // Actions are rare, so each one is flushed straight away, and a session that
+        // crashes can still be replayed up to the crash.
+        std::fwrite(&event, sizeof(event), 1, file);
+        std::fflush(file);
+    }
+
+    perform(env, event);
+}
+
+
+void InputLog::perform(Environment& env, const Event& event)
+{
+    switch (event.action)
+    {
+        case Action::PlaceParticle:
+            env.placeParticle(Particle(event.radius, event.x, event.y, MotionVector<double>(event.vx, event.vy)));
+            break;
+        case Action::ToggleFreeze:
+        {
+            ParticleStore& particles = env.getParticles();
+            unsigned i = particles.indexOf(env.findParticle(event.x, event.y));
+            if (ParticleStore::NONE == i)
+            {
+                break;
+            }
+
+            if (particles.hasFlag(i, ParticleStore::FROZEN))
+            {
+                particles.unFreeze(i);
+            }
+            else
+            {
+                particles.freeze(i);
+            }
+            break;
+        }
+        case Action::PlaceAttacker:
+            env.placeAttacker(event.x, event.y);
+            break;
+        default:
+            break;
+    }
+}
+
+
+void InputLog::replay(Environment& env, const std::vector<Event>& events)
+{
+    std::uint64_t steps = events.empty() ? 0 : events.back().step;
+    std::size_t next = 0;
+
+    for (std::uint64_t step = 0; step <= steps; ++step)
+    {
+        while (next < events.size() && events[next].step == step)
+        {
+            perform(env, events[next++]);
+        }
+
+        if (step < steps)
+        {
+            env.update();
+            env.getProfiler().endFrame();
+        }
+    }
+}
+
+
+bool InputLog::load(const char* path, Header& header, std::vector<Event>& events)
+{
+    std::FILE* in = std::fopen(path, "rb");
+    if (nullptr == in)
+    {
+        LOG_ERROR("Couldn't open the input log %s: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    if (std::fread(&header, sizeof(header), 1, in) != 1 || 0 != std::memcmp(header.magic, MAGIC, sizeof(MAGIC)))
+    {
+        LOG_ERROR("%s isn't an input log", path);
+        std::fclose(in);
+        return false;
+    }
+    if (VERSION != header.version)
+    {
+        LOG_ERROR("%s is a version %u input log, but only version %u can be read", path, header.version, VERSION);
+        std::fclose(in);
+        return false;
+    }
+    if (header.solver > static_cast<std::uint32_t>(Environment::Solver::Mesh)
+        || header.integrator > static_cast<std::uint32_t>(Environment::Integrator::Block)
+        || 0 == header.threads || !(header.timeStep > 0))
+    {
+        LOG_ERROR("The input log %s has bad settings", path);
+        std::fclose(in);
+        return false;
+    }
+
+    events.clear();
+    Event event;
+    while (std::fread(&event, sizeof(event), 1, in) == 1)
+    {
+        // Events are always in order, so anything else means the file is corrupt.
+        if (event.action > Action::End || (!events.empty() && event.step < events.back().step))
+        {
+            LOG_ERROR("The input log %s is corrupt after %zu events", path, events.size());
+            std::fclose(in);
+            return false;
+        }
+        events.push_back(event);
+    }
+    std::fclose(in);
+
+    if (events.empty() || Action::End != events.back().action)
+    {
+        LOG_WARN("%s was cut short, so it will only be replayed up to its last action", path);
+    }
+    return true;
+}
@@ -0,0 +1,188 @@
+#include "Log.hpp"
+#include <chrono>
+#include <cstdarg>
+
+
+Log::Log()
+{
+    for (unsigned i = 0; i < CAPACITY; ++i)
+    {
+        records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writer = std::thread(&Log::drain, this);
+}
+
+
+Log::~Log()
+{
+    stop.store(true);
+    wake();
+    writer.join();
+}
+
+
+Log& Log::instance()
+{
+    static Log log;
+    return log;
+}
+
+
+void Log::write(LogLevel level, const char* format, ...)
+{
+    Log& log = instance();
+
+    // Claim the next position, unless the reader hasn't finished with the record
+    // that's there from the last time around the ring.
+    unsigned long long pos = log.head.load(std::memory_order_relaxed);
+    Record* record;
+    while (true)
+    {
+        record = &log.records[pos % CAPACITY];
+        unsigned long long sequence = record->sequence.load(std::memory_order_acquire);
+
+        if (sequence == pos)
+        {
+            if (log.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (sequence < pos)
+        {
+            log.droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = log.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    record->level = level;
+    std::va_list args;
+    va_start(args, format);
+    std::vsnprintf(record->text, MESSAGE_SIZE, format, args);
+    va_end(args);
+
+    // Hand the record over to the reader. The fence pairs with the one in drain, so
+    // either this sees the reader asleep or the reader sees this record.
+    record->sequence.store(pos + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (log.sleeping.load(std::memory_order_relaxed))
+    {
+        log.wake();
+    }
+}
+
+
+void Log::flush()
+{
+    Log& log = instance();
+    unsigned long long written = log.head.load();
+    while (log.tail.load() < written)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+void Log::setOutput(std::FILE* file)
+{
+    flush();
+    instance().output.store(file);
+}
+
+
+unsigned long long Log::dropped()
+{
+    return instance().droppedCount.load(std::memory_order_relaxed);
+}
+
+
+const char* Log::levelName(LogLevel level)
+{
+    switch (level)
+    {
+        case LogLevel::Trace:
+            return "trace";
+        case LogLevel::Debug:
+            return "debug";
+        case LogLevel::Info:
+            return "info";
+        case LogLevel::Warn:
+            return "warn";
+        default:
+            return "error";
+    }
+}
+
+
+void Log::drain()
+{
+    while (!stop.load())
+    {
+        if (0 != writeReady())
+        {
+            continue;
+        }
+
+        // Go to sleep, unless a record was added before anyone could see that this
+        // thread was asleep.
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        unsigned long long pos = tail.load(std::memory_order_relaxed);
+        if (records[pos % CAPACITY].sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            woken.wait(lock, [this]() { return !sleeping.load() || stop.load(); });
+        }
+        sleeping.store(false);
+    }
+
+    // Anything logged before the log was destroyed still gets written.
+    writeReady();
+}
+
+
+void Log::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleeping.store(false);
+    }
+    woken.notify_one();
+}
+
+
+unsigned Log::writeReady()
+{
+    std::FILE* file = output.load();
+    unsigned long long pos = tail.load(std::memory_order_relaxed);
+    unsigned count = 0;
+
+    while (true)
+    {
+        Record& record = records[pos % CAPACITY];
+        if (record.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            break;
+        }
+
+        std::fprintf(file, "[%s] %s\n", levelName(record.level), record.text);
+
+        // The record can be written to again on the next time around the ring.
+        record.sequence.store(pos + CAPACITY, std::memory_order_release);
+        ++pos;
+        ++count;
+    }
+
+    if (count > 0)
+    {
+        std::fflush(file);
+        tail.store(pos);
+    }
+
+    return count;
+}
@@ -1,4 +1,5 @@
 #include "Particle.hpp"
+#include "Log.hpp"
 
 
 Particle::Particle(
@@ -6,15 +7,14 @@ Particle::Particle(
     double x,
     double y,
     MotionVector<double> vec,
-    SDL_Color col,
+    Color col,
     bool gravity,
     double density
 )
     : rad{radius},
     oriRad{radius},
-    x_pos{x},
-    y_pos{y},
-    vec{vec},
+    pos{x, y},
+    vel{vec.vec()},
     density{density},
     absorbed{false},
     fixed{false},
@@ -24,85 +24,60 @@ Particle::Particle(
     mass = calcMass(radius, density);
     oriMass = mass;
 
-
-    std::cout << "Particle created with mass " << mass << " kg." << std::endl;
+    LOG_TRACE("Particle created with mass %g kg.", mass);
 }
 
 
 double Particle::x()
 {
-    return x_pos;
+    return pos.x;
 }
 
 
 double Particle::y()
 {
-    return y_pos;
+    return pos.y;
 }
 
 
-void Particle::update(std::list<Particle*>& particles)
-{
-    move();
-    rad = calcRad(mass, density);
-    for (Particle* p : particles)
-    {
-        if (p != this && p->hasGravity())
-        {
-            accelerateTowards(p->x(), p->y(), GRAVITATIONAL_CONSTANT, p->getMass());
-            coalesce(*p, ELASTICITY_CONSTANT);
-        }
-    }
-}
-
-
-void Particle::move()
+void Particle::move(double dt)
 {
     if (fixed)
     {
         return;
     }
-    
-    // Get the angle and magnitude of this particle's motion vector.
-    double vec_angle = vec.angle();
-    double vec_mag = vec.magnitude();
-
-    // Calculate the amount that this particle will travel in both the x and y direction.
-    double dx = vec_mag * std::cos(vec_angle);
-    double dy = vec_mag * std::sin(vec_angle);
-
-    // Move the particle by the calculated amounts.
-    x_pos += dx * (1.0 / 60.0);
-    y_pos += dy * (1.0 / 60.0);
+
+    pos.addScaled(vel, dt);
 }
 
 
-void Particle::accelerateTowards(double x, double y, double constant, double pointMass)
+void Particle::accelerateTowards(double x, double y, double constant, double pointMass, double dt)
 {
     if (fixed)
     {
         return;
     }
 
-    double dx = x - x_pos;
-    double dy = y - y_pos;
-    double dist = std::hypot(dx, dy);
+    Vec2<double> deltaVel;
+    pullTowards(x - pos.x, y - pos.y, constant, pointMass, deltaVel.x, deltaVel.y, dt);
 
-    double angleBetweenPoints = std::atan2(dy, dx);
+    // Add the change in velocity to this particle's velocity.
+    vel += deltaVel;
+}
 
-    // The gravitational equation.
-    // This calculated force will be the magnitude of the vector that we'll add to this
-    // particle's existing motion vector, simulating an acceleration towards the point.
-    double force = (constant * mass * pointMass) / std::pow(dist, 2);
-    double acceleration = force / mass;
-    double deltaVel = acceleration * (1.0/60.0);
 
-    double velXComp = std::cos(angleBetweenPoints) * deltaVel;
-    double velYComp = std::sin(angleBetweenPoints) * deltaVel;
+void Particle::pullTowards(double dx, double dy, double constant, double pointMass, double& dvx, double& dvy, double dt)
+{
+    double distSquared = Vec2<double>(dx, dy).squaredNorm();
+
+    // The gravitational equation. The mass of the particle being pulled cancels out,
+    // leaving an acceleration of constant * pointMass / dist^2 towards the point.
+    // Scaling the offset to the point by that over dist gives the acceleration
+    // along each axis, without working out the angle between them.
+    double deltaVel = (constant * pointMass * dt) / (distSquared * std::sqrt(distSquared));
 
-    // Add the force vector to this particle's motion vector.
-    MotionVector<double> forceVec(velXComp, velYComp);
-    vec = vec + forceVec;
+    dvx = dx * deltaVel;
+    dvy = dy * deltaVel;
 }
 
 
@@ -113,119 +88,42 @@ void Particle::coalesce(Particle& p2, double constant)
         return;
     }
 
-    double totalMass = mass + p2.mass;
-
-    // Case where p1 is larger and absorbs p2.
-    if (mass >= p2.mass)
-    {
-        // Create a new position and vector that is based on the masses
-        // of the particles.
-        x_pos = (x_pos * mass + p2.x_pos * p2.mass) / totalMass;
-
-        // The larger particle should stay moving in roughly the same direction,
-        // but can be diverted slightly by the smaller particle.
-        double smallerVecMagnitude = (p2.vec.magnitude() * p2.mass) / totalMass;
-        double smallerVecAngle = p2.vec.angle();
-        double smallerVecX = std::cos(smallerVecAngle) * smallerVecMagnitude;
-        double smallerVecY = std::sin(smallerVecAngle) * smallerVecMagnitude;
-
-        // Add this new weighted vector to p1's existing vector.
-        vec = vec + MotionVector<double>(smallerVecX, smallerVecY);
-
-        // Make it seem like energy was lost during the collision.
-        applyElasticity(constant);
-
-        // Update mass and change radius accordingly.
-        mass = totalMass;
-        rad = calcRad(totalMass, density);
-
-        // Set this flag to true so the simulation can remove p2.
-        p2.absorbed = true;
-    }
-    // Case where p2 is larger.
-    else if (mass < p2.mass)
-    {
-        p2.x_pos = (p2.x_pos * p2.mass + x_pos * mass) / totalMass;
-
-        double smallerVecMagnitude = (vec.magnitude() * mass) / totalMass;
-        double smallerVecAngle = vec.angle();
-        double smallerVecX = std::cos(smallerVecAngle) * smallerVecMagnitude;
-        double smallerVecY = std::sin(smallerVecAngle) * smallerVecMagnitude;
+    // The larger particle absorbs the smaller one.
+    Particle& larger = mass >= p2.mass ? *this : p2;
+    Particle& smaller = mass >= p2.mass ? p2 : *this;
 
-        p2.vec = p2.vec + MotionVector<double>(smallerVecX, smallerVecY);
+    double totalMass = mass + p2.mass;
+    double share = smaller.mass / totalMass;
 
-        p2.applyElasticity(constant);
+    // The new position is weighted by the masses of the particles.
+    larger.pos = fma(larger.pos, larger.mass / totalMass, smaller.pos * share);
 
-        p2.mass = totalMass;
-        p2.rad = Particle::calcRad(totalMass, density);
+    // The larger particle should stay moving in roughly the same direction,
+    // but can be diverted slightly by the smaller particle.
+    larger.vel.addScaled(smaller.vel, share);
 
-        absorbed = true;
-    }
-}
+    // Make it seem like energy was lost during the collision.
+    larger.applyElasticity(constant);
 
+    // Update mass and change radius accordingly.
+    larger.mass = totalMass;
+    larger.rad = calcRad(totalMass, larger.density);
 
-void Particle::explode(std::list<Particle*>& particles)
-{
-    if (oriRad < 3)
-    {
-        return;
-    }
-
-    double fragmentAngle;
-    int fragmentVelocity = 100;
-    int fragmentRadius;
-    double fragmentX;
-    double fragmentY;
-    double xLBound = x_pos - (oriRad / 2);
-    double xHBound = x_pos + (oriRad / 2);
-    double yLBound = y_pos - (oriRad / 2);
-    double yHBound = y_pos + (oriRad / 2);
-
-    for (int i = 0; i < oriRad; ++i)
-    {
-        fragmentAngle = std::fmod(std::rand(), 2 * 3.14);
-        MotionVector<double> fragMot = MotionVector<double>(
-            fragmentVelocity* std::cos(fragmentAngle),
-            fragmentVelocity* std::sin(fragmentAngle)
-        );
-        if (oriRad < 25)
-        {
-            fragmentRadius = 1;
-        }
-        else if (oriRad < 50)
-        {
-            fragmentRadius = 1 + std::rand() % 2;
-        }
-        else
-        {
-            fragmentRadius = 1 + std::rand() % 3;
-        }
-        
-        fragmentX = xLBound + std::fmod(std::rand(), xHBound - xLBound);
-        fragmentY = yLBound + std::fmod(std::rand(), yHBound - yLBound);
-
-        std::cout << "Generated (" << fragmentX << ", " << fragmentY << ")" << std::endl;
-        std::cout << "This is between x: [" << xLBound << ", " << xHBound << "] y: [" << yLBound << ", " << yHBound << "]" << std::endl;
-
-        particles.push_back(new Particle(
-            fragmentRadius,
-            fragmentX,
-            fragmentY,
-            fragMot + vec
-        ));
-    }
+    // Set this flag so the simulation can remove the smaller particle.
+    smaller.absorbed = true;
 }
 
 
 double Particle::distanceFrom(double x, double y)
 {
-    return std::hypot(x - x_pos, y - y_pos);
+    return (Vec2<double>(x, y) - pos).norm();
 }
 
 
 bool Particle::isCollidingWith(Particle& p2)
 {
-    return (distanceFrom(p2.x_pos, p2.y_pos) < rad + p2.rad);
+    double reach = rad + p2.rad;
+    return (p2.pos - pos).squaredNorm() < reach * reach;
 }
 
 
@@ -238,8 +136,7 @@ bool Particle::isAbsorbed()
 void Particle::freeze()
 {
     fixed = true;
-    vec.setX(0);
-    vec.setY(0);
+    vel = Vec2<double>();
 }
 
 
@@ -269,7 +166,7 @@ double Particle::calcRad(double mass, double density)
 
 double Particle::calcMass(double radius, double density)
 {
-    return (4.0 / 3.0) * M_PI * std::pow(radius, 3) * density;
+    return (4.0 / 3.0) * M_PI * radius * radius * radius * density;
 }
 
 
@@ -291,24 +188,37 @@ void Particle::changeMass(double amount)
 }
 
 
+double Particle::getDensity()
+{
+    return density;
+}
+
+
 MotionVector<double> Particle::getVelocity()
 {
-    return vec;
+    return MotionVector<double>(vel.x, vel.y);
 }
 
 
-SDL_Color Particle::getColor()
+Color Particle::getColor()
 {
-    double percOriMass = mass / oriMass;
-    Uint8 blueVal = 255 * percOriMass;
-    Uint8 greenVal = (255 + blueVal) / 2;
-    color.b = blueVal;
-    color.g = greenVal;
+    color = colorFor(mass, oriMass, color);
     return color;
 }
 
 
+Color Particle::colorFor(double mass, double oriMass, Color col)
+{
+    double percOriMass = mass / oriMass;
+    std::uint8_t blueVal = 255 * percOriMass;
+    std::uint8_t greenVal = (255 + blueVal) / 2;
+    col.b = blueVal;
+    col.g = greenVal;
+    return col;
+}
+
+
 void Particle::applyElasticity(double constant)
 {
-    vec = vec * constant;
+    vel *= constant;
 }
@@ -0,0 +1,429 @@
+#include "ParticleMesh.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+    // Number of entries in the short range correction table.
+    constexpr unsigned TABLE_SIZE = 1024;
+
+    // Return the transform of the cloud-in-cell window at frequency k of m.
+    double window(unsigned k, unsigned m)
+    {
+        double f = k < m / 2 ? k : static_cast<double>(k) - m;
+        double x = M_PI * f / m;
+        double sinc = x != 0 ? std::sin(x) / x : 1;
+        return sinc * sinc;
+    }
+}
+
+
+ParticleMesh::ParticleMesh(unsigned cells, bool shortRange)
+    : cells{std::max(cells, 8u)}, shortRange{shortRange}, fft{2 * this->cells},
+    x0{0}, y0{0}, spacing{1}, chainDim{1}, chainSize{1}
+{
+    unsigned m = 2 * this->cells;
+
+    // The pull of a unit mass at every offset on the padded grid. Offsets past the
+    // middle wrap around to negative ones.
+    green.resize(m * m);
+    for (unsigned iy = 0; iy < m; ++iy)
+    {
+        for (unsigned ix = 0; ix < m; ++ix)
+        {
+            double dx = ix < this->cells ? ix : static_cast<double>(ix) - m;
+            double dy = iy < this->cells ? iy : static_cast<double>(iy) - m;
+            double r = std::hypot(dx, dy);
+            green[iy * m + ix] = r > 0 ? std::erf(r / SPLIT) / r : 2 / (std::sqrt(M_PI) * SPLIT);
+        }
+    }
+    transform(green, false, nullptr);
+
+    // Spreading the mass and interpolating the force each smooth it out with the
+    // cloud-in-cell window, so divide the window out twice.
+    for (unsigned iy = 0; iy < m; ++iy)
+    {
+        for (unsigned ix = 0; ix < m; ++ix)
+        {
+            double wx = window(ix, m);
+            double wy = window(iy, m);
+            green[iy * m + ix] /= wx * wx * wy * wy;
+        }
+    }
+
+    // What's left of the pull once the grid's share is taken away, as a fraction
+    // of the full pull, going by q = (r / SPLIT)^2.
+    correction.resize(TABLE_SIZE + 1);
+    for (unsigned k = 0; k <= TABLE_SIZE; ++k)
+    {
+        double q = CUTOFF * CUTOFF * k / TABLE_SIZE;
+        double s = std::sqrt(q);
+        correction[k] = std::erfc(s) + 2 * s / std::sqrt(M_PI) * std::exp(-q);
+    }
+}
+
+
+void ParticleMesh::solve(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    ax.assign(xs.size(), 0);
+    ay.assign(xs.size(), 0);
+    run(xs, ys, masses, nullptr, width, height, constant, ax, ay, pool);
+}
+
+
+void ParticleMesh::solveFor(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>& targets,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    if (ax.size() < xs.size())
+    {
+        ax.resize(xs.size());
+        ay.resize(xs.size());
+    }
+    run(xs, ys, masses, &targets, width, height, constant, ax, ay, pool);
+}
+
+
+void ParticleMesh::setShortRange(bool on)
+{
+    shortRange = on;
+}
+
+
+bool ParticleMesh::hasShortRange() const
+{
+    return shortRange;
+}
+
+
+unsigned ParticleMesh::getCells() const
+{
+    return cells;
+}
+
+
+void ParticleMesh::run(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>* targets,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    unsigned n = xs.size();
+
+    // Find a square that covers the domain and every body.
+    double minX = 0;
+    double minY = 0;
+    double maxX = width;
+    double maxY = height;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        minX = std::min<double>(minX, xs[i]);
+        minY = std::min<double>(minY, ys[i]);
+        maxX = std::max<double>(maxX, xs[i]);
+        maxY = std::max<double>(maxY, ys[i]);
+    }
+
+    // Leave two empty grid points before the bodies and three after them. The
+    // differences reach two points either side, and the padded grid is only exact
+    // up to one point past the end.
+    double span = std::max(std::max(maxX - minX, maxY - minY), 1e-9) * (1 + 1e-9);
+    spacing = span / (cells - 5);
+    x0 = minX - 2 * spacing;
+    y0 = minY - 2 * spacing;
+
+    deposit(xs, ys, masses);
+    solveGrid(pool);
+    if (shortRange)
+    {
+        buildChains(xs, ys);
+    }
+
+    auto evaluate = [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned t = begin; t < end; ++t)
+        {
+            unsigned i = targets ? (*targets)[t] : t;
+            double gx;
+            double gy;
+            accelerationOf(i, xs, ys, masses, gx, gy);
+            ax[i] = constant * gx;
+            ay[i] = constant * gy;
+        }
+    };
+
+    unsigned count = targets ? targets->size() : n;
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, count, 512, evaluate);
+    }
+    else
+    {
+        evaluate(0, count, 0);
+    }
+}
+
+
+void ParticleMesh::deposit(const std::vector<Real>& xs, const std::vector<Real>& ys, const std::vector<Real>& masses)
+{
+    unsigned m = 2 * cells;
+    grid.assign(m * m, 0);
+
+    for (unsigned i = 0; i < xs.size(); ++i)
+    {
+        if (masses[i] == 0)
+        {
+            continue;
+        }
+
+        unsigned cx;
+        unsigned cy;
+        double wx;
+        double wy;
+        locate(xs[i], x0, cx, wx);
+        locate(ys[i], y0, cy, wy);
+
+        std::complex<double>* row = grid.data() + cy * m + cx;
+        row[0] += masses[i] * (1 - wx) * (1 - wy);
+        row[1] += masses[i] * wx * (1 - wy);
+        row[m] += masses[i] * (1 - wx) * wy;
+        row[m + 1] += masses[i] * wx * wy;
+    }
+}
+
+
+void ParticleMesh::transform(std::vector<std::complex<double>>& data, bool inverse, ThreadPool* pool)
+{
+    unsigned m = fft.size();
+    columnBuffer.resize(m * (nullptr != pool ? pool->size() : 1));
+
+    auto rows = [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned r = begin; r < end; ++r)
+        {
+            fft.transform(data.data() + r * m, inverse);
+        }
+    };
+
+    // Columns are copied out so the transform runs over contiguous memory.
+    auto columns = [&](unsigned begin, unsigned end, unsigned worker) {
+        std::complex<double>* column = columnBuffer.data() + worker * m;
+        for (unsigned c = begin; c < end; ++c)
+        {
+            for (unsigned r = 0; r < m; ++r)
+            {
+                column[r] = data[r * m + c];
+            }
+            fft.transform(column, inverse);
+            for (unsigned r = 0; r < m; ++r)
+            {
+                data[r * m + c] = column[r];
+            }
+        }
+    };
+
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, m, 16, rows);
+        pool->parallelFor(0, m, 16, columns);
+    }
+    else
+    {
+        rows(0, m, 0);
+        columns(0, m, 0);
+    }
+}
+
+
+void ParticleMesh::solveGrid(ThreadPool* pool)
+{
+    unsigned m = 2 * cells;
+
+    // Convolve the mass with the pull of a unit mass.
+    transform(grid, false, pool);
+    for (unsigned k = 0; k < grid.size(); ++k)
+    {
+        grid[k] *= green[k];
+    }
+    transform(grid, true, pool);
+
+    // The inverse transform is m * m times too big, and the pull was worked out
+    // for a grid spacing of 1.
+    double scale = 1 / (static_cast<double>(m) * m * spacing);
+
+    gradX.resize(cells * cells);
+    gradY.resize(cells * cells);
+
+    auto difference = [&](unsigned begin, unsigned end, unsigned) {
+        auto potential = [&](unsigned ix, unsigned iy) {
+            return grid[(iy & (m - 1)) * m + (ix & (m - 1))].real();
+        };
+
+        for (unsigned iy = begin; iy < end; ++iy)
+        {
+            for (unsigned ix = 0; ix < cells; ++ix)
+            {
+                // Fourth order central differences.
+                gradX[iy * cells + ix] = scale / (12 * spacing) * (
+                    8 * (potential(ix + 1, iy) - potential(ix - 1, iy)) - (potential(ix + 2, iy) - potential(ix - 2, iy)));
+                gradY[iy * cells + ix] = scale / (12 * spacing) * (
+                    8 * (potential(ix, iy + 1) - potential(ix, iy - 1)) - (potential(ix, iy + 2) - potential(ix, iy - 2)));
+            }
+        }
+    };
+
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, cells, 16, difference);
+    }
+    else
+    {
+        difference(0, cells, 0);
+    }
+}
+
+
+void ParticleMesh::buildChains(const std::vector<Real>& xs, const std::vector<Real>& ys)
+{
+    unsigned n = xs.size();
+    double extent = cells * spacing;
+    double cutoff = CUTOFF * SPLIT * spacing;
+
+    chainDim = std::max(1.0, std::floor(extent / cutoff));
+    chainSize = extent / chainDim;
+
+    chainOf.resize(n);
+    chainStart.assign(chainDim * chainDim + 1, 0);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double fx = (xs[i] - x0) / chainSize;
+        double fy = (ys[i] - y0) / chainSize;
+        unsigned cx = fx >= 0 ? std::min<double>(fx, chainDim - 1) : 0;
+        unsigned cy = fy >= 0 ? std::min<double>(fy, chainDim - 1) : 0;
+        chainOf[i] = cy * chainDim + cx;
+        ++chainStart[chainOf[i] + 1];
+    }
+
+    // Counting sort. After this, chainStart[c + 1] is where cell c ends.
+    for (unsigned c = 0; c < chainDim * chainDim; ++c)
+    {
+        chainStart[c + 1] += chainStart[c];
+    }
+
+    chained.resize(n);
+    for (unsigned i = n; i-- > 0;)
+    {
+        chained[--chainStart[chainOf[i] + 1]] = i;
+    }
+
+    // Filling from the end moved each start one cell early, so shift them back.
+    for (unsigned c = 0; c < chainDim * chainDim; ++c)
+    {
+        chainStart[c] = chainStart[c + 1];
+    }
+    chainStart[chainDim * chainDim] = n;
+}
+
+
+void ParticleMesh::accelerationOf(
+    unsigned i,
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double& ax,
+    double& ay
+) const
+{
+    // Interpolate the long range pull with the same weights the mass was spread with.
+    unsigned cx;
+    unsigned cy;
+    double wx;
+    double wy;
+    locate(xs[i], x0, cx, wx);
+    locate(ys[i], y0, cy, wy);
+
+    unsigned k = cy * cells + cx;
+    ax = (1 - wx) * (1 - wy) * gradX[k] + wx * (1 - wy) * gradX[k + 1]
+        + (1 - wx) * wy * gradX[k + cells] + wx * wy * gradX[k + cells + 1];
+    ay = (1 - wx) * (1 - wy) * gradY[k] + wx * (1 - wy) * gradY[k + 1]
+        + (1 - wx) * wy * gradY[k + cells] + wx * wy * gradY[k + cells + 1];
+
+    if (!shortRange)
+    {
+        return;
+    }
+
+    double splitSq = SPLIT * SPLIT * spacing * spacing;
+    double cutoffSq = CUTOFF * CUTOFF * splitSq;
+    double tableScale = TABLE_SIZE / (CUTOFF * CUTOFF);
+
+    int kx = chainOf[i] % chainDim;
+    int ky = chainOf[i] / chainDim;
+    int last = chainDim - 1;
+
+    for (int ny = std::max(ky - 1, 0); ny <= std::min(ky + 1, last); ++ny)
+    {
+        for (int nx = std::max(kx - 1, 0); nx <= std::min(kx + 1, last); ++nx)
+        {
+            unsigned c = ny * chainDim + nx;
+            for (unsigned s = chainStart[c]; s < chainStart[c + 1]; ++s)
+            {
+                unsigned j = chained[s];
+                double dx = xs[j] - xs[i];
+                double dy = ys[j] - ys[i];
+                double distSq = dx * dx + dy * dy;
+                if (distSq > 0 && distSq < cutoffSq)
+                {
+                    double pos = distSq / splitSq * tableScale;
+                    unsigned entry = pos;
+                    double frac = pos - entry;
+                    double fraction = correction[entry] + frac * (correction[entry + 1] - correction[entry]);
+
+                    double scale = masses[j] * fraction / (distSq * std::sqrt(distSq));
+                    ax += dx * scale;
+                    ay += dy * scale;
+                }
+            }
+        }
+    }
+}
+
+
+void ParticleMesh::locate(double v, double origin, unsigned& cell, double& weight) const
+{
+    double u = (v - origin) / spacing;
+
+    // Anything that isn't a sensible number goes on the first grid point.
+    if (!(u >= 0))
+    {
+        u = 0;
+    }
+    u = std::min<double>(u, cells - 2);
+
+    cell = u;
+    weight = u - cell;
+}
@@ -0,0 +1,298 @@
+#include "ParticleStore.hpp"
+#include <cmath>
+#include <utility>
+#include "Log.hpp"
+#include "Particle.hpp"
+#include "Vec2.hpp"
+
+
+ParticleStore::Id ParticleStore::add(
+    double radius,
+    double x,
+    double y,
+    double vx,
+    double vy,
+    double density,
+    std::uint8_t flags
+)
+{
+    unsigned slot;
+    if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else if (slots.size() < SLOT_MASK)
+    {
+        slot = slots.size();
+        slots.push_back(NONE);
+        generations.push_back(0);
+    }
+    else
+    {
+        LOG_ERROR("Can't add a particle, because all %llu slots are in use", static_cast<unsigned long long>(SLOT_MASK));
+        return NO_ID;
+    }
+
+    Id id = Id(generations[slot]) << SLOT_BITS | slot;
+    slots[slot] = ids.size();
+    ids.push_back(id);
+
+    this->x.push_back(x);
+    this->y.push_back(y);
+    this->vx.push_back(vx);
+    this->vy.push_back(vy);
+    mass.push_back(Particle::calcMass(radius, density));
+    this->radius.push_back(radius);
+    this->density.push_back(density);
+    oriMass.push_back(mass.back());
+    oriRad.push_back(radius);
+    this->flags.push_back(flags);
+
+    return id;
+}
+
+
+unsigned ParticleStore::size() const
+{
+    return ids.size();
+}
+
+
+bool ParticleStore::empty() const
+{
+    return ids.empty();
+}
+
+
+void ParticleStore::reserve(unsigned n)
+{
+    x.reserve(n);
+    y.reserve(n);
+    vx.reserve(n);
+    vy.reserve(n);
+    mass.reserve(n);
+    radius.reserve(n);
+    density.reserve(n);
+    oriMass.reserve(n);
+    oriRad.reserve(n);
+    flags.reserve(n);
+    ids.reserve(n);
+}
+
+
+void ParticleStore::clear()
+{
+    for (Id id : ids)
+    {
+        release(id);
+    }
+
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    mass.clear();
+    radius.clear();
+    density.clear();
+    oriMass.clear();
+    oriRad.clear();
+    flags.clear();
+    ids.clear();
+}
+
+
+void ParticleStore::remove(unsigned i)
+{
+    release(ids[i]);
+
+    unsigned last = size() - 1;
+    if (i != last)
+    {
+        x[i] = x[last];
+        y[i] = y[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        mass[i] = mass[last];
+        radius[i] = radius[last];
+        density[i] = density[last];
+        oriMass[i] = oriMass[last];
+        oriRad[i] = oriRad[last];
+        flags[i] = flags[last];
+        ids[i] = ids[last];
+        slots[ids[i] & SLOT_MASK] = i;
+    }
+
+    x.pop_back();
+    y.pop_back();
+    vx.pop_back();
+    vy.pop_back();
+    mass.pop_back();
+    radius.pop_back();
+    density.pop_back();
+    oriMass.pop_back();
+    oriRad.pop_back();
+    flags.pop_back();
+    ids.pop_back();
+}
+
+
+void ParticleStore::removeDead()
+{
+    unsigned i = 0;
+
+    while (i < size())
+    {
+        // The particle moved into a removed one's place needs checking too.
+        if (flags[i] & DEAD)
+        {
+            remove(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+
+unsigned ParticleStore::indexOf(Id id) const
+{
+    Id slot = id & SLOT_MASK;
+
+    if (slot >= slots.size() || generations[slot] != id >> SLOT_BITS)
+    {
+        return NONE;
+    }
+
+    return slots[slot];
+}
+
+
+ParticleStore::Id ParticleStore::idAt(unsigned i) const
+{
+    return ids[i];
+}
+
+
+bool ParticleStore::hasFlag(unsigned i, Flag f) const
+{
+    return flags[i] & f;
+}
+
+
+void ParticleStore::setFlag(unsigned i, Flag f)
+{
+    flags[i] |= f;
+}
+
+
+void ParticleStore::clearFlag(unsigned i, Flag f)
+{
+    flags[i] &= ~f;
+}
+
+
+void ParticleStore::move(unsigned i, double dt)
+{
+    if (flags[i] & FROZEN)
+    {
+        return;
+    }
+
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+}
+
+
+void ParticleStore::accelerateTowards(unsigned i, double x, double y, double constant, double pointMass, double dt)
+{
+    if (flags[i] & FROZEN)
+    {
+        return;
+    }
+
+    double dvx;
+    double dvy;
+    Particle::pullTowards(x - this->x[i], y - this->y[i], constant, pointMass, dvx, dvy, dt);
+
+    vx[i] += dvx;
+    vy[i] += dvy;
+}
+
+
+bool ParticleStore::coalesce(unsigned i, unsigned j, double constant)
+{
+    if (!isColliding(i, j))
+    {
+        return false;
+    }
+
+    // Make i the heavier particle, which absorbs j.
+    if (mass[i] < mass[j])
+    {
+        std::swap(i, j);
+    }
+
+    double totalMass = mass[i] + mass[j];
+    double share = mass[j] / totalMass;
+
+    // The new position is weighted by the masses of the particles.
+    Vec2<double> position = fma(Vec2<double>(x[i], y[i]), mass[i] / totalMass, Vec2<double>(x[j], y[j]) * share);
+    x[i] = position.x;
+    y[i] = position.y;
+
+    // The larger particle should stay moving in roughly the same direction,
+    // but can be diverted slightly by the smaller particle. Then make it seem like
+    // energy was lost during the collision.
+    Vec2<double> velocity = fma(Vec2<double>(vx[j], vy[j]), share, Vec2<double>(vx[i], vy[i])) * constant;
+    vx[i] = velocity.x;
+    vy[i] = velocity.y;
+
+    mass[i] = totalMass;
+    radius[i] = Particle::calcRad(totalMass, density[i]);
+
+    flags[j] |= DEAD;
+
+    return true;
+}
+
+
+double ParticleStore::distanceFrom(unsigned i, double x, double y) const
+{
+    return Vec2<double>(x - this->x[i], y - this->y[i]).norm();
+}
+
+
+bool ParticleStore::isColliding(unsigned i, unsigned j) const
+{
+    double reach = radius[i] + radius[j];
+    return Vec2<double>(x[j] - x[i], y[j] - y[i]).squaredNorm() < reach * reach;
+}
+
+
+void ParticleStore::freeze(unsigned i)
+{
+    flags[i] |= FROZEN;
+    vx[i] = 0;
+    vy[i] = 0;
+}
+
+
+void ParticleStore::unFreeze(unsigned i)
+{
+    flags[i] &= ~FROZEN;
+}
+
+
+void ParticleStore::release(Id id)
+{
+    unsigned slot = id & SLOT_MASK;
+    slots[slot] = NONE;
+
+    if (generations[slot] < MAX_GENERATION)
+    {
+        ++generations[slot];
+        freeSlots.push_back(slot);
+    }
+}
@@ -0,0 +1,171 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+Profiler::Scope::Scope(Profiler& profiler, Phase phase)
+    : profiler{profiler},
+    outer{profiler.begin(phase)}
+{
+}
+
+
+Profiler::Scope::~Scope()
+{
+    profiler.end(outer);
+}
+
+
+void Profiler::add(Phase phase, std::chrono::nanoseconds time)
+{
+    current[static_cast<unsigned>(phase)] += time;
+}
+
+
+void Profiler::endFrame()
+{
+    unsigned slot = finished % WINDOW;
+    for (unsigned p = 0; p < PHASES; ++p)
+    {
+        history[p][slot] = std::chrono::duration<double, std::milli>(current[p]).count();
+        current[p] = std::chrono::nanoseconds(0);
+    }
+
+    if (csv)
+    {
+        std::fprintf(csv, "%llu", finished);
+        for (unsigned p = 0; p < PHASES; ++p)
+        {
+            std::fprintf(csv, ",%.4f", history[p][slot]);
+        }
+        std::fprintf(csv, "\n");
+    }
+
+    ++finished;
+}
+
+
+Profiler::Stats Profiler::stats(Phase phase) const
+{
+    unsigned n = std::min<unsigned long long>(finished, WINDOW);
+    if (0 == n)
+    {
+        return Stats{0, 0, 0};
+    }
+
+    // Sort a copy, so the ring stays in order.
+    double times[WINDOW];
+    std::copy(history[static_cast<unsigned>(phase)], history[static_cast<unsigned>(phase)] + n, times);
+
+    double sum = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        sum += times[i];
+    }
+
+    // The 99th percentile is the smallest time that at least 99% of frames are within.
+    unsigned rank = std::ceil(0.99 * n) - 1;
+    std::nth_element(times, times + rank, times + n);
+
+    return Stats{*std::min_element(times, times + n), sum / n, times[rank]};
+}
+
+
+double Profiler::last(Phase phase) const
+{
+    if (0 == finished)
+    {
+        return 0;
+    }
+    return history[static_cast<unsigned>(phase)][(finished - 1) % WINDOW];
+}
+
+
+unsigned long long Profiler::frames() const
+{
+    return finished;
+}
+
+
+void Profiler::setCsv(std::FILE* file)
+{
+    csv = file;
+    if (csv)
+    {
+        std::fprintf(csv, "frame");
+        for (unsigned p = 0; p < PHASES; ++p)
+        {
+            std::fprintf(csv, ",%s_ms", phaseName(static_cast<Phase>(p)));
+        }
+        std::fprintf(csv, "\n");
+    }
+}
+
+
+void Profiler::setEnabled(bool on)
+{
+    enabled = on;
+    running = Phase::Count;
+}
+
+
+const char* Profiler::phaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::Forces:
+            return "forces";
+        case Phase::Merges:
+            return "merges";
+        case Phase::Explosions:
+            return "explosions";
+        case Phase::Removal:
+            return "removal";
+        case Phase::Circles:
+            return "circles";
+        case Phase::Text:
+            return "text";
+        case Phase::Present:
+            return "present";
+        default:
+            return "none";
+    }
+}
+
+
+Profiler::Phase Profiler::begin(Phase phase)
+{
+    Phase outer = running;
+    if (!enabled)
+    {
+        return outer;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (outer != Phase::Count)
+    {
+        add(outer, now - since);
+    }
+
+    running = phase;
+    since = now;
+    return outer;
+}
+
+
+void Profiler::end(Phase outer)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (running != Phase::Count)
+    {
+        add(running, now - since);
+    }
+
+    running = outer;
+    since = now;
+}
@@ -0,0 +1,323 @@
+#include "QuadTree.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+QuadTree::QuadTree(double theta)
+    : theta{theta}
+{
+}
+
+
+void QuadTree::build(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double width,
+    double height
+)
+{
+    bodyX = xs;
+    bodyY = ys;
+    bodyMass = masses;
+
+    nodes.clear();
+    next.assign(bodyX.size(), -1);
+
+    // Find a square that covers the domain and every body.
+    double minX = 0;
+    double minY = 0;
+    double maxX = width;
+    double maxY = height;
+    for (unsigned i = 0; i < bodyX.size(); ++i)
+    {
+        minX = std::min<double>(minX, bodyX[i]);
+        minY = std::min<double>(minY, bodyY[i]);
+        maxX = std::max<double>(maxX, bodyX[i]);
+        maxY = std::max<double>(maxY, bodyY[i]);
+    }
+
+    nodes.push_back(Node{minX, minY, std::max(maxX - minX, maxY - minY), 0, 0, 0, -1, -1});
+
+    for (unsigned i = 0; i < bodyX.size(); ++i)
+    {
+        insert(i);
+    }
+
+    // Children are always stored after their parents, so walking the nodes
+    // backwards visits every child before the node that owns it.
+    for (int n = nodes.size() - 1; n >= 0; --n)
+    {
+        Node& node = nodes[n];
+        double mass = 0;
+        double mx = 0;
+        double my = 0;
+
+        if (node.child < 0)
+        {
+            // Multiply in double, even if the bodies are floats. Otherwise the center
+            // of mass of bodies on top of each other can land a little way off them,
+            // and they'd be pulled towards it.
+            for (int b = node.body; b >= 0; b = next[b])
+            {
+                mass += bodyMass[b];
+                mx += double(bodyX[b]) * bodyMass[b];
+                my += double(bodyY[b]) * bodyMass[b];
+            }
+        }
+        else
+        {
+            for (int c = node.child; c < node.child + 4; ++c)
+            {
+                mass += nodes[c].mass;
+                mx += nodes[c].comX * nodes[c].mass;
+                my += nodes[c].comY * nodes[c].mass;
+            }
+        }
+
+        node.mass = mass;
+        node.comX = mass > 0 ? mx / mass : node.x0 + node.side / 2;
+        node.comY = mass > 0 ? my / mass : node.y0 + node.side / 2;
+    }
+}
+
+
+void QuadTree::computeAccelerations(
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+) const
+{
+    ax.resize(bodyX.size());
+    ay.resize(bodyY.size());
+
+    auto walk = [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            accelerationAt(bodyX[i], bodyY[i], constant, ax[i], ay[i]);
+        }
+    };
+
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, bodyX.size(), 512, walk);
+    }
+    else
+    {
+        walk(0, bodyX.size(), 0);
+    }
+}
+
+
+void QuadTree::solve(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    build(xs, ys, masses, width, height);
+    computeAccelerations(constant, ax, ay, pool);
+}
+
+
+void QuadTree::solveFor(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& masses,
+    const std::vector<unsigned>& targets,
+    double width,
+    double height,
+    double constant,
+    std::vector<Accum>& ax,
+    std::vector<Accum>& ay,
+    ThreadPool* pool
+)
+{
+    build(xs, ys, masses, width, height);
+
+    if (ax.size() < xs.size())
+    {
+        ax.resize(xs.size());
+        ay.resize(xs.size());
+    }
+
+    auto walk = [&](unsigned begin, unsigned end, unsigned) {
+        for (unsigned t = begin; t < end; ++t)
+        {
+            unsigned i = targets[t];
+            accelerationAt(bodyX[i], bodyY[i], constant, ax[i], ay[i]);
+        }
+    };
+
+    if (nullptr != pool)
+    {
+        pool->parallelFor(0, targets.size(), 512, walk);
+    }
+    else
+    {
+        walk(0, targets.size(), 0);
+    }
+}
+
+
+void QuadTree::accelerationAt(double x, double y, double constant, Accum& ax, Accum& ay) const
+{
+    ax = 0;
+    ay = 0;
+
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    // Every level of the tree adds at most 3 pending nodes to the stack.
+    int stack[3 * MAX_DEPTH + 4];
+    int top = 0;
+    stack[top++] = 0;
+
+    double thetaSq = theta * theta;
+
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+
+        if (node.mass <= 0)
+        {
+            continue;
+        }
+
+        if (node.child < 0)
+        {
+            // Sum each body in the leaf exactly.
+            for (int b = node.body; b >= 0; b = next[b])
+            {
+                double dx = bodyX[b] - x;
+                double dy = bodyY[b] - y;
+                double distSq = dx * dx + dy * dy;
+                if (distSq > 0)
+                {
+                    double scale = constant * bodyMass[b] / (distSq * std::sqrt(distSq));
+                    ax += dx * scale;
+                    ay += dy * scale;
+                }
+            }
+            continue;
+        }
+
+        double dx = node.comX - x;
+        double dy = node.comY - y;
+        double distSq = dx * dx + dy * dy;
+
+        // The node is far enough away to be treated as a single body.
+        if (node.side * node.side < thetaSq * distSq)
+        {
+            double scale = constant * node.mass / (distSq * std::sqrt(distSq));
+            ax += dx * scale;
+            ay += dy * scale;
+        }
+        else
+        {
+            for (int c = node.child; c < node.child + 4; ++c)
+            {
+                stack[top++] = c;
+            }
+        }
+    }
+}
+
+
+void QuadTree::setOpeningAngle(double theta)
+{
+    this->theta = theta;
+}
+
+
+double QuadTree::openingAngle() const
+{
+    return theta;
+}
+
+
+unsigned QuadTree::size() const
+{
+    return nodes.size();
+}
+
+
+void QuadTree::insert(int i)
+{
+    int n = 0;
+    int depth = 0;
+
+    while (true)
+    {
+        if (nodes[n].child >= 0)
+        {
+            n = childFor(n, bodyX[i], bodyY[i]);
+            ++depth;
+            continue;
+        }
+
+        // Empty leaf, the body can go right here.
+        if (nodes[n].body < 0)
+        {
+            nodes[n].body = i;
+            return;
+        }
+
+        // The leaf is as small as it's allowed to get, so share it.
+        if (depth >= MAX_DEPTH)
+        {
+            next[i] = nodes[n].body;
+            nodes[n].body = i;
+            return;
+        }
+
+        // Otherwise split the leaf, push its body down a level and try again.
+        int existing = nodes[n].body;
+        nodes[n].body = -1;
+        subdivide(n);
+        nodes[childFor(n, bodyX[existing], bodyY[existing])].body = existing;
+    }
+}
+
+
+void QuadTree::subdivide(int n)
+{
+    double half = nodes[n].side / 2;
+    double x0 = nodes[n].x0;
+    double y0 = nodes[n].y0;
+
+    // Pushing may reallocate the vector, so don't hold a reference to node n.
+    nodes[n].child = nodes.size();
+    nodes.push_back(Node{x0, y0, half, 0, 0, 0, -1, -1});
+    nodes.push_back(Node{x0 + half, y0, half, 0, 0, 0, -1, -1});
+    nodes.push_back(Node{x0, y0 + half, half, 0, 0, 0, -1, -1});
+    nodes.push_back(Node{x0 + half, y0 + half, half, 0, 0, 0, -1, -1});
+}
+
+
+int QuadTree::childFor(int n, double x, double y) const
+{
+    const Node& node = nodes[n];
+    double half = node.side / 2;
+    int c = node.child;
+
+    if (x >= node.x0 + half)
+    {
+        c += 1;
+    }
+    if (y >= node.y0 + half)
+    {
+        c += 2;
+    }
+
+    return c;
+}
@@ -0,0 +1,109 @@
+#include "RenderFrame.hpp"
+#include <cmath>
+#include "Particle.hpp"
+
+
+void RenderFrame::capture(Environment& env, unsigned long long updates)
+{
+    ParticleStore& particles = env.getParticles();
+    unsigned n = particles.size();
+
+    x.assign(particles.x.begin(), particles.x.begin() + n);
+    y.assign(particles.y.begin(), particles.y.begin() + n);
+    radius.assign(particles.radius.begin(), particles.radius.begin() + n);
+    color.resize(n);
+    ids.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        ids[i] = particles.idAt(i);
+        color[i] = particles.hasFlag(i, ParticleStore::ATTACKER)
+            ? Color{255, 0, 0}
+            : Particle::colorFor(particles.mass[i], particles.oriMass[i], Color{255, 255, 255});
+    }
+
+    lasers.clear();
+    for (Attacker& a : env.getAttackers())
+    {
+        if (a.lockedOn(particles))
+        {
+            unsigned self = particles.indexOf(a.getBody());
+            unsigned t = particles.indexOf(a.getTarget());
+            lasers.push_back(Laser{
+                static_cast<float>(particles.x[self]),
+                static_cast<float>(particles.y[self]),
+                static_cast<float>(particles.x[t]),
+                static_cast<float>(particles.y[t]),
+                a.getWeaponStrength()
+            });
+        }
+    }
+
+    const Profiler& profiler = env.getProfiler();
+    for (unsigned p = 0; p < Profiler::PHASES; ++p)
+    {
+        phases[p] = profiler.stats(static_cast<Profiler::Phase>(p));
+    }
+
+    this->updates = updates;
+    time = env.getTime();
+
+    // Cells big enough to hold a few particles each, if they were spread evenly over
+    // the environment, so a view of the window walks about as many cells as it has
+    // particles in it.
+    std::vector<unsigned> dims = env.dimensions();
+    double spacing = n > 0 ? std::sqrt(static_cast<double>(dims.at(0)) * dims.at(1) / n) : 0;
+    grid.build(x, y, radius, 2 * spacing);
+}
+
+
+void RenderFrame::visible(double left, double top, double right, double bottom, std::vector<unsigned>& out) const
+{
+    out.clear();
+    grid.query(left, top, right, bottom, out);
+
+    // Keep only the candidates whose bounding box overlaps the rectangle.
+    unsigned kept = 0;
+    for (unsigned i : out)
+    {
+        if (x[i] + radius[i] >= left && x[i] - radius[i] <= right
+            && y[i] + radius[i] >= top && y[i] - radius[i] <= bottom)
+        {
+            out[kept++] = i;
+        }
+    }
+    out.resize(kept);
+}
+
+
+unsigned RenderFrame::size() const
+{
+    return ids.size();
+}
+
+
+unsigned RenderFrame::indexOf(ParticleStore::Id id) const
+{
+    for (unsigned i = 0; i < ids.size(); ++i)
+    {
+        if (ids[i] == id)
+        {
+            return i;
+        }
+    }
+
+    return ParticleStore::NONE;
+}
+
+
+ParticleStore::Id RenderFrame::findParticle(double x, double y) const
+{
+    for (unsigned i = 0; i < ids.size(); ++i)
+    {
+        if (std::hypot(this->x[i] - x, this->y[i] - y) <= radius[i])
+        {
+            return ids[i];
+        }
+    }
+
+    return ParticleStore::NO_ID;
+}
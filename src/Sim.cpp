@@ -1,9 +1,22 @@
 #include "Sim.hpp"
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include "Log.hpp"
+#include "Snapshot.hpp"
 
 
 namespace
 {
     double const PI = std::atan(1) * 4;
+
+    // Where F5 saves the environment to, and F9 loads it from.
+    const char* const SNAPSHOT_PATH = "gravsim.snapshot";
+
+    // The font looked for next to the executable, and the width of the texture its
+    // glyphs are packed into.
+    const char* const FONT_FILE = "grav.ttf";
+    const int ATLAS_WIDTH = 512;
 }
 
 
@@ -16,16 +29,46 @@ Sim::Sim(unsigned numParticles)
     mouseY{-1},
     ghostRad{5},
     showGhostParticle{false},
-    fontSize{10},
-    frozenP{nullptr},
+    fontSize{20},
+    seed{std::random_device()()},
+    initialParticles{numParticles},
+    updates{0},
+    camera{0, 0},
+    panning{false},
+    geometryFailed{false},
+    glyphAtlas{nullptr},
+    showProfiler{false},
+    orbitCenter{ParticleStore::NO_ID},
     choosingOrbit{false}
 {
+    // Everything random in the environment comes from std::rand, so this is all it
+    // takes to be able to make the same environment again.
+    std::srand(seed);
     env = Environment(numParticles);
+    env.setThreads(ThreadPool::hardwareThreads());
+
+    // The window is as big as the environment.
+    camera = Camera(env.dimensions().at(0), env.dimensions().at(1));
+    density.resize(env.dimensions().at(0), env.dimensions().at(1));
 }
 
 
 Sim::~Sim()
 {
+    running = false;
+    if (simulation.joinable())
+    {
+        simulation.join();
+    }
+
+    input.stop(updates);
+
+    if (glyphAtlas)
+    {
+        SDL_DestroyTexture(glyphAtlas);
+        glyphAtlas = nullptr;
+    }
+
     if (ren)
     {
         SDL_DestroyRenderer(ren);
@@ -43,12 +86,18 @@ Sim::~Sim()
 }
 
 
+bool Sim::record(const char* path)
+{
+    return input.record(path, InputLog::headerFor(env, seed, initialParticles));
+}
+
+
 bool Sim::Init()
 {
     // SDL_Init will return -1 on error.
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
-        std::cout << "Video Initialization Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Video Initialization Error: %s", SDL_GetError());
         return false;
     }
 
@@ -64,7 +113,7 @@ bool Sim::Init()
 
     if (nullptr == win)
     {
-        std::cout << "Window Creation Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Window Creation Error: %s", SDL_GetError());
         return false;
     }
 
@@ -76,7 +125,7 @@ bool Sim::Init()
 
     if (nullptr == ren)
     {
-        std::cerr << "Renderer Creation Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("Renderer Creation Error: %s", SDL_GetError());
         return false;
     }
 
@@ -85,9 +134,85 @@ bool Sim::Init()
     // Init text.
     if (TTF_Init() < 0)
     {
-        std::cerr << "Failed to initialize SDL_TTF: " << TTF_GetError() << std::endl;
+        LOG_ERROR("Failed to initialize SDL_TTF: %s", TTF_GetError());
+    }
+    else
+    {
+        loadFont();
+    }
+
+    return true;
+}
+
+
+bool Sim::loadFont()
+{
+    std::string path;
+    if (const char* configured = std::getenv("GRAVSIM_FONT"))
+    {
+        path = configured;
+    }
+    else
+    {
+        char* base = SDL_GetBasePath();
+        path = std::string(base ? base : "") + FONT_FILE;
+        SDL_free(base);
+    }
+
+    TTF_Font* font = TTF_OpenFont(path.c_str(), fontSize);
+    if (nullptr == font)
+    {
+        LOG_ERROR("Failed to open font %s, so no text will be drawn: %s", path.c_str(), TTF_GetError());
+        return false;
+    }
+
+    // Render each glyph on its own, then copy them all into one surface.
+    std::vector<SDL_Surface*> rendered;
+    std::vector<TextBatch::Glyph> glyphs;
+    for (char c = TextBatch::FIRST; c <= TextBatch::LAST; ++c)
+    {
+        Uint16 ch = static_cast<unsigned char>(c);
+        SDL_Surface* surface = TTF_RenderGlyph_Blended(font, ch, SDL_Color{255, 255, 255, 255});
+        int advance = 0;
+        TTF_GlyphMetrics(font, ch, nullptr, nullptr, nullptr, nullptr, &advance);
+
+        rendered.push_back(surface);
+        glyphs.push_back(TextBatch::Glyph{0, 0, surface ? surface->w : 0, surface ? surface->h : 0, advance});
+    }
+    TTF_CloseFont(font);
+
+    int height = TextBatch::pack(glyphs, ATLAS_WIDTH);
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (atlas)
+    {
+        for (std::size_t i = 0; i < rendered.size(); ++i)
+        {
+            if (rendered[i])
+            {
+                // Copy the glyph's alpha as it is, rather than blending it onto the
+                // empty atlas.
+                SDL_SetSurfaceBlendMode(rendered[i], SDL_BLENDMODE_NONE);
+                SDL_Rect place{glyphs[i].atlasX, glyphs[i].atlasY, glyphs[i].width, glyphs[i].height};
+                SDL_BlitSurface(rendered[i], nullptr, atlas, &place);
+            }
+        }
+        glyphAtlas = SDL_CreateTextureFromSurface(ren, atlas);
+        SDL_FreeSurface(atlas);
     }
 
+    for (SDL_Surface* surface : rendered)
+    {
+        SDL_FreeSurface(surface);
+    }
+
+    if (nullptr == glyphAtlas)
+    {
+        LOG_ERROR("Failed to build the glyph atlas, so no text will be drawn: %s", SDL_GetError());
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(glyphAtlas, SDL_BLENDMODE_BLEND);
+    textBatch.setGlyphs(glyphs, ATLAS_WIDTH, height);
     return true;
 }
 
@@ -132,7 +257,7 @@ void Sim::drawCirclePixels(double xc, double yc, double x, double y, bool filled
 }
 
 
-void Sim::drawSDLCircle(double h, double k, double radius, bool filled, SDL_Color color)
+void Sim::drawSDLCircle(double h, double k, double radius, bool filled, Color color)
 {
     SDL_SetRenderDrawColor(ren, color.r, color.g, color.b, 255);
 
@@ -163,20 +288,53 @@ void Sim::drawSDLCircle(double h, double k, double radius, bool filled, SDL_Colo
 }
 
 
-void Sim::drawParticles()
+void Sim::drawParticles(const RenderFrame& frame)
 {
-    for (Particle* p : env.getParticles())
+    frame.visible(camera.left(), camera.top(), camera.right(), camera.bottom(), inView);
+    double zoom = camera.getZoom();
+
+    circles.clear();
+    density.clear();
+    for (unsigned i : inView)
     {
-        drawSDLCircle(p->x(), p->y(), p->getRadius(), true, p->getColor());
-        if (!(p->hasGravity()))
+        double x = camera.toScreenX(frame.x[i]);
+        double y = camera.toScreenY(frame.y[i]);
+        double r = frame.radius[i] * zoom;
+
+        if (r >= MIN_CIRCLE_RADIUS)
+        {
+            circles.addCircle(x, y, r, frame.color[i]);
+        }
+        else
         {
-            drawParticleEffects(p);
+            density.add(x, y, PI * r * r, frame.color[i]);
         }
     }
+    density.drawInto(circles);
+
+    if (!drawBatch())
+    {
+        for (unsigned i : inView)
+        {
+            drawSDLCircle(camera.toScreenX(frame.x[i]), camera.toScreenY(frame.y[i]), frame.radius[i] * zoom, true, frame.color[i]);
+        }
+    }
+
+    for (const RenderFrame::Laser& laser : frame.lasers)
+    {
+        drawParticleEffects(laser);
+    }
+
+    // Stop choosing an orbit if the center has been removed.
+    unsigned center = choosingOrbit ? frame.indexOf(orbitCenter) : ParticleStore::NONE;
+    if (ParticleStore::NONE == center)
+    {
+        choosingOrbit = false;
+    }
 
     if (showGhostParticle || choosingOrbit)
     {
-        drawSDLCircle(mouseX, mouseY, ghostRad, true, SDL_Color{100, 100, 100});
+        drawSDLCircle(mouseX, mouseY, ghostRad * zoom, true, Color{100, 100, 100});
         addText(std::to_string((int)ghostRad), mouseX, mouseY - 30);
     }
 
@@ -184,61 +342,85 @@ void Sim::drawParticles()
     {
         // Draw a circle, centered at the orbitCenter particle, and that extends to
         // the mouse cursor.
+        double cx = camera.toScreenX(frame.x[center]);
+        double cy = camera.toScreenY(frame.y[center]);
         drawSDLCircle(
-            (*orbitCenter).x(),
-            (*orbitCenter).y(),
-            std::hypot(mouseX - (*orbitCenter).x(), mouseY - (*orbitCenter).y()),
+            cx,
+            cy,
+            std::hypot(mouseX - cx, mouseY - cy),
             false,
-            SDL_Color{100, 100, 100}
+            Color{100, 100, 100}
         );
     }
 }
 
 
-void Sim::drawParticleEffects(Particle* p)
+bool Sim::drawBatch()
 {
-
-    Attacker* a = (Attacker*)p;
-    if (a->lockedOn())
+    static_assert(sizeof(CircleBatch::Vertex) == sizeof(SDL_Vertex)
+        && offsetof(CircleBatch::Vertex, r) == offsetof(SDL_Vertex, color)
+        && offsetof(CircleBatch::Vertex, u) == offsetof(SDL_Vertex, tex_coord),
+        "CircleBatch::Vertex has to match SDL_Vertex.");
+
+    const std::vector<CircleBatch::Vertex>& vertices = circles.vertices();
+    const std::vector<int>& indices = circles.indices();
+    if (indices.empty())
     {
-        SDL_SetRenderDrawColor(ren, 255, 165, 0, 255);
-        Particle* t = a->getTarget();
-        double tx = t->x();
-        double ty = t->y();
-        double dy = ty - a->y();
-        double dx = tx - a->x();
-        double angle = std::atan2(dy, dx);
+        return true;
+    }
 
-        if (a->getWeaponStrength() < 20)
-        {
-            // Draw tier 2 laser.
-            drawAttackerLaser(2, angle, a->x(), a->y(), tx, ty);
-        }
-        else if (a->getWeaponStrength() < 40)
-        {
-            // Draw tier 3 laser.
-            drawAttackerLaser(3, angle, a->x(), a->y(), tx, ty);
-        }
-        else if (a->getWeaponStrength() < 60)
-        {
-            // Draw tier 4 laser.
-            drawAttackerLaser(4, angle, a->x(), a->y(), tx, ty);
-        }
-        else if (a->getWeaponStrength() < 200)
-        {
-            // Draw tier 5 laser.
-            drawAttackerLaser(5, angle, a->x(), a->y(), tx, ty);
-        }
-        else 
-        {
-            SDL_SetRenderDrawColor(ren, 200, 50, 200, 255);
-            // Draw tier 6 laser.
-            drawAttackerLaser(6, angle, a->x(), a->y(), tx, ty);
-        }
+    if (!geometryFailed && SDL_RenderGeometry(
+        ren,
+        nullptr,
+        reinterpret_cast<const SDL_Vertex*>(vertices.data()), vertices.size(),
+        indices.data(), indices.size()) < 0)
+    {
+        LOG_WARN("Can't draw triangles, so circles will be drawn a line at a time: %s", SDL_GetError());
+        geometryFailed = true;
     }
+
+    return !geometryFailed;
 }
 
 
+void Sim::drawParticleEffects(const RenderFrame::Laser& laser)
+{
+    SDL_SetRenderDrawColor(ren, 255, 165, 0, 255);
+    double ax = camera.toScreenX(laser.ax);
+    double ay = camera.toScreenY(laser.ay);
+    double tx = camera.toScreenX(laser.tx);
+    double ty = camera.toScreenY(laser.ty);
+    double dy = ty - ay;
+    double dx = tx - ax;
+    double angle = std::atan2(dy, dx);
+
+    if (laser.strength < 20)
+    {
+        // Draw tier 2 laser.
+        drawAttackerLaser(2, angle, ax, ay, tx, ty);
+    }
+    else if (laser.strength < 40)
+    {
+        // Draw tier 3 laser.
+        drawAttackerLaser(3, angle, ax, ay, tx, ty);
+    }
+    else if (laser.strength < 60)
+    {
+        // Draw tier 4 laser.
+        drawAttackerLaser(4, angle, ax, ay, tx, ty);
+    }
+    else if (laser.strength < 200)
+    {
+        // Draw tier 5 laser.
+        drawAttackerLaser(5, angle, ax, ay, tx, ty);
+    }
+    else 
+    {
+        SDL_SetRenderDrawColor(ren, 200, 50, 200, 255);
+        // Draw tier 6 laser.
+        drawAttackerLaser(6, angle, ax, ay, tx, ty);
+    }
+}
 
 
 void Sim::drawAttackerLaser(int tier, double angle, double ax, double ay, double tx, double ty)
@@ -262,6 +444,28 @@ void Sim::drawAttackerLaser(int tier, double angle, double ax, double ay, double
 }
 
 
+void Sim::addProfilerText(const RenderFrame& frame)
+{
+    addText("phase        min    avg    p99 (ms)", 10, 10);
+
+    for (unsigned p = 0; p < Profiler::PHASES; ++p)
+    {
+        // The phases from Circles on are timed by this thread, and the ones before
+        // them by the simulation thread.
+        Profiler::Phase phase = static_cast<Profiler::Phase>(p);
+        Profiler::Stats stats = phase >= Profiler::Phase::Circles ? renderProfiler.stats(phase) : frame.phases[p];
+
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-10s %6.2f %6.2f %6.2f", Profiler::phaseName(phase), stats.min, stats.avg, stats.p99);
+        addText(line, 10, 10 + 22 * (p + 1));
+    }
+
+    char line[64];
+    std::snprintf(line, sizeof(line), "drawn %zu of %u at %.3gx", inView.size(), frame.size(), camera.getZoom());
+    addText(line, 10, 10 + 22 * (Profiler::PHASES + 1));
+}
+
+
 void Sim::addText(std::string text, int x, int y)
 {
     Text t{text, x, y};
@@ -269,54 +473,82 @@ void Sim::addText(std::string text, int x, int y)
 }
 
 
-// Draw text to the screen.
-void Sim::drawText(const char* text, int x, int y) const
+void Sim::drawText()
 {
-    TTF_Font* font = TTF_OpenFont("/home/scotttw/Projects/GravSim/grav.ttf", 20);
-
-    if (!font)
+    textBatch.clear();
+    for (const Text& text : texts)
     {
-        std::cout << font << std::endl;
-        std::cout << TTF_GetError() << std::endl;
+        textBatch.addText(text.t, text.x, text.y, Color{255, 255, 255});
     }
+    texts.clear();
 
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, {255, 255, 255});
-    SDL_Texture* textTexture = SDL_CreateTextureFromSurface(ren, textSurface);
-
-    SDL_Rect textRect;
-    textRect.x = x;
-    textRect.y = y;
-
-    SDL_QueryTexture(textTexture, NULL, NULL, &textRect.w, &textRect.h);
+    const std::vector<TextBatch::Vertex>& vertices = textBatch.vertices();
+    const std::vector<int>& indices = textBatch.indices();
+    if (indices.empty())
+    {
+        return;
+    }
 
-    SDL_RenderCopy(ren, textTexture, NULL, &textRect);
+    if (!geometryFailed && SDL_RenderGeometry(
+        ren,
+        glyphAtlas,
+        reinterpret_cast<const SDL_Vertex*>(vertices.data()), vertices.size(),
+        indices.data(), indices.size()) < 0)
+    {
+        LOG_WARN("Can't draw triangles, so text will be copied a glyph at a time: %s", SDL_GetError());
+        geometryFailed = true;
+    }
 
-    SDL_FreeSurface(textSurface);
-    SDL_DestroyTexture(textTexture);
-    TTF_CloseFont(font);
+    if (geometryFailed)
+    {
+        // Copy each glyph's rectangle out of the atlas, using its top left and
+        // bottom right corners.
+        int w = 0;
+        int h = 0;
+        SDL_QueryTexture(glyphAtlas, nullptr, nullptr, &w, &h);
+        for (std::size_t q = 0; q + 3 < vertices.size(); q += 4)
+        {
+            const TextBatch::Vertex& topLeft = vertices[q];
+            const TextBatch::Vertex& bottomRight = vertices[q + 2];
+            SDL_Rect source{
+                static_cast<int>(std::lround(topLeft.u * w)),
+                static_cast<int>(std::lround(topLeft.v * h)),
+                static_cast<int>(std::lround((bottomRight.u - topLeft.u) * w)),
+                static_cast<int>(std::lround((bottomRight.v - topLeft.v) * h))
+            };
+            SDL_Rect place{static_cast<int>(std::lround(topLeft.x)), static_cast<int>(std::lround(topLeft.y)), source.w, source.h};
+            SDL_RenderCopy(ren, glyphAtlas, &source, &place);
+        }
+    }
 }
 
 
-void Sim::drawScreen()
+void Sim::drawScreen(const RenderFrame& frame)
 {
     // SDL_RenderClear fills the entire screen with the color set by
     /// SDL_SetRenderDrawColor.
     SDL_SetRenderDrawColor(ren, 0, 0, 0, 255);
     SDL_RenderClear(ren);
 
+    Profiler& profiler = renderProfiler;
+
     // Draw the particles on top of that color.
-    drawParticles();
+    {
+        Profiler::Scope scope(profiler, Profiler::Phase::Circles);
+        drawParticles(frame);
+    }
 
-    // Draw text.
-    for (auto it = texts.begin(); it != texts.end();)
+    if (showProfiler)
     {
-        // The SDL function to render text requires a const char*.
-        // The .c_str() method converts from std::string to const char*.
-        drawText((*it).t.c_str(), (*it).x, (*it).y);
-        it = texts.erase(it);
+        addProfilerText(frame);
     }
 
+    // Draw text.
+    Profiler::Scope textScope(profiler, Profiler::Phase::Text);
+    drawText();
+
     // Then present the completed frame.
+    Profiler::Scope presentScope(profiler, Profiler::Phase::Present);
     SDL_RenderPresent(ren);
 }
 
@@ -329,9 +561,20 @@ int Sim::run()
     }
 
     SDL_Event Event;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    simulation = std::thread(&Sim::simulate, this);
 
     while (running)
     {
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        // Take the latest frame, if the simulation has published a new one. The
+        // particles under the mouse are looked for in the frame being drawn, since
+        // that's what the user is looking at.
+        frames.update();
+        const RenderFrame& frame = frames.front();
+
         while (SDL_PollEvent(&Event) != 0)
         {
             if (Event.type == SDL_QUIT)
@@ -344,6 +587,10 @@ int Sim::run()
                 {
                     showGhostParticle = true;
                 }
+                else if (Event.button.button == SDL_BUTTON_MIDDLE)
+                {
+                    panning = true;
+                }
             }
             else if (Event.type == SDL_MOUSEBUTTONUP)
             {
@@ -351,17 +598,32 @@ int Sim::run()
                 {
                     showGhostParticle = false;
                 }
+                else if (Event.button.button == SDL_BUTTON_MIDDLE)
+                {
+                    panning = false;
+                }
                 else if (Event.button.button == SDL_BUTTON_RIGHT && showGhostParticle)
                 {
-                    MotionVector<double> newMot = MotionVector<double>(0, 0);
-                    env.placeParticle(new Particle(ghostRad, mouseX, mouseY, newMot));
+                    send(Command{Command::Type::Input, InputLog::Event{0, InputLog::Action::PlaceParticle, 0, ghostRad, camera.toWorldX(mouseX), camera.toWorldY(mouseY), 0, 0}, 0});
                 }
             }
             else if (Event.type == SDL_MOUSEMOTION)
             {
                 // Get the x and y coordinates of the mouse.
-                mouseX = Event.button.x;
-                mouseY = Event.button.y;
+                mouseX = Event.motion.x;
+                mouseY = Event.motion.y;
+
+                if (panning)
+                {
+                    camera.pan(Event.motion.xrel, Event.motion.yrel);
+                }
+            }
+            else if (Event.type == SDL_MOUSEWHEEL && !showGhostParticle && !choosingOrbit)
+            {
+                if (Event.wheel.y != 0)
+                {
+                    camera.zoomAt(Event.wheel.y > 0 ? ZOOM_STEP : 1 / ZOOM_STEP, mouseX, mouseY);
+                }
             }
             else if (Event.type == SDL_MOUSEWHEEL)
             {
@@ -374,78 +636,207 @@ int Sim::run()
                     ghostRad = ghostRad > 1 ? ghostRad - 1 : 1;
                 }
             }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_LEFT)
+            {
+                camera.pan(PAN_STEP, 0);
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_RIGHT)
+            {
+                camera.pan(-PAN_STEP, 0);
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_UP)
+            {
+                camera.pan(0, PAN_STEP);
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_DOWN)
+            {
+                camera.pan(0, -PAN_STEP);
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_0)
+            {
+                camera.reset();
+            }
             else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_SPACE)
             {
-                // Search if there is a particle near the mouse cursor.
-                if ( (frozenP = env.findParticle(mouseX, mouseY)) != nullptr )
-                {
-                    if ( (*frozenP).isFrozen() )
-                    {
-                        (*frozenP).unFreeze();
-                    }
-                    else
-                    {
-                        (*frozenP).freeze();
-                    }
-                }
+                // Freeze or unfreeze the particle under the mouse cursor, if there is one.
+                send(Command{Command::Type::Input, InputLog::Event{0, InputLog::Action::ToggleFreeze, 0, 0, camera.toWorldX(mouseX), camera.toWorldY(mouseY), 0, 0}, 0});
             }
             else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_o && !choosingOrbit)
             {
                 // See if we clicked on a particle.
-                if ( (orbitCenter = env.findParticle(mouseX, mouseY)) != nullptr )
+                if ( (orbitCenter = frame.findParticle(camera.toWorldX(mouseX), camera.toWorldY(mouseY))) != ParticleStore::NO_ID )
                 {
-                    std::cout << "Orbit chosen" << std::endl;
+                    LOG_INFO("Orbit chosen");
                     choosingOrbit = true;
                 }
             }
             else if (Event.type == SDL_KEYUP && Event.key.keysym.sym == SDLK_o && choosingOrbit)
             {
-                std::cout << "Stopped choosing orbit" << std::endl;
+                LOG_INFO("Stopped choosing orbit");
+                choosingOrbit = false;
+                send(Command{Command::Type::PlaceOrbit, InputLog::Event{0, InputLog::Action::PlaceParticle, 0, ghostRad, camera.toWorldX(mouseX), camera.toWorldY(mouseY), 0, 0}, orbitCenter});
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_a)
+            {
+                // Place an attacker, false sets gravity to be off.
+                send(Command{Command::Type::Input, InputLog::Event{0, InputLog::Action::PlaceAttacker, 0, 0, camera.toWorldX(mouseX), camera.toWorldY(mouseY), 0, 0}, 0});
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_p)
+            {
+                showProfiler = !showProfiler;
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_F5)
+            {
+                send(Command{Command::Type::SaveSnapshot, InputLog::Event{}, 0});
+            }
+            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_F9)
+            {
+                // IDs from before the load won't mean anything after it.
                 choosingOrbit = false;
+                send(Command{Command::Type::LoadSnapshot, InputLog::Event{}, 0});
+            }
+        }
 
-                double ocX = (*orbitCenter).x();
-                double ocY = (*orbitCenter).y();
+        drawScreen(frame);
+        renderProfiler.endFrame();
 
-                // Find the angle between the mouse cursor and the orbitCenter.
-                double orbitAngle = std::atan2(ocY - mouseY, ocX - mouseX);
+        // Sleep until the next frame is due. The simulation carries on meanwhile.
+        double elapsed = static_cast<double>(SDL_GetPerformanceCounter() - start) / frequency;
+        if (elapsed < FRAME_INTERVAL)
+        {
+            SDL_Delay(static_cast<Uint32>((FRAME_INTERVAL - elapsed) * 1000));
+        }
+    }
 
-                // Subtract 90 degrees.
-                orbitAngle = std::fmod(orbitAngle - 0.5 * M_PI, 2 * M_PI);
+    simulation.join();
+    return 0;
+}
 
-                // Distance between mouse and orbitCenter.
-                double distBetweenBodies = std::hypot(mouseX - ocX, mouseY - ocY);
 
-                std::cout << "Choosing particle with radius " << ghostRad << " meters and mass " << Particle::calcMass(ghostRad, 5500) << "kg" << std::endl;
+void Sim::send(const Command& command)
+{
+    std::lock_guard<std::mutex> guard(commandLock);
+    commands.push_back(command);
+}
+
 
-                // Calculate the necessary velocity.
-                double orbitalVelocity = std::sqrt( 
-                    (GRAVITATIONAL_CONSTANT * (*orbitCenter).getMass()) / distBetweenBodies );
+void Sim::simulate()
+{
+    typedef std::chrono::steady_clock Clock;
 
-                // Create a MotionVector for the new particle.
-                MotionVector<double> newMot = MotionVector<double>(
-                    orbitalVelocity * std::cos(orbitAngle),
-                    orbitalVelocity * std::sin(orbitAngle)
-                );
+    std::vector<Command> pending;
 
-                // Place the particle.
-                env.placeParticle(new Particle(
-                    ghostRad,
-                    mouseX, mouseY,
-                    newMot + (*orbitCenter).getVelocity()
-                ));
-            }
-            else if (Event.type == SDL_KEYDOWN && Event.key.keysym.sym == SDLK_a)
+    // Real time that hasn't been simulated yet, in seconds.
+    double accumulator = 0;
+    Clock::time_point previous = Clock::now();
+
+    while (running)
+    {
+        {
+            std::lock_guard<std::mutex> guard(commandLock);
+            pending.swap(commands);
+        }
+        for (const Command& command : pending)
+        {
+            perform(command);
+        }
+        pending.clear();
+
+        Clock::time_point now = Clock::now();
+        accumulator += std::chrono::duration<double>(now - previous).count();
+        previous = now;
+
+        // Step the environment until it has caught up with real time, or until it
+        // has used up its budget. Whatever time is left over when the budget runs
+        // out is dropped, so falling behind once can't make it fall further behind.
+        double dt = env.getTimeStep();
+        while (accumulator >= dt)
+        {
+            env.update();
+            env.getProfiler().endFrame();
+            ++updates;
+            accumulator -= dt;
+
+            if (std::chrono::duration<double>(Clock::now() - now).count() > PHYSICS_BUDGET)
             {
-                // Place an attacker, false sets gravity to be off.
-                env.placeParticle(new Attacker(mouseX, mouseY));
+                accumulator = std::fmod(accumulator, dt);
+                break;
             }
         }
 
-        env.update();
+        frames.back().capture(env, updates);
+        frames.publish();
+
+        // Sleep until the next step is due.
+        if (accumulator < dt)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(dt - accumulator));
+        }
+    }
+}
+
+
+void Sim::perform(const Command& command)
+{
+    InputLog::Event event = command.event;
+    event.step = updates;
+
+    switch (command.type)
+    {
+        case Command::Type::Input:
+            input.apply(env, event);
+            break;
+        case Command::Type::PlaceOrbit:
+        {
+            ParticleStore& particles = env.getParticles();
+            unsigned center = particles.indexOf(command.center);
+            if (ParticleStore::NONE == center)
+            {
+                break;
+            }
+
+            double ocX = particles.x[center];
+            double ocY = particles.y[center];
 
-        drawScreen();
+            // Find the angle between the mouse cursor and the orbitCenter.
+            double orbitAngle = std::atan2(ocY - event.y, ocX - event.x);
 
-        SDL_Delay(16);
+            // Subtract 90 degrees.
+            orbitAngle = std::fmod(orbitAngle - 0.5 * M_PI, 2 * M_PI);
+
+            // Distance between mouse and orbitCenter.
+            double distBetweenBodies = std::hypot(event.x - ocX, event.y - ocY);
+
+            LOG_INFO("Choosing particle with radius %g meters and mass %gkg", event.radius, Particle::calcMass(event.radius, 5500));
+
+            // Calculate the necessary velocity.
+            double orbitalVelocity = std::sqrt( 
+                (GRAVITATIONAL_CONSTANT * particles.mass[center]) / distBetweenBodies );
+
+            // Place the particle, moving along with the orbit center.
+            event.vx = orbitalVelocity * std::cos(orbitAngle) + particles.vx[center];
+            event.vy = orbitalVelocity * std::sin(orbitAngle) + particles.vy[center];
+            input.apply(env, event);
+            break;
+        }
+        case Command::Type::SaveSnapshot:
+            if (Snapshot::save(env, SNAPSHOT_PATH))
+            {
+                LOG_INFO("Saved a snapshot to %s", SNAPSHOT_PATH);
+            }
+            break;
+        case Command::Type::LoadSnapshot:
+            if (Snapshot::load(env, SNAPSHOT_PATH))
+            {
+                LOG_INFO("Loaded a snapshot from %s", SNAPSHOT_PATH);
+
+                // A replay can't load the same snapshot, so the recording ends here.
+                if (input.isRecording())
+                {
+                    LOG_WARN("Stopped recording input because a snapshot was loaded");
+                    input.stop(updates);
+                }
+            }
+            break;
     }
-    return 0;
 }
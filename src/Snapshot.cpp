@@ -0,0 +1,335 @@
+#include "Snapshot.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Log.hpp"
+
+
+// The header and records are written straight from memory, which is only the
+// documented format on a little-endian machine.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Snapshots are only supported on little-endian machines.");
+static_assert(sizeof(Snapshot::Header) == 72 && std::is_trivially_copyable<Snapshot::Header>::value, "Snapshot header has padding.");
+static_assert(sizeof(Snapshot::AttackerRecord) == 48, "Snapshot attacker record has padding.");
+static_assert(sizeof(unsigned) == sizeof(std::uint32_t), "Slots are stored as 32 bit numbers.");
+static_assert(sizeof(ParticleStore::Id) == sizeof(std::uint64_t), "IDs are stored as 64 bit numbers.");
+
+
+namespace
+{
+    const char MAGIC[8] = {'G', 'R', 'A', 'V', 'S', 'N', 'A', 'P'};
+
+
+    // Return n rounded up to the next multiple of the section alignment.
+    std::size_t align(std::size_t n)
+    {
+        return (n + Snapshot::SECTION_ALIGNMENT - 1) / Snapshot::SECTION_ALIGNMENT * Snapshot::SECTION_ALIGNMENT;
+    }
+
+
+    // Write a section at offset, padding with zeros from pos up to it.
+    bool writeSection(std::FILE* file, std::size_t& pos, std::size_t offset, const void* data, std::size_t bytes)
+    {
+        static const char zeros[Snapshot::SECTION_ALIGNMENT] = {};
+        std::size_t padding = offset - pos;
+        if (std::fwrite(zeros, 1, padding, file) != padding || (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes))
+        {
+            return false;
+        }
+
+        pos = offset + bytes;
+        return true;
+    }
+
+
+    // Copy n Reals stored with realBytes bytes each, converting them if this build
+    // uses the other precision.
+    void copyReals(std::vector<Real>& out, const char* data, std::size_t n, std::uint32_t realBytes)
+    {
+        if (sizeof(float) == realBytes)
+        {
+            const float* values = reinterpret_cast<const float*>(data);
+            out.assign(values, values + n);
+        }
+        else
+        {
+            const double* values = reinterpret_cast<const double*>(data);
+            out.assign(values, values + n);
+        }
+    }
+
+
+    template <typename T>
+    void copyArray(std::vector<T>& out, const char* data, std::size_t n)
+    {
+        const T* values = reinterpret_cast<const T*>(data);
+        out.assign(values, values + n);
+    }
+
+
+    // A read only mapping of a whole file, which is unmapped when it goes away.
+    struct MappedFile
+    {
+        explicit MappedFile(const char* path)
+        {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+            {
+                return;
+            }
+
+            struct stat info;
+            if (0 == fstat(fd, &info) && info.st_size > 0)
+            {
+                void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (MAP_FAILED != mapped)
+                {
+                    data = static_cast<const char*>(mapped);
+                    size = info.st_size;
+                    // Each section is read from start to end exactly once.
+                    madvise(mapped, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+                }
+            }
+            close(fd);
+        }
+
+        ~MappedFile()
+        {
+            if (data)
+            {
+                munmap(const_cast<char*>(data), size);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data = nullptr;
+        std::size_t size = 0;
+    };
+}
+
+
+bool Snapshot::save(const Environment& env, const char* path)
+{
+    const ParticleStore& particles = env.particles;
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.realBytes = sizeof(Real);
+    header.width = env.width;
+    header.height = env.height;
+    header.particles = particles.size();
+    header.slots = particles.slots.size();
+    header.freeSlots = particles.freeSlots.size();
+    header.attackers = env.attackers.size();
+    header.time = env.time;
+    header.timeStep = env.timeStep;
+
+    std::vector<AttackerRecord> records;
+    records.reserve(env.attackers.size());
+    for (const Attacker& a : env.attackers)
+    {
+        records.push_back(AttackerRecord{a.body, a.target, a.ws, a.heading.x, a.heading.y, a.lifespan, a.range});
+    }
+
+    std::FILE* file = std::fopen(path, "wb");
+    if (nullptr == file)
+    {
+        LOG_ERROR("Couldn't open %s to save a snapshot: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    Layout layout = layoutFor(header);
+    const std::vector<Real>* reals[9] = {
+        &particles.x, &particles.y, &particles.vx, &particles.vy, &particles.mass,
+        &particles.radius, &particles.density, &particles.oriMass, &particles.oriRad
+    };
+    std::size_t n = particles.size();
+
+    std::size_t pos = 0;
+    bool ok = writeSection(file, pos, 0, &header, sizeof(header));
+    for (unsigned r = 0; r < 9 && ok; ++r)
+    {
+        ok = writeSection(file, pos, layout.reals[r], reals[r]->data(), n * sizeof(Real));
+    }
+    ok = ok
+        && writeSection(file, pos, layout.flags, particles.flags.data(), n)
+        && writeSection(file, pos, layout.ids, particles.ids.data(), n * sizeof(ParticleStore::Id))
+        && writeSection(file, pos, layout.slots, particles.slots.data(), header.slots * sizeof(unsigned))
+        && writeSection(file, pos, layout.generations, particles.generations.data(), header.slots * sizeof(std::uint32_t))
+        && writeSection(file, pos, layout.freeSlots, particles.freeSlots.data(), header.freeSlots * sizeof(unsigned))
+        && writeSection(file, pos, layout.attackers, records.data(), records.size() * sizeof(AttackerRecord))
+        && writeSection(file, pos, layout.end, nullptr, 0);
+
+    if (0 != std::fclose(file) || !ok)
+    {
+        LOG_ERROR("Couldn't write the snapshot %s", path);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool Snapshot::load(Environment& env, const char* path)
+{
+    MappedFile file(path);
+    if (nullptr == file.data)
+    {
+        LOG_ERROR("Couldn't map the snapshot %s: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    Header header;
+    if (file.size < sizeof(header))
+    {
+        LOG_ERROR("%s is too short to be a snapshot", path);
+        return false;
+    }
+    std::memcpy(&header, file.data, sizeof(header));
+
+    if (0 != std::memcmp(header.magic, MAGIC, sizeof(MAGIC)))
+    {
+        LOG_ERROR("%s isn't a snapshot", path);
+        return false;
+    }
+    if (VERSION != header.version)
+    {
+        LOG_ERROR("%s is a version %u snapshot, but only version %u can be loaded", path, header.version, VERSION);
+        return false;
+    }
+
+    // Check the counts before working out the layout from them, so it can't overflow.
+    std::uint64_t maxSlots = (std::uint64_t(1) << ParticleStore::SLOT_BITS) - 1;
+    if ((sizeof(float) != header.realBytes && sizeof(double) != header.realBytes)
+        || header.slots > maxSlots || header.particles > header.slots || header.freeSlots > header.slots
+        || header.attackers > header.particles || layoutFor(header).end > file.size)
+    {
+        LOG_ERROR("The snapshot %s is corrupt or cut short", path);
+        return false;
+    }
+
+    Layout layout = layoutFor(header);
+    std::size_t n = header.particles;
+    const ParticleStore::Id* ids = reinterpret_cast<const ParticleStore::Id*>(file.data + layout.ids);
+    const unsigned* slots = reinterpret_cast<const unsigned*>(file.data + layout.slots);
+    const std::uint32_t* generations = reinterpret_cast<const std::uint32_t*>(file.data + layout.generations);
+    const unsigned* freeSlots = reinterpret_cast<const unsigned*>(file.data + layout.freeSlots);
+
+    // Make sure every ID leads back to its particle before trusting them, so a bad
+    // file can't send indexOf out of bounds later.
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        std::uint64_t slot = ids[i] & maxSlots;
+        if (slot >= header.slots || slots[slot] != i || generations[slot] != ids[i] >> ParticleStore::SLOT_BITS)
+        {
+            LOG_ERROR("The snapshot %s has a bad ID at index %zu", path, i);
+            return false;
+        }
+    }
+    for (std::size_t s = 0; s < header.slots; ++s)
+    {
+        if (ParticleStore::NONE != slots[s] && (slots[s] >= n || (ids[slots[s]] & maxSlots) != s))
+        {
+            LOG_ERROR("The snapshot %s has a bad slot %zu", path, s);
+            return false;
+        }
+    }
+    // A slot listed twice would be handed out to two particles.
+    std::vector<bool> listedFree(header.slots, false);
+    for (std::size_t f = 0; f < header.freeSlots; ++f)
+    {
+        if (freeSlots[f] >= header.slots || ParticleStore::NONE != slots[freeSlots[f]] || listedFree[freeSlots[f]])
+        {
+            LOG_ERROR("The snapshot %s has a bad free slot %u", path, freeSlots[f]);
+            return false;
+        }
+        listedFree[freeSlots[f]] = true;
+    }
+
+    // Every attacker has to be steering a live particle flagged as one. Targets are
+    // looked up every update and may have died, so they aren't checked.
+    const std::uint8_t* flags = reinterpret_cast<const std::uint8_t*>(file.data + layout.flags);
+    const AttackerRecord* records = reinterpret_cast<const AttackerRecord*>(file.data + layout.attackers);
+    for (std::size_t i = 0; i < header.attackers; ++i)
+    {
+        std::uint64_t slot = records[i].body & maxSlots;
+        unsigned body = slot < header.slots ? slots[slot] : ParticleStore::NONE;
+        if (ParticleStore::NONE == body || ids[body] != records[i].body || 0 == (flags[body] & ParticleStore::ATTACKER))
+        {
+            LOG_ERROR("The snapshot %s has attacker %zu steering a particle that isn't an attacker", path, i);
+            return false;
+        }
+    }
+
+    ParticleStore& particles = env.particles;
+    std::vector<Real>* reals[9] = {
+        &particles.x, &particles.y, &particles.vx, &particles.vy, &particles.mass,
+        &particles.radius, &particles.density, &particles.oriMass, &particles.oriRad
+    };
+    for (unsigned r = 0; r < 9; ++r)
+    {
+        copyReals(*reals[r], file.data + layout.reals[r], n, header.realBytes);
+    }
+    copyArray(particles.flags, file.data + layout.flags, n);
+    copyArray(particles.ids, file.data + layout.ids, n);
+    copyArray(particles.slots, file.data + layout.slots, header.slots);
+    copyArray(particles.generations, file.data + layout.generations, header.slots);
+    copyArray(particles.freeSlots, file.data + layout.freeSlots, header.freeSlots);
+
+    env.attackers.clear();
+    for (std::size_t i = 0; i < header.attackers; ++i)
+    {
+        Attacker a(records[i].body);
+        a.target = records[i].target;
+        a.ws = records[i].weaponStrength;
+        a.heading = Vec2<double>(records[i].headingX, records[i].headingY);
+        a.lifespan = records[i].lifespan;
+        a.range = records[i].range;
+        env.attackers.push_back(a);
+    }
+
+    env.width = header.width;
+    env.height = header.height;
+    env.time = header.time;
+    env.timeStep = header.timeStep;
+    env.numParticles = n;
+    // Accelerations saved for block time steps belong to the old particles.
+    env.accIds.clear();
+
+    return true;
+}
+
+
+Snapshot::Layout Snapshot::layoutFor(const Header& header)
+{
+    Layout layout;
+    std::size_t pos = align(sizeof(Header));
+
+    for (std::size_t& offset : layout.reals)
+    {
+        offset = pos;
+        pos = align(pos + header.particles * header.realBytes);
+    }
+
+    layout.flags = pos;
+    pos = align(pos + header.particles);
+    layout.ids = pos;
+    pos = align(pos + header.particles * sizeof(std::uint64_t));
+    layout.slots = pos;
+    pos = align(pos + header.slots * sizeof(std::uint32_t));
+    layout.generations = pos;
+    pos = align(pos + header.slots * sizeof(std::uint32_t));
+    layout.freeSlots = pos;
+    pos = align(pos + header.freeSlots * sizeof(std::uint32_t));
+    layout.attackers = pos;
+    layout.end = pos + header.attackers * sizeof(AttackerRecord);
+
+    return layout;
+}
@@ -0,0 +1,253 @@
+#include "SpatialGrid.hpp"
+#include <algorithm>
+#include <cmath>
+
+
+SpatialGrid::SpatialGrid()
+    : cellSize{1}, mask{0}, largestBucket{0}, largestReach{0}
+{
+}
+
+
+template <typename Visit>
+void SpatialGrid::forEachSmallIn(double left, double top, double right, double bottom, unsigned first, Visit visit) const
+{
+    // A circle that isn't big is never wider than a cell, so one in a neighbouring
+    // cell can still reach into the rectangle.
+    std::int64_t x0 = cellCoord(left) - 1;
+    std::int64_t x1 = cellCoord(right) + 1;
+    std::int64_t y0 = cellCoord(top) - 1;
+    std::int64_t y1 = cellCoord(bottom) + 1;
+    unsigned bigBucket = mask + 1;
+
+    double cells = static_cast<double>(x1 - x0 + 1) * static_cast<double>(y1 - y0 + 1);
+    if (cells > entries.size())
+    {
+        for (unsigned i = first; i < cellX.size(); ++i)
+        {
+            if (bigBucket != bucketOf[i] && cellX[i] >= x0 && cellX[i] <= x1 && cellY[i] >= y0 && cellY[i] <= y1)
+            {
+                visit(i);
+            }
+        }
+        return;
+    }
+
+    for (std::int64_t cy = y0; cy <= y1; ++cy)
+    {
+        for (std::int64_t cx = x0; cx <= x1; ++cx)
+        {
+            // Other cells can share the bucket, so only take the circles in this one.
+            unsigned b = bucketFor(cx, cy);
+            auto e = std::lower_bound(entries.begin() + start[b], entries.begin() + start[b + 1], first);
+            for (; e != entries.begin() + start[b + 1]; ++e)
+            {
+                if (cellX[*e] == cx && cellY[*e] == cy)
+                {
+                    visit(*e);
+                }
+            }
+        }
+    }
+}
+
+
+void SpatialGrid::build(
+    const std::vector<Real>& xs,
+    const std::vector<Real>& ys,
+    const std::vector<Real>& radii,
+    double minCellSize
+)
+{
+    unsigned n = xs.size();
+
+    double totalRadius = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        totalRadius += radii[i];
+    }
+    double bigRadius = n > 0 ? BIG_RADIUS * totalRadius / n : 0;
+
+    // Cells only need to fit the circles that aren't big.
+    double cellRadius = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (radii[i] <= bigRadius)
+        {
+            cellRadius = std::max<double>(cellRadius, radii[i]);
+        }
+    }
+    cellSize = std::max(cellRadius > 0 ? 2 * cellRadius : 1, minCellSize);
+
+    // Keep the table at least twice as big as the number of circles, so most
+    // occupied cells get a bucket of their own.
+    unsigned buckets = 64;
+    while (buckets < 2 * n)
+    {
+        buckets *= 2;
+    }
+    mask = buckets - 1;
+
+    cellX.resize(n);
+    cellY.resize(n);
+    bucketOf.resize(n);
+    start.assign(buckets + 2, 0);
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        cellX[i] = cellCoord(xs[i]);
+        cellY[i] = cellCoord(ys[i]);
+        bucketOf[i] = 2 * radii[i] > cellSize ? buckets : bucketFor(cellX[i], cellY[i]);
+        ++start[bucketOf[i] + 1];
+    }
+
+    // Counting sort. After this, start[b] is where bucket b begins.
+    largestBucket = 0;
+    for (unsigned b = 0; b <= buckets; ++b)
+    {
+        if (b < buckets)
+        {
+            largestBucket = std::max(largestBucket, start[b + 1]);
+        }
+        start[b + 1] += start[b];
+    }
+
+    entries.resize(n);
+    for (unsigned i = n; i-- > 0;)
+    {
+        // Filling each bucket from its end, in decreasing order of index, leaves it sorted.
+        entries[--start[bucketOf[i] + 1]] = i;
+    }
+
+    // Filling from the end moved each start one bucket early, so shift them back.
+    for (unsigned b = 0; b <= buckets; ++b)
+    {
+        start[b] = start[b + 1];
+    }
+    start[buckets + 1] = n;
+
+    big.clear();
+    largestReach = 0;
+    for (unsigned e = start[buckets]; e < n; ++e)
+    {
+        unsigned i = entries[e];
+        big.push_back(Big{i, xs[i], ys[i], radii[i]});
+
+        unsigned reach = 0;
+        forEachSmallIn(xs[i] - radii[i], ys[i] - radii[i], xs[i] + radii[i], ys[i] + radii[i], i + 1, [&](unsigned) { ++reach; });
+        largestReach = std::max(largestReach, reach);
+    }
+}
+
+
+void SpatialGrid::candidatesFor(unsigned i, std::vector<unsigned>& out) const
+{
+    unsigned bigBucket = mask + 1;
+
+    if (bigBucket == bucketOf[i])
+    {
+        // Any circle that isn't big and touches this one is in a cell under it, or
+        // in a neighbouring cell.
+        auto self = std::lower_bound(big.begin(), big.end(), i, [](const Big& b, unsigned i) { return b.index < i; });
+        forEachSmallIn(self->x - self->radius, self->y - self->radius, self->x + self->radius, self->y + self->radius, i + 1, [&](unsigned j) { out.push_back(j); });
+
+        for (auto other = self + 1; other != big.end(); ++other)
+        {
+            double reach = self->radius + other->radius;
+            if (std::abs(other->x - self->x) <= reach && std::abs(other->y - self->y) <= reach)
+            {
+                out.push_back(other->index);
+            }
+        }
+        return;
+    }
+
+    unsigned visited[9];
+    unsigned numVisited = 0;
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            unsigned b = bucketFor(cellX[i] + dx, cellY[i] + dy);
+
+            // Different cells can hash to the same bucket. Don't report it twice.
+            if (std::find(visited, visited + numVisited, b) != visited + numVisited)
+            {
+                continue;
+            }
+            visited[numVisited++] = b;
+
+            // Buckets are sorted, so skip straight past i.
+            auto first = std::upper_bound(entries.begin() + start[b], entries.begin() + start[b + 1], i);
+            out.insert(out.end(), first, entries.begin() + start[b + 1]);
+        }
+    }
+
+    // Any big circle after i could reach it.
+    auto first = std::upper_bound(entries.begin() + start[bigBucket], entries.end(), i);
+    out.insert(out.end(), first, entries.end());
+}
+
+
+void SpatialGrid::query(double left, double top, double right, double bottom, std::vector<unsigned>& out) const
+{
+    forEachSmallIn(left, top, right, bottom, 0, [&](unsigned i) { out.push_back(i); });
+
+    for (const Big& b : big)
+    {
+        if (b.x + b.radius >= left && b.x - b.radius <= right && b.y + b.radius >= top && b.y - b.radius <= bottom)
+        {
+            out.push_back(b.index);
+        }
+    }
+}
+
+
+unsigned SpatialGrid::maxCandidates() const
+{
+    return std::max(9 * largestBucket, largestReach) + big.size();
+}
+
+
+double SpatialGrid::getCellSize() const
+{
+    return cellSize;
+}
+
+
+unsigned SpatialGrid::size() const
+{
+    return entries.size();
+}
+
+
+unsigned SpatialGrid::bigCount() const
+{
+    return big.size();
+}
+
+
+std::int64_t SpatialGrid::cellCoord(double v) const
+{
+    double c = std::floor(v / cellSize);
+
+    // Keep runaway particles from overflowing the conversion.
+    if (!(c > -1e15))
+    {
+        return -1000000000000000;
+    }
+    if (c > 1e15)
+    {
+        return 1000000000000000;
+    }
+
+    return c;
+}
+
+
+unsigned SpatialGrid::bucketFor(std::int64_t cx, std::int64_t cy) const
+{
+    std::uint64_t h = static_cast<std::uint64_t>(cx) * 73856093u ^ static_cast<std::uint64_t>(cy) * 19349663u;
+    return (h ^ (h >> 32)) & mask;
+}
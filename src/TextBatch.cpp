@@ -0,0 +1,164 @@
+#include "TextBatch.hpp"
+#include <algorithm>
+
+
+namespace
+{
+    // Space left between glyphs in the atlas, so filtering never picks up the edge
+    // of the glyph next door.
+    const int PADDING = 1;
+}
+
+
+int TextBatch::pack(std::vector<Glyph>& glyphs, int atlasWidth)
+{
+    int x = 0;
+    int y = 0;
+    int rowHeight = 0;
+
+    for (Glyph& glyph : glyphs)
+    {
+        if (x > 0 && x + glyph.width > atlasWidth)
+        {
+            x = 0;
+            y += rowHeight + PADDING;
+            rowHeight = 0;
+        }
+
+        glyph.atlasX = x;
+        glyph.atlasY = y;
+        x += glyph.width + PADDING;
+        rowHeight = std::max(rowHeight, glyph.height);
+    }
+
+    return y + rowHeight;
+}
+
+
+void TextBatch::setGlyphs(const std::vector<Glyph>& glyphs, int atlasWidth, int atlasHeight)
+{
+    this->glyphs = glyphs;
+    this->atlasWidth = atlasWidth;
+    this->atlasHeight = atlasHeight;
+    layouts.clear();
+}
+
+
+bool TextBatch::hasGlyphs() const
+{
+    return glyphs.size() == static_cast<std::size_t>(LAST - FIRST + 1);
+}
+
+
+void TextBatch::clear()
+{
+    textVertices.clear();
+    textIndices.clear();
+    ++frame;
+
+    for (auto it = layouts.begin(); it != layouts.end();)
+    {
+        if (frame - it->second.lastUsed > KEEP_FRAMES)
+        {
+            it = layouts.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+
+void TextBatch::addText(const std::string& text, float x, float y, Color color)
+{
+    if (!hasGlyphs())
+    {
+        return;
+    }
+
+    const Layout& l = layout(text);
+    int first = textVertices.size();
+
+    for (Vertex v : l.vertices)
+    {
+        v.x += x;
+        v.y += y;
+        v.r = color.r;
+        v.g = color.g;
+        v.b = color.b;
+        textVertices.push_back(v);
+    }
+
+    for (int quad = first; quad < static_cast<int>(textVertices.size()); quad += 4)
+    {
+        textIndices.push_back(quad);
+        textIndices.push_back(quad + 1);
+        textIndices.push_back(quad + 2);
+        textIndices.push_back(quad);
+        textIndices.push_back(quad + 2);
+        textIndices.push_back(quad + 3);
+    }
+}
+
+
+const std::vector<TextBatch::Vertex>& TextBatch::vertices() const
+{
+    return textVertices;
+}
+
+
+const std::vector<int>& TextBatch::indices() const
+{
+    return textIndices;
+}
+
+
+std::size_t TextBatch::cached() const
+{
+    return layouts.size();
+}
+
+
+TextBatch::Layout& TextBatch::layout(const std::string& text)
+{
+    auto found = layouts.find(text);
+    if (found != layouts.end())
+    {
+        found->second.lastUsed = frame;
+        return found->second;
+    }
+
+    Layout& l = layouts[text];
+    l.lastUsed = frame;
+    l.vertices.reserve(4 * text.size());
+
+    float pen = 0;
+    for (char c : text)
+    {
+        if (c < FIRST || c > LAST)
+        {
+            c = '?';
+        }
+
+        const Glyph& g = glyphs[c - FIRST];
+        float u0 = g.atlasX / atlasWidth;
+        float v0 = g.atlasY / atlasHeight;
+        float u1 = (g.atlasX + g.width) / atlasWidth;
+        float v1 = (g.atlasY + g.height) / atlasHeight;
+        float right = pen + g.width;
+        float bottom = g.height;
+
+        // Spaces and other empty glyphs only move the pen.
+        if (g.width > 0 && g.height > 0)
+        {
+            l.vertices.push_back(Vertex{pen, 0, 255, 255, 255, 255, u0, v0});
+            l.vertices.push_back(Vertex{right, 0, 255, 255, 255, 255, u1, v0});
+            l.vertices.push_back(Vertex{right, bottom, 255, 255, 255, 255, u1, v1});
+            l.vertices.push_back(Vertex{pen, bottom, 255, 255, 255, 255, u0, v1});
+        }
+        pen += g.advance;
+    }
+
+    return l;
+}
@@ -0,0 +1,181 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(unsigned threads)
+    : job{nullptr}, generation{0}, active{0}, stopping{false}, remaining{0}
+{
+    threads = std::max(threads, 1u);
+
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    // Worker 0 is whoever calls parallelFor.
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        this->threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        stopping = true;
+    }
+    jobReady.notify_all();
+
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+
+unsigned ThreadPool::size() const
+{
+    return queues.size();
+}
+
+
+void ThreadPool::parallelFor(unsigned begin, unsigned end, unsigned grain, const RangeTask& task)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    grain = std::max(grain, 1u);
+    unsigned numChunks = (end - begin + grain - 1) / grain;
+
+    // Not worth waking anyone up.
+    if (size() == 1 || numChunks == 1)
+    {
+        task(begin, end, 0);
+        return;
+    }
+
+    // The task has to be in place before any chunks are, since a worker still
+    // finishing up the last job might pick them up straight away.
+    remaining = numChunks;
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        job = &task;
+    }
+
+    // Give each worker a contiguous run of chunks, so that without any stealing
+    // every thread works on its own part of memory.
+    for (unsigned w = 0; w < size(); ++w)
+    {
+        unsigned first = numChunks * w / size();
+        unsigned last = numChunks * (w + 1) / size();
+
+        std::lock_guard<std::mutex> guard(queues[w]->lock);
+        queues[w]->chunks.clear();
+        queues[w]->front = 0;
+        for (unsigned c = first; c < last; ++c)
+        {
+            unsigned chunkBegin = begin + c * grain;
+            queues[w]->chunks.push_back(Chunk{chunkBegin, std::min(chunkBegin + grain, end)});
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        ++generation;
+    }
+    jobReady.notify_all();
+
+    runChunks(0);
+
+    // Wait for the last chunks to finish, and for every worker to let go of the task.
+    std::unique_lock<std::mutex> lock(jobLock);
+    jobDone.wait(lock, [this]() { return remaining == 0 && active == 0; });
+    job = nullptr;
+}
+
+
+unsigned ThreadPool::hardwareThreads()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+
+void ThreadPool::workerLoop(unsigned worker)
+{
+    unsigned seen = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(jobLock);
+            jobReady.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+            ++active;
+        }
+
+        runChunks(worker);
+
+        {
+            std::lock_guard<std::mutex> guard(jobLock);
+            --active;
+        }
+        jobDone.notify_all();
+    }
+}
+
+
+void ThreadPool::runChunks(unsigned worker)
+{
+    Chunk chunk;
+
+    while (takeChunk(worker, chunk))
+    {
+        (*job)(chunk.begin, chunk.end, worker);
+
+        if (--remaining == 0)
+        {
+            // Take the lock so the notification can't slip in between the caller
+            // checking the count and going to sleep.
+            std::lock_guard<std::mutex> guard(jobLock);
+            jobDone.notify_all();
+        }
+    }
+}
+
+
+bool ThreadPool::takeChunk(unsigned worker, Chunk& chunk)
+{
+    // Work through our own queue from the front.
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.front < own.chunks.size())
+        {
+            chunk = own.chunks[own.front++];
+            return true;
+        }
+    }
+
+    // Steal from the back of someone else's, where they'll get to last.
+    for (unsigned i = 1; i < size(); ++i)
+    {
+        Queue& victim = *queues[(worker + i) % size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.front < victim.chunks.size())
+        {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
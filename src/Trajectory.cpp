@@ -0,0 +1,182 @@
+#include "Trajectory.hpp"
+#include <cstring>
+
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Trajectories are only supported on little-endian machines.");
+static_assert(sizeof(Trajectory::FileHeader) == 32, "Trajectory file header has padding.");
+static_assert(sizeof(Trajectory::ChunkHeader) == 24, "Trajectory chunk header has padding.");
+static_assert(sizeof(Trajectory::FrameHeader) == 24, "Trajectory frame header has padding.");
+static_assert(sizeof(Trajectory::Trailer) == 32, "Trajectory trailer has padding.");
+
+
+const char Trajectory::FILE_MAGIC[8] = {'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J'};
+const char Trajectory::CHUNK_MAGIC[4] = {'C', 'H', 'N', 'K'};
+const char Trajectory::TRAILER_MAGIC[8] = {'G', 'R', 'A', 'V', 'T', 'I', 'D', 'X'};
+constexpr Trajectory::Field Trajectory::FIELD_BITS[FIELDS];
+
+
+namespace
+{
+    // The longest run a control byte can stand for.
+    const std::size_t MAX_RUN = 128;
+    // Zero runs shorter than this are cheaper to copy along with the bytes around them.
+    const std::size_t MIN_ZERO_RUN = 3;
+
+
+    // Return what the value at index i is compared to, given the values already
+    // before it and the previous frame.
+    template <typename U>
+    U reference(const U* values, const std::uint64_t* ids, unsigned i, const U* previous, const std::uint64_t* previousIds, unsigned previousN)
+    {
+        if (i < previousN && previousIds[i] == ids[i])
+        {
+            return previous[i];
+        }
+        return i > 0 ? values[i - 1] : 0;
+    }
+}
+
+
+void Trajectory::deltaIds(const std::uint64_t* ids, unsigned n, const std::uint64_t* previous, unsigned previousN, std::uint64_t* out)
+{
+    for (unsigned i = 0; i < n; ++i)
+    {
+        std::uint64_t base = i < previousN ? previous[i] : (i > 0 ? ids[i - 1] : 0);
+        out[i] = ids[i] - base;
+    }
+}
+
+
+void Trajectory::undeltaIds(std::uint64_t* ids, unsigned n, const std::uint64_t* previous, unsigned previousN)
+{
+    for (unsigned i = 0; i < n; ++i)
+    {
+        std::uint64_t base = i < previousN ? previous[i] : (i > 0 ? ids[i - 1] : 0);
+        ids[i] += base;
+    }
+}
+
+
+template <typename U>
+void Trajectory::deltaValues(const U* values, const std::uint64_t* ids, unsigned n, const U* previous, const std::uint64_t* previousIds, unsigned previousN, U* out)
+{
+    for (unsigned i = 0; i < n; ++i)
+    {
+        out[i] = values[i] ^ reference(values, ids, i, previous, previousIds, previousN);
+    }
+}
+
+
+template <typename U>
+void Trajectory::undeltaValues(U* values, const std::uint64_t* ids, unsigned n, const U* previous, const std::uint64_t* previousIds, unsigned previousN)
+{
+    // Each value may be compared to the one before it, so they're restored in order.
+    for (unsigned i = 0; i < n; ++i)
+    {
+        values[i] ^= reference(values, ids, i, previous, previousIds, previousN);
+    }
+}
+
+
+template void Trajectory::deltaValues<std::uint32_t>(const std::uint32_t*, const std::uint64_t*, unsigned, const std::uint32_t*, const std::uint64_t*, unsigned, std::uint32_t*);
+template void Trajectory::deltaValues<std::uint64_t>(const std::uint64_t*, const std::uint64_t*, unsigned, const std::uint64_t*, const std::uint64_t*, unsigned, std::uint64_t*);
+template void Trajectory::undeltaValues<std::uint32_t>(std::uint32_t*, const std::uint64_t*, unsigned, const std::uint32_t*, const std::uint64_t*, unsigned);
+template void Trajectory::undeltaValues<std::uint64_t>(std::uint64_t*, const std::uint64_t*, unsigned, const std::uint64_t*, const std::uint64_t*, unsigned);
+
+
+void Trajectory::shuffle(const void* values, unsigned n, unsigned width, char* out)
+{
+    const char* bytes = static_cast<const char*>(values);
+    for (unsigned b = 0; b < width; ++b)
+    {
+        char* plane = out + std::size_t(b) * n;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            plane[i] = bytes[std::size_t(i) * width + b];
+        }
+    }
+}
+
+
+void Trajectory::unshuffle(const char* shuffled, unsigned n, unsigned width, void* out)
+{
+    char* bytes = static_cast<char*>(out);
+    for (unsigned b = 0; b < width; ++b)
+    {
+        const char* plane = shuffled + std::size_t(b) * n;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            bytes[std::size_t(i) * width + b] = plane[i];
+        }
+    }
+}
+
+
+void Trajectory::encodeRuns(const char* bytes, std::size_t n, std::vector<char>& out)
+{
+    std::size_t i = 0;
+    while (i < n)
+    {
+        // Count the zeros starting here.
+        std::size_t zeros = 0;
+        while (i + zeros < n && zeros < MAX_RUN && 0 == bytes[i + zeros])
+        {
+            ++zeros;
+        }
+
+        if (zeros >= MIN_ZERO_RUN)
+        {
+            out.push_back(static_cast<char>(0x80 | (zeros - 1)));
+            i += zeros;
+            continue;
+        }
+
+        // Copy bytes until the next zero run worth storing.
+        std::size_t start = i;
+        while (i < n && i - start < MAX_RUN)
+        {
+            if (0 == bytes[i] && i + MIN_ZERO_RUN <= n
+                && 0 == bytes[i + 1] && 0 == bytes[i + 2])
+            {
+                break;
+            }
+            ++i;
+        }
+
+        out.push_back(static_cast<char>(i - start - 1));
+        out.insert(out.end(), bytes + start, bytes + i);
+    }
+}
+
+
+bool Trajectory::decodeRuns(const char* runs, std::size_t size, char* bytes, std::size_t n)
+{
+    std::size_t in = 0;
+    std::size_t pos = 0;
+    while (in < size)
+    {
+        unsigned char control = runs[in++];
+        std::size_t length = (control & 0x7F) + 1;
+        if (pos + length > n)
+        {
+            return false;
+        }
+
+        if (control & 0x80)
+        {
+            std::memset(bytes + pos, 0, length);
+        }
+        else
+        {
+            if (in + length > size)
+            {
+                return false;
+            }
+            std::memcpy(bytes + pos, runs + in, length);
+            in += length;
+        }
+        pos += length;
+    }
+
+    return pos == n;
+}
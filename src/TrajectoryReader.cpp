@@ -0,0 +1,274 @@
+#include "TrajectoryReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "Log.hpp"
+
+
+TrajectoryReader::~TrajectoryReader()
+{
+    close();
+}
+
+
+bool TrajectoryReader::open(const char* path)
+{
+    close();
+
+    file = std::fopen(path, "rb");
+    if (nullptr == file)
+    {
+        LOG_ERROR("Couldn't open the trajectory %s: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    if (std::fread(&header, sizeof(header), 1, file) != 1
+        || 0 != std::memcmp(header.magic, Trajectory::FILE_MAGIC, sizeof(header.magic)))
+    {
+        LOG_ERROR("%s isn't a trajectory", path);
+        close();
+        return false;
+    }
+    if (Trajectory::VERSION != header.version || (4 != header.realBytes && 8 != header.realBytes))
+    {
+        LOG_ERROR("%s is a version %u trajectory, but only version %u can be read", path, header.version, Trajectory::VERSION);
+        close();
+        return false;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    std::uint64_t size = std::ftell(file);
+
+    // Use the index if the file was closed properly.
+    Trajectory::Trailer trailer;
+    if (size >= sizeof(header) + sizeof(trailer)
+        && 0 == std::fseek(file, size - sizeof(trailer), SEEK_SET)
+        && std::fread(&trailer, sizeof(trailer), 1, file) == 1
+        && 0 == std::memcmp(trailer.magic, Trajectory::TRAILER_MAGIC, sizeof(trailer.magic))
+        && trailer.indexOffset + trailer.chunks * sizeof(Trajectory::IndexEntry) + sizeof(trailer) == size)
+    {
+        index.resize(trailer.chunks);
+        std::fseek(file, trailer.indexOffset, SEEK_SET);
+        if (std::fread(index.data(), sizeof(Trajectory::IndexEntry), index.size(), file) == index.size())
+        {
+            total = trailer.frames;
+            return true;
+        }
+    }
+
+    // Otherwise walk from chunk to chunk, stopping at the first one that's cut short.
+    index.clear();
+    total = 0;
+    std::uint64_t offset = sizeof(header);
+    Trajectory::ChunkHeader chunkHeader;
+    while (offset + sizeof(chunkHeader) <= size
+        && 0 == std::fseek(file, offset, SEEK_SET)
+        && std::fread(&chunkHeader, sizeof(chunkHeader), 1, file) == 1
+        && 0 == std::memcmp(chunkHeader.magic, Trajectory::CHUNK_MAGIC, sizeof(chunkHeader.magic))
+        && chunkHeader.firstFrame == total
+        && offset + sizeof(chunkHeader) + chunkHeader.bytes <= size)
+    {
+        index.push_back(Trajectory::IndexEntry{offset, total});
+        total += chunkHeader.frames;
+        offset += sizeof(chunkHeader) + chunkHeader.bytes;
+    }
+
+    LOG_WARN("%s wasn't closed properly, so only its first %llu frames can be read", path, static_cast<unsigned long long>(total));
+    return true;
+}
+
+
+void TrajectoryReader::close()
+{
+    if (file)
+    {
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    index.clear();
+    total = 0;
+    loaded = NO_CHUNK;
+}
+
+
+std::uint64_t TrajectoryReader::frames() const
+{
+    return total;
+}
+
+
+std::uint32_t TrajectoryReader::fields() const
+{
+    return header.fields;
+}
+
+
+unsigned TrajectoryReader::decimation() const
+{
+    return header.decimation;
+}
+
+
+bool TrajectoryReader::read(std::uint64_t i, Frame& out)
+{
+    if (i >= total)
+    {
+        LOG_ERROR("There's no frame %llu in a trajectory of %llu frames", static_cast<unsigned long long>(i), static_cast<unsigned long long>(total));
+        return false;
+    }
+
+    // Find the last chunk starting at or before the frame.
+    std::size_t c = std::upper_bound(index.begin(), index.end(), i, [](std::uint64_t frame, const Trajectory::IndexEntry& entry) {
+        return frame < entry.firstFrame;
+    }) - index.begin() - 1;
+
+    // Carry on from the last frame read if it's before this one in the same chunk.
+    if (loaded != c || next > i + 1)
+    {
+        if (!loadChunk(c))
+        {
+            return false;
+        }
+    }
+    while (next <= i)
+    {
+        if (!decodeNext())
+        {
+            loaded = NO_CHUNK;
+            LOG_ERROR("Frame %llu of the trajectory is corrupt", static_cast<unsigned long long>(next));
+            return false;
+        }
+    }
+
+    unsigned n = current.particles;
+    out.step = current.step;
+    out.time = current.time;
+    out.ids = ids;
+
+    std::vector<double>* fields[Trajectory::FIELDS] = {&out.x, &out.y, &out.vx, &out.vy, &out.mass};
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        fields[f]->clear();
+        if (!(header.fields & Trajectory::FIELD_BITS[f]))
+        {
+            continue;
+        }
+
+        fields[f]->resize(n);
+        for (unsigned p = 0; p < n; ++p)
+        {
+            if (4 == header.realBytes)
+            {
+                std::uint32_t value = bits[f][p];
+                float real;
+                std::memcpy(&real, &value, sizeof(real));
+                (*fields[f])[p] = real;
+            }
+            else
+            {
+                std::memcpy(&(*fields[f])[p], &bits[f][p], sizeof(double));
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool TrajectoryReader::loadChunk(std::size_t c)
+{
+    loaded = NO_CHUNK;
+
+    Trajectory::ChunkHeader chunkHeader;
+    if (0 != std::fseek(file, index[c].offset, SEEK_SET)
+        || std::fread(&chunkHeader, sizeof(chunkHeader), 1, file) != 1
+        || 0 != std::memcmp(chunkHeader.magic, Trajectory::CHUNK_MAGIC, sizeof(chunkHeader.magic)))
+    {
+        LOG_ERROR("Chunk %zu of the trajectory is corrupt", c);
+        return false;
+    }
+
+    chunk.resize(chunkHeader.bytes);
+    if (std::fread(chunk.data(), 1, chunk.size(), file) != chunk.size())
+    {
+        LOG_ERROR("Chunk %zu of the trajectory is cut short", c);
+        return false;
+    }
+
+    loaded = c;
+    cursor = 0;
+    next = chunkHeader.firstFrame;
+    chunkEnd = chunkHeader.firstFrame + chunkHeader.frames;
+    return true;
+}
+
+
+bool TrajectoryReader::decodeNext()
+{
+    Trajectory::FrameHeader frame;
+    if (next >= chunkEnd || cursor + sizeof(frame) > chunk.size())
+    {
+        return false;
+    }
+    std::memcpy(&frame, chunk.data() + cursor, sizeof(frame));
+    cursor += sizeof(frame);
+    if (cursor + frame.bytes > chunk.size())
+    {
+        return false;
+    }
+
+    unsigned fieldCount = 0;
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        fieldCount += (header.fields & Trajectory::FIELD_BITS[f]) != 0;
+    }
+
+    unsigned n = frame.particles;
+    raw.resize(std::size_t(n) * (sizeof(std::uint64_t) + fieldCount * header.realBytes));
+    if (!Trajectory::decodeRuns(chunk.data() + cursor, frame.bytes, raw.data(), raw.size()))
+    {
+        return false;
+    }
+    cursor += frame.bytes;
+
+    // The first frame of a chunk stands on its own.
+    bool first = cursor == sizeof(frame) + frame.bytes;
+    unsigned previousN = first ? 0 : current.particles;
+
+    newIds.resize(n);
+    Trajectory::unshuffle(raw.data(), n, sizeof(std::uint64_t), newIds.data());
+    Trajectory::undeltaIds(newIds.data(), n, ids.data(), previousN);
+    std::size_t pos = std::size_t(n) * sizeof(std::uint64_t);
+
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        if (!(header.fields & Trajectory::FIELD_BITS[f]))
+        {
+            continue;
+        }
+
+        // Values are widened to 64 bits before undoing the XOR, which gives the same
+        // bits as doing it at their own width.
+        newBits.resize(n);
+        if (4 == header.realBytes)
+        {
+            narrow.resize(n);
+            Trajectory::unshuffle(raw.data() + pos, n, 4, narrow.data());
+            std::copy(narrow.begin(), narrow.end(), newBits.begin());
+        }
+        else
+        {
+            Trajectory::unshuffle(raw.data() + pos, n, 8, newBits.data());
+        }
+        pos += std::size_t(n) * header.realBytes;
+
+        Trajectory::undeltaValues<std::uint64_t>(newBits.data(), newIds.data(), n, bits[f].data(), ids.data(), previousN);
+        bits[f].swap(newBits);
+    }
+
+    ids.swap(newIds);
+    current = frame;
+    ++next;
+    return true;
+}
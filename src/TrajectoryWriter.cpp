@@ -0,0 +1,282 @@
+#include "TrajectoryWriter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "Log.hpp"
+
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    close();
+}
+
+
+bool TrajectoryWriter::open(const char* path, const Options& options)
+{
+    close();
+
+    file = std::fopen(path, "wb");
+    if (nullptr == file)
+    {
+        LOG_ERROR("Couldn't open %s to write a trajectory: %s", path, std::strerror(errno));
+        return false;
+    }
+
+    this->options = options;
+    this->options.decimation = std::max(1u, options.decimation);
+    this->options.chunkFrames = std::max(1u, options.chunkFrames);
+    this->options.fields = options.fields & Trajectory::ALL;
+
+    Trajectory::FileHeader header{};
+    std::memcpy(header.magic, Trajectory::FILE_MAGIC, sizeof(header.magic));
+    header.version = Trajectory::VERSION;
+    header.realBytes = sizeof(Real);
+    header.fields = this->options.fields;
+    header.decimation = this->options.decimation;
+    header.chunkFrames = this->options.chunkFrames;
+    failed = std::fwrite(&header, sizeof(header), 1, file) != 1;
+
+    calls = 0;
+    frames = 0;
+    droppedFrames = 0;
+    chunk.clear();
+    chunkFrames = 0;
+    chunkFirst = 0;
+    encoded = 0;
+    offset = sizeof(header);
+    index.clear();
+    stop = false;
+
+    encoder = std::thread(&TrajectoryWriter::drain, this);
+    return true;
+}
+
+
+bool TrajectoryWriter::open(const char* path)
+{
+    return open(path, Options());
+}
+
+
+void TrajectoryWriter::write(const ParticleStore& particles, double time)
+{
+    if (nullptr == file)
+    {
+        return;
+    }
+
+    unsigned long long step = calls++;
+    if (step % options.decimation != 0)
+    {
+        return;
+    }
+
+    // Two frames are always with the background thread, the one being encoded and
+    // the one it's encoded against.
+    std::unique_ptr<Frame> frame;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!spare.empty())
+        {
+            frame = std::move(spare.back());
+            spare.pop_back();
+        }
+        else if (allocated < options.queueFrames + 2)
+        {
+            ++allocated;
+        }
+        else
+        {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (!frame)
+    {
+        frame = std::make_unique<Frame>();
+    }
+
+    unsigned n = particles.size();
+    frame->step = step;
+    frame->time = time;
+    frame->ids.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        frame->ids[i] = particles.idAt(i);
+    }
+
+    const std::vector<Real>* sources[Trajectory::FIELDS] = {&particles.x, &particles.y, &particles.vx, &particles.vy, &particles.mass};
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        if (options.fields & Trajectory::FIELD_BITS[f])
+        {
+            frame->fields[f].resize(n);
+            std::memcpy(frame->fields[f].data(), sources[f]->data(), n * sizeof(Real));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(std::move(frame));
+    }
+    ready.notify_one();
+    frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void TrajectoryWriter::close()
+{
+    if (nullptr == file)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    ready.notify_one();
+    encoder.join();
+
+    Trajectory::Trailer trailer{offset, index.size(), encoded, {}};
+    std::memcpy(trailer.magic, Trajectory::TRAILER_MAGIC, sizeof(trailer.magic));
+    if (std::fwrite(index.data(), sizeof(Trajectory::IndexEntry), index.size(), file) != index.size()
+        || std::fwrite(&trailer, sizeof(trailer), 1, file) != 1 || 0 != std::fclose(file))
+    {
+        failed = true;
+    }
+    file = nullptr;
+
+    if (failed)
+    {
+        LOG_ERROR("Couldn't write the whole trajectory");
+    }
+    if (droppedFrames > 0)
+    {
+        LOG_WARN("Dropped %llu trajectory frames because the disk couldn't keep up", droppedFrames.load());
+    }
+}
+
+
+bool TrajectoryWriter::isOpen() const
+{
+    return nullptr != file;
+}
+
+
+unsigned long long TrajectoryWriter::written() const
+{
+    return frames.load(std::memory_order_relaxed);
+}
+
+
+unsigned long long TrajectoryWriter::dropped() const
+{
+    return droppedFrames.load(std::memory_order_relaxed);
+}
+
+
+void TrajectoryWriter::drain()
+{
+    std::unique_ptr<Frame> previous;
+
+    while (true)
+    {
+        std::unique_ptr<Frame> frame;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return stop || !pending.empty(); });
+            if (pending.empty())
+            {
+                break;
+            }
+            frame = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        // The first frame of each chunk stands on its own.
+        encode(*frame, chunkFrames > 0 ? previous.get() : nullptr);
+        if (++chunkFrames == options.chunkFrames)
+        {
+            writeChunk();
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (previous)
+        {
+            spare.push_back(std::move(previous));
+        }
+        previous = std::move(frame);
+    }
+
+    if (chunkFrames > 0)
+    {
+        writeChunk();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (previous)
+    {
+        spare.push_back(std::move(previous));
+    }
+}
+
+
+void TrajectoryWriter::encode(const Frame& frame, const Frame* previous)
+{
+    unsigned n = frame.ids.size();
+    unsigned previousN = previous ? previous->ids.size() : 0;
+    const std::uint64_t* previousIds = previous ? previous->ids.data() : nullptr;
+
+    std::size_t bytes = std::size_t(n) * sizeof(std::uint64_t);
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        if (options.fields & Trajectory::FIELD_BITS[f])
+        {
+            bytes += std::size_t(n) * sizeof(Bits);
+        }
+    }
+    shuffled.resize(bytes);
+
+    idDelta.resize(n);
+    Trajectory::deltaIds(frame.ids.data(), n, previousIds, previousN, idDelta.data());
+    Trajectory::shuffle(idDelta.data(), n, sizeof(std::uint64_t), shuffled.data());
+    std::size_t pos = std::size_t(n) * sizeof(std::uint64_t);
+
+    delta.resize(n);
+    for (unsigned f = 0; f < Trajectory::FIELDS; ++f)
+    {
+        if (options.fields & Trajectory::FIELD_BITS[f])
+        {
+            Trajectory::deltaValues<Bits>(frame.fields[f].data(), frame.ids.data(), n, previous ? previous->fields[f].data() : nullptr, previousIds, previousN, delta.data());
+            Trajectory::shuffle(delta.data(), n, sizeof(Bits), shuffled.data() + pos);
+            pos += std::size_t(n) * sizeof(Bits);
+        }
+    }
+
+    std::size_t start = chunk.size();
+    chunk.resize(start + sizeof(Trajectory::FrameHeader));
+    Trajectory::encodeRuns(shuffled.data(), bytes, chunk);
+
+    Trajectory::FrameHeader header{frame.step, frame.time, n, static_cast<std::uint32_t>(chunk.size() - start - sizeof(header))};
+    std::memcpy(chunk.data() + start, &header, sizeof(header));
+    ++encoded;
+}
+
+
+void TrajectoryWriter::writeChunk()
+{
+    Trajectory::ChunkHeader header{{}, chunkFrames, chunkFirst, chunk.size()};
+    std::memcpy(header.magic, Trajectory::CHUNK_MAGIC, sizeof(header.magic));
+
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fwrite(chunk.data(), 1, chunk.size(), file) != chunk.size())
+    {
+        failed = true;
+    }
+
+    index.push_back(Trajectory::IndexEntry{offset, chunkFirst});
+    offset += sizeof(header) + chunk.size();
+    chunkFirst += chunkFrames;
+    chunkFrames = 0;
+    chunk.clear();
+}
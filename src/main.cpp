@@ -1,11 +1,19 @@
+#include <cstring>
 #include <iostream>
 #include "Sim.hpp"
 
 
-int main()
+int main(int argc, char** argv)
 {
     Sim Simulator = Sim(0);
 
+    // Run with --record <file> to record the session, so the headless runner can
+    // replay it with --replay <file>.
+    if (argc > 2 && 0 == std::strcmp(argv[1], "--record") && !Simulator.record(argv[2]))
+    {
+        return 1;
+    }
+
     Simulator.run();
     
     return 0;